@@ -0,0 +1,145 @@
+﻿#include "AsyncWriter.h"
+
+#include "Logger.h"
+
+bool AsyncWriter::write(const Job& job)
+{
+    std::vector<std::string> temporaryFilePaths;
+    temporaryFilePaths.reserve(job.filePaths.size());
+
+    for (auto& filePath : job.filePaths)
+        temporaryFilePaths.push_back(getTemporaryFilePath(filePath));
+
+    std::vector<std::array<WCHAR, MAX_PATH>> wideCharFilePaths(job.filePaths.size());
+    std::vector<std::array<WCHAR, MAX_PATH>> wideCharTemporaryFilePaths(job.filePaths.size());
+
+    for (size_t i = 0; i < job.filePaths.size(); i++)
+    {
+        MultiByteToWideChar(CP_UTF8, NULL, job.filePaths[i].c_str(), -1, wideCharFilePaths[i].data(), MAX_PATH);
+        MultiByteToWideChar(CP_UTF8, NULL, temporaryFilePaths[i].c_str(), -1, wideCharTemporaryFilePaths[i].data(), MAX_PATH);
+
+        // A temporary file left behind by a crashed bake would otherwise pass as written
+        DeleteFileW(wideCharTemporaryFilePaths[i].data());
+    }
+
+    // HedgeLib streams throw when they fail to write
+    bool saved;
+
+    try
+    {
+        saved = job.write(temporaryFilePaths);
+    }
+    catch (const std::exception&)
+    {
+        saved = false;
+    }
+
+    bool written = true;
+
+    for (size_t i = 0; i < job.filePaths.size(); i++)
+    {
+        if (!saved || GetFileAttributesW(wideCharTemporaryFilePaths[i].data()) == INVALID_FILE_ATTRIBUTES)
+        {
+            Logger::logFormatted(LogType::Error, "Failed to write \"%s\"", job.filePaths[i].c_str());
+            written = false;
+        }
+    }
+
+    // Don't replace any of the outputs unless all of them made it, they belong together
+    for (size_t i = 0; i < job.filePaths.size(); i++)
+    {
+        if (!written)
+        {
+            DeleteFileW(wideCharTemporaryFilePaths[i].data());
+            continue;
+        }
+
+        if (!MoveFileExW(wideCharTemporaryFilePaths[i].data(), wideCharFilePaths[i].data(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        {
+            Logger::logFormatted(LogType::Error, "Failed to replace \"%s\"", job.filePaths[i].c_str());
+            written = false;
+        }
+    }
+
+    return written;
+}
+
+void AsyncWriter::threadFunc()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock lock(criticalSection);
+            condition.wait(lock, [this] { return stopped || !jobs.empty(); });
+
+            if (jobs.empty())
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        const bool written = write(job);
+
+        if (job.complete != nullptr)
+            job.complete(written);
+
+        {
+            std::lock_guard lock(criticalSection);
+
+            pendingSize -= job.size;
+            --pendingCount;
+        }
+
+        condition.notify_all();
+    }
+}
+
+AsyncWriter::AsyncWriter(const size_t capacity) : capacity(capacity)
+{
+    thread = std::thread(&AsyncWriter::threadFunc, this);
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    wait();
+    {
+        std::lock_guard lock(criticalSection);
+        stopped = true;
+    }
+
+    condition.notify_all();
+    thread.join();
+}
+
+std::string AsyncWriter::getTemporaryFilePath(const std::string& filePath)
+{
+    return filePath + ".tmp";
+}
+
+void AsyncWriter::submit(std::vector<std::string> filePaths, const size_t size, WriteFunction write, CompleteFunction complete)
+{
+    {
+        std::unique_lock lock(criticalSection);
+        condition.wait(lock, [&] { return pendingCount == 0 || pendingSize + size <= capacity; });
+
+        jobs.push_back({ std::move(filePaths), size, std::move(write), std::move(complete) });
+
+        pendingSize += size;
+        ++pendingCount;
+    }
+
+    condition.notify_all();
+}
+
+void AsyncWriter::wait()
+{
+    std::unique_lock lock(criticalSection);
+    condition.wait(lock, [this] { return pendingCount == 0; });
+}
+
+size_t AsyncWriter::getPendingSize() const
+{
+    return pendingSize;
+}
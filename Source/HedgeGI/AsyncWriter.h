@@ -0,0 +1,50 @@
+﻿#pragma once
+
+// Writes outputs on a dedicated thread so bake nodes never wait on the disk. Files are written next to their
+// destination under a temporary name and renamed once complete, an interrupted bake never leaves a partially
+// written output behind. Queued jobs are bounded by their size, submitting blocks while the queue is full.
+class AsyncWriter
+{
+public:
+    // Receives the temporary file paths, in the same order as the destination file paths of the job.
+    // Returns false if any of the files failed to write, the outputs are then left alone.
+    using WriteFunction = std::function<bool(const std::vector<std::string>& filePaths)>;
+
+    // Called on the writer thread once the files were renamed, or left alone if any of them failed to write.
+    using CompleteFunction = std::function<void(bool written)>;
+
+private:
+    struct Job
+    {
+        std::vector<std::string> filePaths;
+        size_t size;
+        WriteFunction write;
+        CompleteFunction complete;
+    };
+
+    CriticalSection criticalSection;
+    std::condition_variable_any condition;
+    std::deque<Job> jobs;
+    size_t capacity;
+    size_t pendingSize{};
+    size_t pendingCount{};
+    bool stopped{};
+    std::thread thread;
+
+    static bool write(const Job& job);
+    void threadFunc();
+
+public:
+    AsyncWriter(size_t capacity);
+    ~AsyncWriter();
+
+    static std::string getTemporaryFilePath(const std::string& filePath);
+
+    // A job larger than the capacity is still accepted once nothing else is pending, so it can never stall.
+    void submit(std::vector<std::string> filePaths, size_t size, WriteFunction write, CompleteFunction complete = nullptr);
+
+    // Blocks until every submitted job has been written.
+    void wait();
+
+    size_t getPendingSize() const;
+};
@@ -0,0 +1,105 @@
+﻿#include "BakeCostModel.h"
+
+#include "BakeParams.h"
+#include "BakePoint.h"
+#include "Instance.h"
+#include "Mesh.h"
+
+// Used until a bake has been timed on this machine
+const double DEFAULT_SECONDS_PER_UNIT = 1e-7;
+
+uint64_t BakeCostModel::computeKey(const Instance& instance, const uint16_t resolution, const bool isSg, const BakeParams& bakeParams)
+{
+    uint64_t hash = hashData(instance.name.data(), instance.name.size());
+    hash = hashValue(resolution, hash);
+    hash = hashValue(isSg, hash);
+    hash = hashValue(bakeParams.targetEngine, hash);
+    hash = hashValue(bakeParams.light.sampleCount, hash);
+    hash = hashValue(bakeParams.light.bounceCount, hash);
+    hash = hashValue(bakeParams.shadow.sampleCount, hash);
+
+    return hash;
+}
+
+double BakeCostModel::computeUnits(const Instance& instance, const uint16_t resolution, const bool isSg, const BakeParams& bakeParams)
+{
+    double uvArea = 0.0;
+    size_t triangleCount = 0;
+
+    for (auto& mesh : instance.meshes)
+    {
+        for (uint32_t i = 0; i < mesh->triangleCount; i++)
+        {
+            const Triangle& triangle = mesh->triangles[i];
+            const Vector2 ab = mesh->vertices[triangle.b].vPos - mesh->vertices[triangle.a].vPos;
+            const Vector2 ac = mesh->vertices[triangle.c].vPos - mesh->vertices[triangle.a].vPos;
+
+            uvArea += std::abs(ab.x() * ac.y() - ab.y() * ac.x()) * 0.5;
+        }
+
+        triangleCount += mesh->triangleCount;
+    }
+
+    // Overlapping charts can't cover more than the whole lightmap
+    const double texelCount = std::min(1.0, uvArea) * resolution * resolution;
+
+    // Path traced samples dominate, SG points additionally project every sample onto four lobes
+    const double sampleCost = bakeParams.light.sampleCount * (isSg ? 1.25 : 1.0) *
+        (1 + std::min(bakeParams.light.bounceCount, bakeParams.light.maxRussianRouletteDepth)) + bakeParams.shadow.sampleCount;
+
+    // Each triangle gets rasterized once per bake point offset
+    return texelCount * sampleCost + (double)triangleCount * _countof(BAKE_POINT_OFFSETS);
+}
+
+double BakeCostModel::estimate(const Instance& instance, const uint16_t resolution, const bool isSg, const BakeParams& bakeParams)
+{
+    std::lock_guard lock(criticalSection);
+
+    const double seconds = timings.get(computeKey(instance, resolution, isSg, bakeParams), 0.0);
+    if (seconds > 0.0)
+        return seconds;
+
+    return computeUnits(instance, resolution, isSg, bakeParams) * timings.get(PROP("secondsPerUnit"), DEFAULT_SECONDS_PER_UNIT);
+}
+
+void BakeCostModel::record(const Instance& instance, const uint16_t resolution, const bool isSg, const BakeParams& bakeParams, const double seconds)
+{
+    const double units = computeUnits(instance, resolution, isSg, bakeParams);
+
+    std::lock_guard lock(criticalSection);
+
+    timings.set(computeKey(instance, resolution, isSg, bakeParams), seconds);
+
+    if (units <= 0.0)
+        return;
+
+    // Moving average keeps the calibration stable against outliers
+    const size_t sampleCount = timings.get(PROP("sampleCount"), (size_t)0);
+    const double secondsPerUnit = timings.get(PROP("secondsPerUnit"), DEFAULT_SECONDS_PER_UNIT);
+
+    timings.set(PROP("secondsPerUnit"), sampleCount > 0 ? lerp(secondsPerUnit, seconds / units, 0.1f) : seconds / units);
+    timings.set(PROP("sampleCount"), sampleCount + 1);
+}
+
+void BakeCostModel::load(const std::string& filePath)
+{
+    std::lock_guard lock(criticalSection);
+    timings.load(filePath);
+}
+
+void BakeCostModel::save(const std::string& filePath)
+{
+    std::lock_guard lock(criticalSection);
+    timings.save(filePath);
+}
+
+void BakeCostModel::merge(const std::string& filePath)
+{
+    PropertyBag other;
+    other.load(filePath);
+
+    std::lock_guard lock(criticalSection);
+
+    for (auto& property : other.properties)
+        timings.set(property.key, property.value);
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include "PropertyBag.h"
+
+class Instance;
+
+struct BakeParams;
+
+// Estimates how long an instance takes to bake. The estimate is based on the lightmap area covered by the
+// instance, sample counts and triangle count, calibrated and overridden by timings recorded in earlier bakes.
+class BakeCostModel
+{
+    PropertyBag timings;
+    CriticalSection criticalSection;
+
+    static uint64_t computeKey(const Instance& instance, uint16_t resolution, bool isSg, const BakeParams& bakeParams);
+
+public:
+    static double computeUnits(const Instance& instance, uint16_t resolution, bool isSg, const BakeParams& bakeParams);
+
+    double estimate(const Instance& instance, uint16_t resolution, bool isSg, const BakeParams& bakeParams);
+    void record(const Instance& instance, uint16_t resolution, bool isSg, const BakeParams& bakeParams, double seconds);
+
+    void load(const std::string& filePath);
+    void save(const std::string& filePath);
+
+    // Takes over the timings recorded in another file.
+    void merge(const std::string& filePath);
+};
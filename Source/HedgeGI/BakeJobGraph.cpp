@@ -0,0 +1,43 @@
+﻿#include "BakeJobGraph.h"
+
+size_t BakeJobGraph::add(std::function<void()> function, const std::initializer_list<size_t> dependencies)
+{
+    return add(std::move(function), std::vector<size_t>(dependencies));
+}
+
+size_t BakeJobGraph::add(std::function<void()> function, const std::vector<size_t>& dependencies)
+{
+    const size_t index = nodes.size();
+
+    nodes.push_back(std::make_unique<JobNode>(g, [function = std::move(function)](const tbb::flow::continue_msg&)
+    {
+        function();
+        return tbb::flow::continue_msg();
+    }));
+
+    roots.push_back(dependencies.size() == 0);
+
+    for (const size_t dependency : dependencies)
+    {
+        assert(dependency < index);
+        tbb::flow::make_edge(*nodes[dependency], *nodes[index]);
+    }
+
+    return index;
+}
+
+size_t BakeJobGraph::getCount() const
+{
+    return nodes.size();
+}
+
+void BakeJobGraph::run()
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (roots[i])
+            nodes[i]->try_put(tbb::flow::continue_msg());
+    }
+
+    g.wait_for_all();
+}
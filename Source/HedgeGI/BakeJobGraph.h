@@ -0,0 +1,22 @@
+﻿#pragma once
+
+// Runs bake jobs as soon as every job they depend on has finished. Jobs without
+// a dependency between them run at the same time and share the cores.
+class BakeJobGraph
+{
+    typedef tbb::flow::continue_node<tbb::flow::continue_msg> JobNode;
+
+    tbb::flow::graph g;
+    std::vector<std::unique_ptr<JobNode>> nodes;
+    std::vector<bool> roots;
+
+public:
+    // Dependencies are indices returned by previous calls.
+    size_t add(std::function<void()> function, std::initializer_list<size_t> dependencies = {});
+    size_t add(std::function<void()> function, const std::vector<size_t>& dependencies);
+
+    size_t getCount() const;
+
+    // Blocks until every job has finished.
+    void run();
+};
@@ -0,0 +1,302 @@
+﻿#include "BakeJournal.h"
+
+#include "FileStream.h"
+#include "Logger.h"
+#include "Utilities.h"
+
+namespace
+{
+    constexpr uint32_t BAKE_JOURNAL_SIGNATURE = 0x4C4E524A; // JRNL
+    constexpr uint32_t BAKE_JOURNAL_ENTRY_SIGNATURE = 0x544E454A; // JENT
+    constexpr uint32_t BAKE_JOURNAL_VERSION = 1;
+
+    class JournalReader
+    {
+        const std::vector<uint8_t>& data;
+        size_t position;
+
+    public:
+        JournalReader(const std::vector<uint8_t>& data)
+            : data(data), position(0)
+        {
+        }
+
+        bool end() const
+        {
+            return position >= data.size();
+        }
+
+        size_t tell() const
+        {
+            return position;
+        }
+
+        template<typename T>
+        bool read(T& value)
+        {
+            if (data.size() - position < sizeof(T))
+                return false;
+
+            memcpy(&value, data.data() + position, sizeof(T));
+            position += sizeof(T);
+
+            return true;
+        }
+
+        bool read(std::string& value)
+        {
+            uint32_t length;
+            if (!read(length) || data.size() - position < length)
+                return false;
+
+            value.assign((const char*)data.data() + position, length);
+            position += (length + 3) & ~3;
+
+            return position <= data.size();
+        }
+    };
+}
+
+uint64_t BakeJournal::computeKey(const BakeJournalEntryType type, const std::string& name)
+{
+    return hashData(name.data(), name.size(), hashData(&type, sizeof(type)));
+}
+
+uint64_t BakeJournal::computeChecksum(const BakeJournalEntry& entry)
+{
+    uint64_t checksum = hashValue(entry.hash, computeKey(entry.type, entry.name));
+
+    for (auto& file : entry.files)
+    {
+        checksum = hashData(file.name.data(), file.name.size(), checksum);
+        checksum = hashValue(file.size, checksum);
+        checksum = hashValue(file.checksum, checksum);
+    }
+
+    return checksum;
+}
+
+bool BakeJournal::read(const std::string& filePath)
+{
+    std::vector<uint8_t> data;
+    {
+        const FileStream fileStream(filePath.c_str(), "rb");
+        if (!fileStream.isOpen())
+            return false;
+
+        fileStream.seek(0, SEEK_END);
+        data.resize(fileStream.tell());
+        fileStream.seek(0, SEEK_SET);
+        fileStream.read(data.data(), data.size());
+    }
+
+    JournalReader reader(data);
+
+    uint32_t signature, version;
+    if (!reader.read(signature) || !reader.read(version) || signature != BAKE_JOURNAL_SIGNATURE || version != BAKE_JOURNAL_VERSION)
+        return false;
+
+    while (!reader.end())
+    {
+        BakeJournalEntry entry;
+        uint32_t fileCount;
+        uint64_t checksum;
+
+        if (!reader.read(signature) || signature != BAKE_JOURNAL_ENTRY_SIGNATURE ||
+            !reader.read(entry.type) || !reader.read(entry.name) || !reader.read(entry.hash) || !reader.read(fileCount))
+            break;
+
+        bool valid = true;
+
+        for (uint32_t i = 0; i < fileCount && valid; i++)
+        {
+            BakeJournalFile& file = entry.files.emplace_back();
+            valid = reader.read(file.name) && reader.read(file.size) && reader.read(file.checksum);
+        }
+
+        // Anything after a torn write is garbage
+        if (!valid || !reader.read(checksum) || checksum != computeChecksum(entry))
+            break;
+
+        const uint64_t key = computeKey(entry.type, entry.name);
+        entries[key] = std::move(entry);
+    }
+
+    return true;
+}
+
+void BakeJournal::write(const BakeJournalEntry& entry) const
+{
+    file->write(BAKE_JOURNAL_ENTRY_SIGNATURE);
+    file->write(entry.type);
+    file->write(entry.name);
+    file->write(entry.hash);
+    file->write((uint32_t)entry.files.size());
+
+    for (auto& journalFile : entry.files)
+    {
+        file->write(journalFile.name);
+        file->write(journalFile.size);
+        file->write(journalFile.checksum);
+    }
+
+    file->write(computeChecksum(entry));
+}
+
+bool BakeJournal::computeFileChecksum(const std::string& filePath, uint64_t& size, uint64_t& checksum)
+{
+    const FileStream fileStream(filePath.c_str(), "rb");
+    if (!fileStream.isOpen())
+        return false;
+
+    fileStream.seek(0, SEEK_END);
+    size = (uint64_t)fileStream.tell();
+    fileStream.seek(0, SEEK_SET);
+
+    std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(0x100000);
+
+    checksum = hashData(&size, sizeof(size));
+
+    for (uint64_t remaining = size; remaining > 0;)
+    {
+        const size_t chunkSize = (size_t)std::min<uint64_t>(remaining, 0x100000);
+        fileStream.read(buffer.get(), chunkSize);
+
+        checksum = hashData(buffer.get(), chunkSize, checksum);
+        remaining -= chunkSize;
+    }
+
+    return true;
+}
+
+void BakeJournal::open(const std::string& filePath)
+{
+    std::lock_guard lock(criticalSection);
+
+    this->filePath = filePath;
+    directoryPath = std::filesystem::path(filePath).parent_path().string();
+    entries.clear();
+
+    const bool resume = read(filePath);
+
+    if (resume && !entries.empty())
+        Logger::logFormatted(LogType::Normal, "Resuming from journal with %lld completed outputs", (long long)entries.size());
+
+    // Rewrite valid entries to drop whatever got torn off at the end. The rewrite goes to a temporary
+    // file that replaces the journal once it's on disk, so a crash in between leaves the old journal intact.
+    const std::string temporaryFilePath = filePath + ".tmp";
+
+    file = std::make_unique<FileStream>(temporaryFilePath.c_str(), "wb");
+    if (!file->isOpen())
+    {
+        Logger::logFormatted(LogType::Warning, "Failed to open bake journal at %s", temporaryFilePath.c_str());
+        file = nullptr;
+        return;
+    }
+
+    file->write(BAKE_JOURNAL_SIGNATURE);
+    file->write(BAKE_JOURNAL_VERSION);
+
+    for (auto& pair : entries)
+        write(pair.second);
+
+    file->flush();
+    file = nullptr;
+
+    WCHAR wideCharFilePath[MAX_PATH];
+    WCHAR wideCharTemporaryFilePath[MAX_PATH];
+
+    MultiByteToWideChar(CP_UTF8, NULL, filePath.c_str(), -1, wideCharFilePath, MAX_PATH);
+    MultiByteToWideChar(CP_UTF8, NULL, temporaryFilePath.c_str(), -1, wideCharTemporaryFilePath, MAX_PATH);
+
+    if (!MoveFileExW(wideCharTemporaryFilePath, wideCharFilePath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        Logger::logFormatted(LogType::Warning, "Failed to replace bake journal at %s", filePath.c_str());
+        DeleteFileW(wideCharTemporaryFilePath);
+        return;
+    }
+
+    file = std::make_unique<FileStream>(filePath.c_str(), "ab");
+    if (!file->isOpen())
+    {
+        Logger::logFormatted(LogType::Warning, "Failed to open bake journal at %s", filePath.c_str());
+        file = nullptr;
+    }
+}
+
+void BakeJournal::close(const bool complete)
+{
+    std::lock_guard lock(criticalSection);
+
+    file = nullptr;
+    entries.clear();
+
+    if (complete && !filePath.empty())
+    {
+        std::error_code errorCode;
+        std::filesystem::remove(filePath, errorCode);
+    }
+}
+
+bool BakeJournal::verify(const BakeJournalEntryType type, const std::string& name, const uint64_t hash)
+{
+    BakeJournalEntry entry;
+    {
+        std::lock_guard lock(criticalSection);
+
+        const auto pair = entries.find(computeKey(type, name));
+        if (pair == entries.end() || pair->second.hash != hash)
+            return false;
+
+        entry = pair->second;
+    }
+
+    for (auto& journalFile : entry.files)
+    {
+        uint64_t size, checksum;
+
+        if (!computeFileChecksum(directoryPath + "/" + journalFile.name, size, checksum) ||
+            size != journalFile.size || checksum != journalFile.checksum)
+        {
+            Logger::logFormatted(LogType::Warning, "%s has been modified or is incomplete, baking again", journalFile.name.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void BakeJournal::record(const BakeJournalEntryType type, const std::string& name, const uint64_t hash, std::initializer_list<std::string> filePaths)
+{
+    BakeJournalEntry entry { type, name, hash };
+
+    for (auto& filePath : filePaths)
+    {
+        if (filePath.empty())
+            continue;
+
+        BakeJournalFile& journalFile = entry.files.emplace_back();
+        journalFile.name = std::filesystem::path(filePath).filename().string();
+
+        if (!computeFileChecksum(filePath, journalFile.size, journalFile.checksum))
+            return;
+    }
+
+    std::lock_guard lock(criticalSection);
+
+    if (file == nullptr)
+        return;
+
+    write(entry);
+    file->flush();
+
+    const uint64_t key = computeKey(type, name);
+
+#ifdef _DEBUG
+    // Everything appended has to read back, otherwise resuming silently drops it and every entry after it
+    BakeJournal journal;
+    assert(journal.read(filePath) && journal.entries.contains(key) && journal.entries[key].hash == hash);
+#endif
+
+    entries[key] = std::move(entry);
+}
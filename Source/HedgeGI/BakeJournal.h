@@ -0,0 +1,58 @@
+﻿#pragma once
+
+class FileStream;
+
+enum class BakeJournalEntryType : uint32_t
+{
+    Instance,
+    SHLightField,
+    MetaInstancer
+};
+
+struct BakeJournalFile
+{
+    std::string name;
+    uint64_t size{};
+    uint64_t checksum{};
+};
+
+struct BakeJournalEntry
+{
+    BakeJournalEntryType type{};
+    std::string name;
+    uint64_t hash{};
+    std::vector<BakeJournalFile> files;
+};
+
+// Append-only record of bake outputs that were completely written to the output directory.
+// Every entry gets flushed to disk before the next one, so a bake that crashed, got killed
+// or cancelled can pick up from where it stopped. Truncated entries at the end are ignored.
+class BakeJournal
+{
+    std::string filePath;
+    std::string directoryPath;
+    std::unique_ptr<FileStream> file;
+    phmap::flat_hash_map<uint64_t, BakeJournalEntry> entries;
+    CriticalSection criticalSection;
+
+    static uint64_t computeKey(BakeJournalEntryType type, const std::string& name);
+    static uint64_t computeChecksum(const BakeJournalEntry& entry);
+
+    bool read(const std::string& filePath);
+    void write(const BakeJournalEntry& entry) const;
+
+public:
+    static bool computeFileChecksum(const std::string& filePath, uint64_t& size, uint64_t& checksum);
+
+    // Loads the entries left behind by a previous bake and opens the journal for appending.
+    // Output files are expected to be in the same directory as the journal.
+    void open(const std::string& filePath);
+
+    // Removes the journal once the bake has finished, there is nothing to resume.
+    void close(bool complete);
+
+    // Checks whether the output was recorded with the same input hash and is still intact on disk.
+    bool verify(BakeJournalEntryType type, const std::string& name, uint64_t hash);
+
+    void record(BakeJournalEntryType type, const std::string& name, uint64_t hash, std::initializer_list<std::string> filePaths);
+};
@@ -0,0 +1,29 @@
+#include "BakeShard.h"
+#include "CommandLine.h"
+
+#include <xmmintrin.h>
+#include <pmmintrin.h>
+
+// Entry point of hedgegi-bake.exe, only links the baking core without any of the UI.
+int32_t main(int32_t argc, const char* argv[])
+{
+    _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+
+    Eigen::initParallel();
+
+    DirectX::Initialize();
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    // Launched by a coordinator to bake a part of the stage
+    if (argc == 3 && strcmp(argv[1], "--bake-shard") == 0)
+        std::_Exit(BakeShard::runWorker(argv[2]));
+
+    if (CommandLine::isBake(argc, argv) || CommandLine::isServe(argc, argv))
+        std::_Exit(CommandLine::run(argc, argv));
+
+    CommandLine::printUsage();
+
+    // Calling exit forces any async tasks to quit
+    std::_Exit(1);
+}
@@ -0,0 +1,179 @@
+﻿#include "BakeManifest.h"
+
+#include "Bitmap.h"
+#include "Instance.h"
+#include "Light.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "Utilities.h"
+
+uint64_t BakeManifest::hashMaterial(const Material& material, uint64_t hash) const
+{
+    hash = hashValue(material.type, hash);
+    hash = hashValue(material.skyType, hash);
+    hash = hashValue(material.skySqrt, hash);
+    hash = hashValue(material.ignoreVertexColor, hash);
+    hash = hashValue(material.hasMetalness, hash);
+
+    // Parameters start with colors only, hash the flags separately to skip the padding
+    hash = hashData(&material.parameters, offsetof(Material::Parameters, doubleSided), hash);
+    hash = hashValue(material.parameters.doubleSided, hash);
+    hash = hashValue(material.parameters.additive, hash);
+
+    for (const Bitmap* bitmap :
+    {
+        material.textures.diffuse, material.textures.specular, material.textures.gloss, material.textures.normal, material.textures.alpha,
+        material.textures.diffuseBlend, material.textures.specularBlend, material.textures.glossBlend, material.textures.normalBlend,
+        material.textures.emission, material.textures.environment
+    })
+    {
+        if (bitmap == nullptr)
+        {
+            hash = hashValue<uint64_t>(0, hash);
+            continue;
+        }
+
+        const auto pair = bitmapHashes.find(bitmap);
+        hash = hashValue(pair != bitmapHashes.end() ? pair->second : hashBitmap(*bitmap, 0), hash);
+    }
+
+    return hash;
+}
+
+uint64_t BakeManifest::hashBitmap(const Bitmap& bitmap, uint64_t hash)
+{
+    hash = hashValue(bitmap.width, hash);
+    hash = hashValue(bitmap.height, hash);
+    hash = hashValue(bitmap.arraySize, hash);
+    hash = hashValue(bitmap.type, hash);
+    hash = hashValue(bitmap.getTexelSize(), hash);
+
+    return hashData(bitmap.data, bitmap.getDataSize(), hash);
+}
+
+uint64_t BakeManifest::hashMesh(const Mesh& mesh, uint64_t hash)
+{
+    hash = hashValue(mesh.type, hash);
+    hash = hashValue(mesh.vertexCount, hash);
+    hash = hashValue(mesh.triangleCount, hash);
+
+    for (uint32_t i = 0; i < mesh.vertexCount; i++)
+    {
+        const Vertex& vertex = mesh.vertices[i];
+
+        hash = hashData(vertex.position.data(), sizeof(float) * 3, hash);
+        hash = hashData(vertex.normal.data(), sizeof(float) * 3, hash);
+        hash = hashData(vertex.tangent.data(), sizeof(float) * 3, hash);
+        hash = hashData(vertex.binormal.data(), sizeof(float) * 3, hash);
+        hash = hashData(vertex.uv.data(), sizeof(float) * 2, hash);
+        hash = hashData(vertex.vPos.data(), sizeof(float) * 2, hash);
+        hash = hashData(vertex.color.data(), sizeof(float) * 4, hash);
+    }
+
+    return hashData(mesh.triangles.get(), sizeof(Triangle) * mesh.triangleCount, hash);
+}
+
+uint64_t BakeManifest::hashLight(const Light& light, uint64_t hash)
+{
+    hash = hashValue(light.type, hash);
+    hash = hashData(light.position.data(), sizeof(float) * 3, hash);
+    hash = hashData(light.color.data(), sizeof(float) * 3, hash);
+    hash = hashData(light.range.data(), sizeof(float) * 4, hash);
+    hash = hashValue(light.shadowRadius, hash);
+    hash = hashValue(light.castShadow, hash);
+
+    return hash;
+}
+
+bool BakeManifest::affects(const Light& light, const Instance& instance)
+{
+    if (light.type == LightType::Directional)
+        return true;
+
+    return instance.aabb.squaredExteriorDistance(light.position) < light.range.w() * light.range.w();
+}
+
+void BakeManifest::hashBitmaps(const Scene& scene)
+{
+    std::vector<uint64_t> results(scene.bitmaps.size());
+
+    tbb::parallel_for<size_t>(0, scene.bitmaps.size(), [&](const size_t i)
+    {
+        results[i] = hashBitmap(*scene.bitmaps[i], 0);
+    });
+
+    std::lock_guard lock(criticalSection);
+
+    for (size_t i = 0; i < scene.bitmaps.size(); i++)
+        bitmapHashes[scene.bitmaps[i].get()] = results[i];
+}
+
+uint64_t BakeManifest::computeHash(const Scene& scene, const Instance& instance, uint64_t seed) const
+{
+    // Meshes hash independently, their hashes get folded in order afterwards
+    std::vector<uint64_t> meshHashes(instance.meshes.size());
+
+    tbb::parallel_for<size_t>(0, instance.meshes.size(), [&](const size_t i)
+    {
+        const Mesh& mesh = *instance.meshes[i];
+
+        uint64_t meshHash = hashMesh(mesh, 0);
+
+        if (mesh.material != nullptr)
+            meshHash = hashMaterial(*mesh.material, meshHash);
+
+        meshHashes[i] = meshHash;
+    });
+
+    uint64_t hash = hashData(meshHashes.data(), meshHashes.size() * sizeof(uint64_t), seed);
+
+    for (auto& light : scene.lights)
+    {
+        if (affects(*light, instance))
+            hash = hashLight(*light, hash);
+    }
+
+    return hash;
+}
+
+bool BakeManifest::matches(const Instance& instance, const uint64_t hash)
+{
+    std::lock_guard lock(criticalSection);
+    return hashes.get<uint64_t>(instance.name) == hash;
+}
+
+bool BakeManifest::contains(const Instance& instance)
+{
+    std::lock_guard lock(criticalSection);
+    return hashes.get<uint64_t>(instance.name) != 0;
+}
+
+void BakeManifest::record(const Instance& instance, const uint64_t hash)
+{
+    std::lock_guard lock(criticalSection);
+    hashes.set(instance.name, hash);
+}
+
+void BakeManifest::load(const std::string& filePath)
+{
+    std::lock_guard lock(criticalSection);
+    hashes.load(filePath);
+}
+
+void BakeManifest::save(const std::string& filePath)
+{
+    std::lock_guard lock(criticalSection);
+    hashes.save(filePath);
+}
+
+void BakeManifest::merge(const std::string& filePath)
+{
+    PropertyBag other;
+    other.load(filePath);
+
+    std::lock_guard lock(criticalSection);
+
+    for (auto& property : other.properties)
+        hashes.set(property.key, property.value);
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "PropertyBag.h"
+
+class Bitmap;
+class Instance;
+class Light;
+class Material;
+class Mesh;
+class Scene;
+
+// Records a hash over the inputs of every baked instance in the output directory.
+// Instances whose hash still matches the recorded one don't need to be baked again.
+class BakeManifest
+{
+    PropertyBag hashes;
+    phmap::flat_hash_map<const Bitmap*, uint64_t> bitmapHashes;
+    CriticalSection criticalSection;
+
+    uint64_t hashMaterial(const Material& material, uint64_t hash) const;
+
+public:
+    static uint64_t hashBitmap(const Bitmap& bitmap, uint64_t hash);
+    static uint64_t hashMesh(const Mesh& mesh, uint64_t hash);
+    static uint64_t hashLight(const Light& light, uint64_t hash);
+
+    static bool affects(const Light& light, const Instance& instance);
+
+    // Hashes every texture in the scene up front, they are shared between instances.
+    void hashBitmaps(const Scene& scene);
+
+    // Covers the meshes, materials and textures of the instance and the lights reaching it.
+    // Anything else affecting the output (bake settings etc.) should be passed through the seed.
+    uint64_t computeHash(const Scene& scene, const Instance& instance, uint64_t seed) const;
+
+    bool matches(const Instance& instance, uint64_t hash);
+    bool contains(const Instance& instance);
+    void record(const Instance& instance, uint64_t hash);
+
+    void load(const std::string& filePath);
+    void save(const std::string& filePath);
+
+    // Takes over the hashes recorded in another manifest file.
+    void merge(const std::string& filePath);
+};
@@ -1,6 +1,8 @@
 ﻿#include "BakeParams.h"
 #include "PropertyBag.h"
 
+#include "BlockCompressor.h"
+
 #include "OidnDenoiserDevice.h"
 #include "OptixDenoiserDevice.h"
 
@@ -41,8 +43,10 @@ void BakeParams::load(const PropertyBag& propertyBag)
 
     postProcess.denoiseShadowMap = propertyBag.get(PROP("bakeParams.denoiseShadowMap"), true);
     postProcess.optimizeSeams = propertyBag.get(PROP("bakeParams.optimizeSeams"), true);
+    postProcess.denoiseProbes = propertyBag.get(PROP("bakeParams.denoiseProbes"), false);
+    postProcess.compressionQuality = propertyBag.get(PROP("bakeParams.compressionQuality"), BlockCompressionQuality::Normal);
     postProcess.denoiserType = propertyBag.get(PROP("bakeParams.denoiserType"), 
-        OptixDenoiserDevice::available ? DenoiserType::Optix : OidnDenoiserDevice::available ? DenoiserType::Oidn : DenoiserType::None);
+        OptixDenoiserDevice::available ? DenoiserType::Optix : OidnDenoiserDevice::available ? DenoiserType::Oidn : DenoiserType::Bilateral);
 
     lightField.minCellRadius = propertyBag.get(PROP("bakeParams.lightFieldMinCellRadius"), 5.0f);
     lightField.aabbSizeMultiplier = propertyBag.get(PROP("bakeParams.lightFieldAabbSizeMultiplier"), 1.0f);
@@ -83,6 +87,8 @@ void BakeParams::store(PropertyBag& propertyBag) const
 
     propertyBag.set(PROP("bakeParams.denoiseShadowMap"), postProcess.denoiseShadowMap);
     propertyBag.set(PROP("bakeParams.optimizeSeams"), postProcess.optimizeSeams);
+    propertyBag.set(PROP("bakeParams.denoiseProbes"), postProcess.denoiseProbes);
+    propertyBag.set(PROP("bakeParams.compressionQuality"), postProcess.compressionQuality);
     propertyBag.set(PROP("bakeParams.denoiserType"), postProcess.denoiserType);
 
     propertyBag.set(PROP("bakeParams.lightFieldMinCellRadius"), lightField.minCellRadius);
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 class PropertyBag;
+enum class BlockCompressionQuality;
 
 enum class EnvironmentMode
 {
@@ -56,7 +57,8 @@ enum class DenoiserType
 {
     None,
     Optix,
-    Oidn
+    Oidn,
+    Bilateral
 };
 
 struct PostProcessParams
@@ -64,6 +66,12 @@ struct PostProcessParams
     DenoiserType denoiserType;
     bool denoiseShadowMap;
     bool optimizeSeams;
+
+    // Light field probes and meta instancer points, SH light fields always go through the selected denoiser
+    bool denoiseProbes;
+
+    // Block compressed outputs and the atlases packed from them
+    BlockCompressionQuality compressionQuality;
 };
 
 struct LightFieldParams
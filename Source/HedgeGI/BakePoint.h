@@ -1,5 +1,8 @@
 ﻿#pragma once
 
+#include "BakeProgress.h"
+#include "BitmapPool.h"
+#include "CoverageMap.h"
 #include "Instance.h"
 #include "Logger.h"
 #include "Math.h"
@@ -115,81 +118,63 @@ inline bool validateVPos(const Vector2& vPos)
 }
 
 template <typename TBakePoint>
-std::vector<TBakePoint> createBakePoints(const RaytracingContext& raytracingContext, const Instance& instance, const uint16_t size)
+BakePointArray<TBakePoint> createBakePoints(const Instance& instance, const CoverageMap& coverageMap, BakeProgress* progress = nullptr)
 {
+    const uint16_t size = coverageMap.size;
     const float factor = 0.5f * (1.0f / (float)size);
 
-    std::vector<TBakePoint> bakePoints;
+    BakePointArray<TBakePoint> bakePoints;
     bakePoints.resize(size * size);
 
-    size_t triCount = 0;
-    size_t validTriCount = 0;
+    BakeProgress::Context taskContext(progress);
 
-    for (auto& mesh : instance.meshes)
+    tbb::parallel_for(tbb::blocked_range<uint16_t>(0, size), [&](const tbb::blocked_range<uint16_t>& range)
     {
-        triCount += mesh->triangleCount;
-        
-        for (uint32_t i = 0; i < mesh->triangleCount; i++)
+        for (uint16_t y = range.begin(); y < range.end(); y++)
         {
-            const Triangle& triangle = mesh->triangles[i];
-            const Vertex& a = mesh->vertices[triangle.a];
-            const Vertex& b = mesh->vertices[triangle.b];
-            const Vertex& c = mesh->vertices[triangle.c];
+            if (progress != nullptr && progress->isCancelled())
+                return;
 
-            // Check if the triangle is valid (but keep processing it to avoid false negatives)
-            validTriCount += validateVPos(a.vPos) && validateVPos(b.vPos) && validateVPos(c.vPos) &&
-                !nearlyEqual(a.vPos, b.vPos) && !nearlyEqual(b.vPos, c.vPos) && !nearlyEqual(c.vPos, a.vPos) ? 1u : 0u;
-
-            for (auto& offset : BAKE_POINT_OFFSETS)
+            for (uint16_t x = 0; x < size; x++)
             {
-                const Vector2 offsetScaled = offset * factor;
+                const CoverageTexel& texel = coverageMap.getTexel(x, y);
+                if (!texel.covered())
+                    continue;
+
+                const size_t meshIndex = coverageMap.getMeshIndex(texel.triangle);
+                const Mesh* mesh = instance.meshes[meshIndex];
 
-                const Vector2 aVPos = a.vPos + offsetScaled;
-                const Vector2 bVPos = b.vPos + offsetScaled;
-                const Vector2 cVPos = c.vPos + offsetScaled;
+                const Triangle& triangle = mesh->triangles[texel.triangle - coverageMap.triangleOffsets[meshIndex]];
+                const Vertex& a = mesh->vertices[triangle.a];
+                const Vertex& b = mesh->vertices[triangle.b];
+                const Vertex& c = mesh->vertices[triangle.c];
 
-                const Vector2 begin = aVPos.cwiseMin(bVPos).cwiseMin(cVPos);
-                const Vector2 end = aVPos.cwiseMax(bVPos).cwiseMax(cVPos);
+                const Vector2 offsetScaled = BAKE_POINT_OFFSETS[texel.offset] * factor;
 
-                const uint16_t xBegin = std::max(0, (uint16_t)std::roundf((float)size * begin.x()) - 1);
-                const uint16_t xEnd = std::min(size - 1, (uint16_t)std::roundf((float)size * end.x()) + 1);
+                const Vector2 vPos(((float)x + 0.5f) / (float)size, ((float)y + 0.5f) / (float)size);
+                const Vector2 baryUV = getBarycentricCoords(vPos, a.vPos + offsetScaled, b.vPos + offsetScaled, c.vPos + offsetScaled);
 
-                const uint16_t yBegin = std::max(0, (uint16_t)std::roundf((float)size * begin.y()) - 1);
-                const uint16_t yEnd = std::min(size - 1, (uint16_t)std::roundf((float)size * end.y()) + 1);
+                const Vector3 position = barycentricLerp(a.position, b.position, c.position, baryUV);
 
-                for (uint16_t x = xBegin; x <= xEnd; x++)
+                const Vector3 normal = barycentricLerp(a.normal, b.normal, c.normal, baryUV).normalized();
+                const Vector3 tangent = barycentricLerp(a.tangent, b.tangent, c.tangent, baryUV).normalized();
+                const Vector3 binormal = barycentricLerp(a.binormal, b.binormal, c.binormal, baryUV).normalized();
+
+                bakePoints[coverageMap.getIndex(x, y)] =
                 {
-                    for (uint16_t y = yBegin; y <= yEnd; y++)
-                    {
-                        const Vector2 vPos(((float)x + 0.5f) / (float)size, ((float)y + 0.5f) / (float)size);
-                        const Vector2 baryUV = getBarycentricCoords(vPos, aVPos, bVPos, cVPos);
-
-                        if (baryUV[0] < 0 || baryUV[0] > 1 ||
-                            baryUV[1] < 0 || baryUV[1] > 1 ||
-                            1 - baryUV[0] - baryUV[1] < 0 ||
-                            1 - baryUV[0] - baryUV[1] > 1)
-                            continue;
-
-                        const Vector3 position = barycentricLerp(a.position, b.position, c.position, baryUV);
-
-                        const Vector3 normal = barycentricLerp(a.normal, b.normal, c.normal, baryUV).normalized();
-                        const Vector3 tangent = barycentricLerp(a.tangent, b.tangent, c.tangent, baryUV).normalized();
-                        const Vector3 binormal = barycentricLerp(a.binormal, b.binormal, c.binormal, baryUV).normalized();
-
-                        bakePoints[y * size + x] =
-                        {
-                            position + position.cwiseAbs().cwiseProduct(normal.cwiseSign()) * 0.0000002f,
-                            tangent, binormal, normal, {}, {}, x, y
-                        };
-                    }
-                }
+                    position + position.cwiseAbs().cwiseProduct(normal.cwiseSign()) * 0.0000002f,
+                    tangent, binormal, normal, {}, {}, x, y
+                };
             }
         }
-    }
-
-    // If a good chunk of triangles are invalid, warn the user about it
-    if (validTriCount < triCount / 2)
-        Logger::logFormatted(LogType::Warning, "Instance \"%s\" has invalid lightmap UV data", instance.name.c_str());
+    }, taskContext.get());
 
     return bakePoints;
+}
+
+template <typename TBakePoint>
+BakePointArray<TBakePoint> createBakePoints(const RaytracingContext& raytracingContext, const Instance& instance, const uint16_t size)
+{
+    const std::unique_ptr<CoverageMap> coverageMap = CoverageMap::create(instance, size);
+    return createBakePoints<TBakePoint>(instance, *coverageMap);
 }
\ No newline at end of file
@@ -0,0 +1,86 @@
+﻿#include "BakeProgress.h"
+
+BakeProgress::Context::Context(BakeProgress* progress)
+    : progress(progress), context(progress != nullptr ? tbb::task_group_context::isolated : tbb::task_group_context::bound)
+{
+    if (progress == nullptr)
+        return;
+
+    std::lock_guard lock(progress->criticalSection);
+    progress->contexts.push_back(&context);
+
+    // Algorithms starting after the cancellation shouldn't run at all
+    if (progress->cancelled)
+        context.cancel_group_execution();
+}
+
+BakeProgress::Context::~Context()
+{
+    if (progress == nullptr)
+        return;
+
+    std::lock_guard lock(progress->criticalSection);
+    progress->contexts.erase(std::find(progress->contexts.begin(), progress->contexts.end(), &context));
+}
+
+tbb::task_group_context& BakeProgress::Context::get()
+{
+    return context;
+}
+
+bool BakeProgress::isCancelled() const
+{
+    return cancelled;
+}
+
+void BakeProgress::cancel()
+{
+    std::lock_guard lock(criticalSection);
+    cancelled = true;
+
+    for (auto context : contexts)
+        context->cancel_group_execution();
+}
+
+void BakeProgress::reset()
+{
+    cancelled = false;
+    done = 0;
+    total = 0;
+}
+
+void BakeProgress::begin(const size_t count)
+{
+    total += count;
+}
+
+void BakeProgress::advance(const size_t count)
+{
+    done += count;
+}
+
+void BakeProgress::end(const size_t count)
+{
+    // Cancelled kernels stop short of their count, the counters get reset by the next bake anyway
+    if (isCancelled())
+        return;
+
+    done -= count;
+    total -= count;
+}
+
+size_t BakeProgress::getDone() const
+{
+    return done;
+}
+
+size_t BakeProgress::getTotal() const
+{
+    return total;
+}
+
+float BakeProgress::getFraction() const
+{
+    const size_t currentTotal = total;
+    return currentTotal > 0 ? std::min(1.0f, (float)done / (float)currentTotal) : 0.0f;
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+// Lets the kernels of a bake stop early and report how many bake points they finished.
+// The counters only cover kernels that are running, finished kernels take their points back out.
+class BakeProgress
+{
+    CriticalSection criticalSection;
+    std::vector<tbb::task_group_context*> contexts;
+    std::atomic<bool> cancelled{};
+    std::atomic<size_t> done{};
+    std::atomic<size_t> total{};
+
+public:
+    // Task group context of a single algorithm. Algorithms running side by side each get their own,
+    // cancelling the progress cancels every one of them. Without a progress, it's a plain bound context.
+    class Context
+    {
+        BakeProgress* progress;
+        tbb::task_group_context context;
+
+    public:
+        Context(BakeProgress* progress);
+        Context(const Context&) = delete;
+        ~Context();
+
+        tbb::task_group_context& get();
+    };
+
+    bool isCancelled() const;
+    void cancel();
+
+    // Only valid while no kernel is running
+    void reset();
+
+    void begin(size_t count);
+    void advance(size_t count);
+    void end(size_t count);
+
+    size_t getDone() const;
+    size_t getTotal() const;
+    float getFraction() const;
+};
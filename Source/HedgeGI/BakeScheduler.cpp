@@ -0,0 +1,67 @@
+﻿#include "BakeScheduler.h"
+
+void BakeScheduler::admit()
+{
+    std::vector<std::function<void()>> functions;
+    {
+        std::lock_guard lock(criticalSection);
+
+        while (!jobs.empty() && (memoryUsage == 0 || memoryUsage + jobs.front().memory <= memoryBudget))
+        {
+            memoryUsage += jobs.front().memory;
+            functions.push_back(std::move(jobs.front().function));
+            jobs.pop_front();
+        }
+    }
+
+    // Run outside the lock as functions are going to push work into the flow graph
+    for (auto& function : functions)
+        function();
+}
+
+BakeScheduler::BakeScheduler(const size_t memoryBudget)
+    : memoryBudget(memoryBudget > 0 ? memoryBudget : getDefaultMemoryBudget())
+{
+}
+
+size_t BakeScheduler::getDefaultMemoryBudget()
+{
+    MEMORYSTATUSEX memoryStatus { sizeof(MEMORYSTATUSEX) };
+    if (!GlobalMemoryStatusEx(&memoryStatus))
+        return 8ull * 1024 * 1024 * 1024;
+
+    // Leave room for the scene, textures and the rest of the system
+    return (size_t)(memoryStatus.ullTotalPhys / 4 * 3);
+}
+
+size_t BakeScheduler::getMemoryBudget() const
+{
+    return memoryBudget;
+}
+
+size_t BakeScheduler::getMemoryUsage() const
+{
+    return memoryUsage;
+}
+
+void BakeScheduler::submit(const size_t memory, std::function<void()> function)
+{
+    {
+        std::lock_guard lock(criticalSection);
+        jobs.push_back({ memory, std::move(function) });
+    }
+
+    admit();
+}
+
+void BakeScheduler::release(const size_t memory)
+{
+    {
+        std::lock_guard lock(criticalSection);
+
+        assert(memoryUsage >= memory);
+        memoryUsage -= std::min(memoryUsage, memory);
+    }
+
+    admit();
+}
@@ -0,0 +1,30 @@
+﻿#pragma once
+
+// Admits work against a memory budget. Work that doesn't fit stays pending until enough memory gets released.
+// A job larger than the whole budget is still admitted once nothing else is in flight, so it can never stall.
+class BakeScheduler
+{
+    struct Job
+    {
+        size_t memory;
+        std::function<void()> function;
+    };
+
+    CriticalSection criticalSection;
+    std::deque<Job> jobs;
+    size_t memoryBudget;
+    size_t memoryUsage{};
+
+    void admit();
+
+public:
+    BakeScheduler(size_t memoryBudget);
+
+    static size_t getDefaultMemoryBudget();
+
+    size_t getMemoryBudget() const;
+    size_t getMemoryUsage() const;
+
+    void submit(size_t memory, std::function<void()> function);
+    void release(size_t memory);
+};
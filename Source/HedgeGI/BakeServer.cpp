@@ -0,0 +1,222 @@
+﻿#include "BakeServer.h"
+
+#include "BakeService.h"
+#include "CommandLine.h"
+#include "HeadlessBaker.h"
+#include "Instance.h"
+#include "Logger.h"
+#include "MetaInstancer.h"
+#include "Scene.h"
+#include "SHLightField.h"
+#include "Stage.h"
+#include "StageParams.h"
+
+namespace
+{
+    PipeOutput output;
+
+    // Bake threads log concurrently
+    std::atomic<size_t> errorCount;
+
+    void logListener(void* owner, const LogType logType, const char* text)
+    {
+        if (logType == LogType::Error)
+            ++errorCount;
+
+        output.writeLine("L%d %s", (int)logType, text);
+    }
+
+    std::vector<std::string> split(const std::string& line)
+    {
+        std::vector<std::string> tokens;
+
+        size_t begin = line.find_first_not_of(' ');
+        while (begin != std::string::npos)
+        {
+            const size_t end = line.find(' ', begin);
+            tokens.push_back(line.substr(begin, end - begin));
+            begin = line.find_first_not_of(' ', end);
+        }
+
+        return tokens;
+    }
+
+    std::filesystem::file_time_type getLastWriteTime(const std::string& directoryPath)
+    {
+        std::filesystem::file_time_type lastWriteTime{};
+
+        std::error_code errorCode;
+        for (auto& file : std::filesystem::recursive_directory_iterator(directoryPath, errorCode))
+        {
+            // Stage properties don't affect the scene, they get reloaded on every load request anyway
+            if (!file.is_regular_file() || file.path().extension() == ".hgi")
+                continue;
+
+            lastWriteTime = std::max(lastWriteTime, file.last_write_time(errorCode));
+        }
+
+        return lastWriteTime;
+    }
+}
+
+bool BakeServer::loadStage(const std::string& directoryPath)
+{
+    const auto lastWriteTime = getLastWriteTime(directoryPath);
+    const auto stage = baker->getStage();
+
+    if (stage->getScene() != nullptr && directoryPath == stageDirectoryPath && lastWriteTime == stageWriteTime)
+    {
+        const auto params = baker->getParams();
+        params->propertyBag.load(directoryPath + "/" + stage->getName() + ".hgi");
+        params->loadProperties();
+
+        Logger::logFormatted(LogType::Normal, "Reusing resident stage %s", stage->getName().c_str());
+        return true;
+    }
+
+    stageDirectoryPath.clear();
+
+    if (!baker->loadStage(directoryPath))
+        return false;
+
+    stageDirectoryPath = directoryPath;
+    stageWriteTime = lastWriteTime;
+
+    return true;
+}
+
+int32_t BakeServer::bake(const std::vector<std::string>& names)
+{
+    const auto stage = baker->getStage();
+    if (stage->getScene() == nullptr)
+    {
+        Logger::log(LogType::Error, "No stage is loaded");
+        return 1;
+    }
+
+    if (!names.empty())
+    {
+        const Scene& scene = *stage->getScene();
+        const phmap::flat_hash_set<std::string> nameSet(names.begin(), names.end());
+
+        baker->getBakeService()->setTargets(SceneLookup::findByName(scene.instances, nameSet),
+            SceneLookup::findByName(scene.shLightFields, nameSet), SceneLookup::findByName(scene.metaInstancers, nameSet));
+
+        if (!baker->getBakeService()->hasTargets())
+        {
+            Logger::log(LogType::Error, "None of the requested items exist in the stage");
+            return 1;
+        }
+    }
+
+    errorCount = 0;
+
+    baker->bake([](const size_t progress, const char* name)
+    {
+        output.writeLine("P %lld %s", (long long)progress, name);
+    });
+
+    return errorCount > 0 ? 1 : 0;
+}
+
+bool BakeServer::process(const std::string& line)
+{
+    const std::vector<std::string> tokens = split(line);
+    if (tokens.empty())
+        return true;
+
+    int32_t exitCode = 0;
+
+    if (tokens[0] == "load" && tokens.size() >= 2)
+    {
+        // Directory paths can contain spaces
+        exitCode = loadStage(line.substr(line.find(tokens[1], line.find(tokens[0]) + tokens[0].size()))) ? 0 : 1;
+    }
+    else if (tokens[0] == "option" && tokens.size() >= 2)
+    {
+        exitCode = CommandLine::applyOption(*baker->getParams(), tokens[1].c_str(), tokens.size() >= 3 ? tokens[2].c_str() : nullptr) ? 0 : 1;
+    }
+    else if (tokens[0] == "bake")
+    {
+        exitCode = bake(std::vector<std::string>(tokens.begin() + 1, tokens.end()));
+    }
+    else if (tokens[0] == "quit")
+    {
+        output.writeLine("D 0");
+        return false;
+    }
+    else
+    {
+        Logger::logFormatted(LogType::Error, "Unknown request %s", line.c_str());
+        exitCode = 1;
+    }
+
+    output.writeLine("D %d", exitCode);
+    return true;
+}
+
+BakeServer::BakeServer(const std::string& pipeName)
+    : pipeName(L"\\\\.\\pipe\\" + std::wstring(toNchar(pipeName.c_str()).data())), baker(std::make_unique<HeadlessBaker>())
+{
+}
+
+BakeServer::~BakeServer() = default;
+
+int32_t BakeServer::run()
+{
+    Logger::addListener(this, logListener);
+
+    bool running = true;
+
+    while (running)
+    {
+        const HANDLE pipe = CreateNamedPipeW(pipeName.c_str(), PIPE_ACCESS_DUPLEX,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 65536, 65536, 0, nullptr);
+
+        if (pipe == INVALID_HANDLE_VALUE)
+        {
+            Logger::logFormatted(LogType::Error, "Unable to create pipe %s", toUtf8(pipeName.c_str()).data());
+            Logger::removeListener(this);
+            return 1;
+        }
+
+        Logger::logFormatted(LogType::Normal, "Waiting for bake requests on %s", toUtf8(pipeName.c_str()).data());
+
+        if (ConnectNamedPipe(pipe, nullptr) || GetLastError() == ERROR_PIPE_CONNECTED)
+        {
+            output.setHandle(pipe);
+
+            std::string line;
+            char buffer[4096];
+            DWORD read;
+
+            while (running && ReadFile(pipe, buffer, sizeof(buffer), &read, nullptr) && read > 0)
+            {
+                for (DWORD i = 0; i < read && running; i++)
+                {
+                    if (buffer[i] == '\r')
+                        continue;
+
+                    if (buffer[i] != '\n')
+                    {
+                        line += buffer[i];
+                        continue;
+                    }
+
+                    running = process(line);
+                    line.clear();
+                }
+            }
+
+            output.setHandle(INVALID_HANDLE_VALUE);
+
+            FlushFileBuffers(pipe);
+            DisconnectNamedPipe(pipe);
+        }
+
+        CloseHandle(pipe);
+    }
+
+    Logger::removeListener(this);
+    return 0;
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+class HeadlessBaker;
+
+// Keeps a stage resident between bake requests sent through a named pipe so that the scene,
+// its Embree scene and light BVH only get rebuilt when the stage files change on disk.
+//
+// Requests are single lines, one client is served at a time:
+//   load <stage directory>      Loads the stage, reusing the resident scene if nothing changed
+//   option <name> [value]       Same options as the command line, eg. "option --mode light-field"
+//   bake [name...]              Bakes the given instances, SH light fields and meta instancers, or everything
+//   quit                        Stops the server
+//
+// Responses use the same lines as shard workers ("L<type> text", "P <progress> <name>"),
+// every request is finished with "D <exit code>".
+class BakeServer
+{
+    std::wstring pipeName;
+    std::unique_ptr<HeadlessBaker> baker;
+    std::string stageDirectoryPath;
+    std::filesystem::file_time_type stageWriteTime;
+
+    bool loadStage(const std::string& directoryPath);
+    int32_t bake(const std::vector<std::string>& names);
+    bool process(const std::string& line);
+
+public:
+    static constexpr const char* DEFAULT_PIPE_NAME = "HedgeGI";
+
+    BakeServer(const std::string& pipeName);
+    ~BakeServer();
+
+    int32_t run();
+};
@@ -1,18 +1,29 @@
 ﻿#include "BakeService.h"
 
+#include "AsyncWriter.h"
+#include "BakeCostModel.h"
+#include "BakeJobGraph.h"
+#include "BakeJournal.h"
+#include "BakeManifest.h"
+#include "BakeScheduler.h"
+#include "BakeShard.h"
 #include "BakingFactory.h"
+#include "BilateralDenoiserDevice.h"
 #include "BitmapHelper.h"
+#include "BitmapPool.h"
+#include "CoverageMap.h"
 #include "GIBaker.h"
 #include "Logger.h"
 #include "Stage.h"
 #include "StageParams.h"
-#include "Viewport.h"
 #include "SHLightField.h"
 #include "LightField.h"
 #include "Instance.h"
 #include "LightFieldBaker.h"
 #include "MetaInstancer.h"
 #include "MetaInstancerBaker.h"
+#include "NumaArenas.h"
+#include "SampleAccumulator.h"
 #include "SeamOptimizer.h"
 #include "SGGIBaker.h"
 #include "SHLightFieldBaker.h"
@@ -23,6 +34,14 @@ struct GIBakerContext
     std::string lightMapFileName;
     std::string shadowMapFileName;
     uint16_t resolution{};
+    bool isSg{};
+    size_t bakeMemory{};
+    size_t postProcessMemory{};
+    double cost{};
+    uint64_t hash{};
+    uint64_t accumulatorHash{};
+    std::unique_ptr<CoverageMap> coverageMap;
+    std::unique_ptr<SampleAccumulator> accumulator;
     GIPair pair;
     std::unique_ptr<Bitmap> combined;
 };
@@ -30,6 +49,67 @@ struct GIBakerContext
 typedef std::shared_ptr<GIBakerContext> GIBakerContextPtr;
 typedef tbb::flow::function_node<GIBakerContextPtr, GIBakerContextPtr> GIBakerFunctionNode;
 
+// Covers every setting that changes the contents of a bake output, accumulated samples stay valid across sample counts
+uint64_t computeBakeParamsHash(const StageParams& params, const Game game, const bool includeSampleCount = true)
+{
+    uint64_t hash = hashData(&game, sizeof(game));
+
+    hash = hashValue(params.targetEngine, hash);
+    hash = hashValue(params.environment.mode, hash);
+    hash = hashData(params.environment.color.data(), sizeof(float) * 3, hash);
+    hash = hashData(params.environment.secondaryColor.data(), sizeof(float) * 3, hash);
+    hash = hashValue(params.environment.colorIntensity, hash);
+    hash = hashValue(params.environment.skyIntensity, hash);
+    hash = hashValue(params.environment.skyIntensityScale, hash);
+
+    if (includeSampleCount)
+        hash = hashValue(params.light, hash);
+
+    else
+    {
+        hash = hashValue(params.light.bounceCount, hash);
+        hash = hashValue(params.light.maxRussianRouletteDepth, hash);
+    }
+
+    hash = hashValue(params.shadow, hash);
+    hash = hashValue(params.material, hash);
+    hash = hashValue(params.postProcess.denoiserType, hash);
+    hash = hashValue(params.postProcess.denoiseShadowMap, hash);
+    hash = hashValue(params.postProcess.optimizeSeams, hash);
+    hash = hashValue(params.resolutionSuperSampleScale, hash);
+
+    // Only hashed when changed, so the default keeps outputs baked before it existed valid
+    if (params.postProcess.compressionQuality != BlockCompressionQuality::Normal)
+        hash = hashValue(params.postProcess.compressionQuality, hash);
+
+    return hash;
+}
+
+uint64_t computeSHLFHash(const SHLightField& shlf, const uint64_t paramsHash)
+{
+    uint64_t hash = hashData(shlf.name.data(), shlf.name.size(), paramsHash);
+
+    hash = hashData(shlf.resolution.data(), sizeof(int) * 3, hash);
+    hash = hashData(shlf.position.data(), sizeof(float) * 3, hash);
+    hash = hashData(shlf.rotation.data(), sizeof(float) * 3, hash);
+    hash = hashData(shlf.scale.data(), sizeof(float) * 3, hash);
+
+    return hash;
+}
+
+uint64_t computeMTIHash(const MetaInstancer& mti, const uint64_t paramsHash)
+{
+    uint64_t hash = hashData(mti.name.data(), mti.name.size(), paramsHash);
+
+    for (auto& instance : mti.instances)
+    {
+        hash = hashData(instance.position.data(), sizeof(float) * 3, hash);
+        hash = hashValue(instance.type, hash);
+    }
+
+    return hash;
+}
+
 struct SHLFBakerContext
 {
     const SHLightField* shlf{};
@@ -49,6 +129,36 @@ size_t BakeService::getProgress() const
     return progress;
 }
 
+float BakeService::getProgressFraction() const
+{
+    const uint64_t total = totalCost;
+    if (total == 0)
+        return 0.0f;
+
+    // Instances in flight count by how many of their bake points are done
+    const double completed = (double)completedCost + (double)runningCost * kernelProgress.getFraction();
+    return (float)std::min(1.0, completed / (double)total);
+}
+
+double BakeService::getRemainingSeconds() const
+{
+    const uint64_t total = totalCost;
+    const uint64_t completed = completedCost;
+
+    if (total == 0 || completed == 0)
+        return -1.0;
+
+    const auto begin = std::chrono::high_resolution_clock::time_point(std::chrono::high_resolution_clock::duration(beginTime));
+    const double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+
+    return elapsed * (double)(total - completed) / (double)completed;
+}
+
+const BakeProgress& BakeService::getKernelProgress() const
+{
+    return kernelProgress;
+}
+
 const Instance* BakeService::getLastBakedInstance() const
 {
     return lastBakedInstance;
@@ -67,33 +177,98 @@ bool BakeService::isPendingCancel() const
 void BakeService::requestCancel()
 {
     g.cancel();
+    kernelProgress.cancel();
     cancel = true;
 }
 
+void BakeService::setTargets(const std::vector<const Instance*>& instances, const std::vector<const SHLightField*>& shLightFields,
+    const std::vector<const MetaInstancer*>& metaInstancers, const bool force)
+{
+    targetInstances.clear();
+    targetInstances.insert(instances.begin(), instances.end());
+
+    targetShLightFields.clear();
+    targetShLightFields.insert(shLightFields.begin(), shLightFields.end());
+
+    targetMetaInstancers.clear();
+    targetMetaInstancers.insert(metaInstancers.begin(), metaInstancers.end());
+
+    forceTargets = force;
+}
+
+bool BakeService::hasTargets() const
+{
+    return !targetInstances.empty() || !targetShLightFields.empty() || !targetMetaInstancers.empty();
+}
+
 void BakeService::bake()
 {
     g.reset();
     progress = 0;
+    totalCost = 0;
+    completedCost = 0;
+    runningCost = 0;
+    kernelProgress.reset();
     lastBakedInstance = nullptr;
     lastBakedShlf = nullptr;
     cancel = false;
 
-    get<Viewport>()->waitForBake();
-
     const auto params = get<StageParams>();
     if (!params->validateOutputDirectoryPath(true))
         return;
 
     const auto begin = std::chrono::high_resolution_clock::now();
+    beginTime = begin.time_since_epoch().count();
+
+    if (params->shardCount > 1 && params->shardName.empty() && !hasTargets() && BakeShard::canSplit(*params))
+        bakeSharded();
+
+    else
+    {
+        BitmapPool& pool = BitmapPool::get();
+        pool.resetStatistics();
+
+        BakeJournal journal;
+        journal.open(params->getShardFilePath(params->outputDirectoryPath + "/journal.bin"));
+
+        // Outputs waiting to be written may take up a quarter of the memory budget before bakes have to wait for the disk
+        AsyncWriter writer((params->memoryBudget > 0 ? (size_t)params->memoryBudget * 1024 * 1024 : BakeScheduler::getDefaultMemoryBudget()) / 4);
+
+        // Targeted bakes run every phase that has targets regardless of the mode, eg. baking
+        // the instances and SH light fields affected by a light. The phases overlap.
+        const bool targeted = hasTargets();
+
+        BakeJobGraph jobs;
+        std::vector<size_t> phases;
 
-    if (params->mode == BakingFactoryMode::GI)
-        bakeGI();
+        if (targeted ? !targetInstances.empty() : params->mode == BakingFactoryMode::GI)
+            phases.push_back(jobs.add([this, &journal, &writer] { bakeGI(journal, writer); }));
 
-    else if (params->mode == BakingFactoryMode::LightField)
-        bakeLightField();
+        if (targeted ? !targetShLightFields.empty() : params->mode == BakingFactoryMode::LightField)
+            phases.push_back(jobs.add([this, &journal, &writer] { bakeLightField(journal, writer); }));
 
-    else if (params->mode == BakingFactoryMode::MetaInstancer)
-        bakeMetaInstancer();
+        if (targeted ? !targetMetaInstancers.empty() : params->mode == BakingFactoryMode::MetaInstancer)
+            phases.push_back(jobs.add([this, &journal, &writer] { bakeMetaInstancer(journal, writer); }));
+
+        // Cancelled bakes keep the journal around to resume later
+        jobs.add([this, &journal, &writer]
+        {
+            writer.wait();
+            journal.close(!cancel);
+        }, phases);
+
+        jobs.run();
+
+        Logger::logFormatted(LogType::Normal, "Bitmap pool: %lld hits, %lld misses, %.2f MB retained", 
+            (long long)pool.getHitCount(), (long long)pool.getMissCount(), (double)pool.getRetainedSize() / (1024.0 * 1024.0));
+
+        // Don't hold on to memory between bakes
+        pool.trim();
+    }
+
+    targetInstances.clear();
+    targetShLightFields.clear();
+    targetMetaInstancers.clear();
 
     const auto end = std::chrono::high_resolution_clock::now();
     const auto duration = std::chrono::duration_cast<std::chrono::seconds>(end - begin);
@@ -105,95 +280,353 @@ void BakeService::bake()
     Logger::logFormatted(LogType::Success, "Bake completed in %02dh:%02dm:%02ds!", hours, minutes, seconds);
 }
 
-void BakeService::bakeGI()
+void BakeService::bakeSharded()
+{
+    const auto stage = get<Stage>();
+    const auto scene = stage->getScene();
+    const auto params = get<StageParams>();
+
+    const std::string costModelFilePath = params->getCacheDirectoryPath() + "/timings.bin";
+    const std::string manifestFilePath = params->outputDirectoryPath + "/manifest.bin";
+    const std::string shardDirectoryPath = params->outputDirectoryPath + "/shards";
+
+    BakeCostModel costModel;
+    costModel.load(costModelFilePath);
+
+    // Workers need the current settings, which might not have been saved to the stage properties yet
+    params->storeProperties();
+
+    std::vector<BakeShard> shards = BakeShard::split(*scene, *params, costModel, params->shardCount);
+
+    // Shard files are only left behind by unfinished bakes, anything that can't be resumed gets split from scratch
+    std::error_code errorCode;
+
+    if (BakeShard::resume(shardDirectoryPath, *params, shards))
+        Logger::logFormatted(LogType::Normal, "Resuming %lld shards of the previous bake", (long long)shards.size());
+    else
+        std::filesystem::remove_all(shardDirectoryPath, errorCode);
+
+    std::filesystem::create_directories(shardDirectoryPath, errorCode);
+    std::vector<BakeShardProcess> processes(shards.size());
+
+    phmap::flat_hash_map<std::string, const Instance*> instances;
+    for (auto& instance : scene->instances)
+        instances.emplace(instance->name, instance.get());
+
+    phmap::flat_hash_map<std::string, const SHLightField*> shLightFields;
+    for (auto& shlf : scene->shLightFields)
+        shLightFields.emplace(shlf->name, shlf.get());
+
+    std::vector<std::future<void>> futures;
+
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        BakeShard& shard = shards[i];
+        shard.stageDirectoryPath = stage->getDirectoryPath();
+
+        totalCost += (uint64_t)(shard.cost * 1000.0);
+
+        const std::string shardFilePath = shardDirectoryPath + "/" + shard.name + ".bin";
+        shard.save(shardFilePath);
+
+        if (!processes[i].launch(shardFilePath))
+        {
+            Logger::logFormatted(LogType::Error, "Failed to launch worker process for %s", shard.name.c_str());
+            continue;
+        }
+
+        Logger::logFormatted(LogType::Normal, "Launched %s with %lld items", shard.name.c_str(), (long long)shard.getCount());
+
+        // Relay worker logs and progress, progress is weighted by the shard's average cost per item
+        futures.push_back(std::async(std::launch::async, [this, &shard, &process = processes[i], &instances, &shLightFields]
+        {
+            size_t shardProgress = 0;
+            const double costPerItem = shard.cost / (double)shard.getCount();
+
+            process.readLines([&](const char* line)
+            {
+                int value;
+                int length;
+
+                if (sscanf(line, "L%d %n", &value, &length) == 1)
+                {
+                    Logger::logFormatted((LogType)value, "[%s] %s", shard.name.c_str(), line + length);
+                }
+                else if (sscanf(line, "P %d %n", &value, &length) == 1 && (size_t)value > shardProgress)
+                {
+                    const size_t delta = (size_t)value - shardProgress;
+                    shardProgress = (size_t)value;
+
+                    progress += delta;
+                    completedCost += (uint64_t)(costPerItem * (double)delta * 1000.0);
+
+                    const std::string name(line + length);
+
+                    if (const auto instance = instances.find(name); instance != instances.end())
+                        lastBakedInstance = instance->second;
+
+                    else if (const auto shlf = shLightFields.find(name); shlf != shLightFields.end())
+                        lastBakedShlf = shlf->second;
+                }
+            });
+        }));
+    }
+
+    for (auto& future : futures)
+    {
+        while (future.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+        {
+            // Workers keep their journals, the next bake resumes from them
+            if (cancel)
+            {
+                for (auto& process : processes)
+                    process.terminate();
+            }
+        }
+    }
+
+    // Merge bookkeeping of the workers back
+    BakeManifest manifest;
+    manifest.load(manifestFilePath);
+
+    bool complete = !cancel;
+
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        if (!cancel && processes[i].getExitCode() != 0)
+        {
+            Logger::logFormatted(LogType::Error, "%s exited with code %d", shards[i].name.c_str(), processes[i].getExitCode());
+            complete = false;
+        }
+
+        const std::string shardManifestFilePath = StageParams::getShardFilePath(manifestFilePath, shards[i].name);
+        const std::string shardCostModelFilePath = StageParams::getShardFilePath(costModelFilePath, shards[i].name);
+
+        manifest.merge(shardManifestFilePath);
+        costModel.merge(shardCostModelFilePath);
+
+        std::filesystem::remove(shardManifestFilePath, errorCode);
+        std::filesystem::remove(shardCostModelFilePath, errorCode);
+    }
+
+    manifest.save(manifestFilePath);
+    costModel.save(costModelFilePath);
+
+    if (complete)
+        std::filesystem::remove_all(shardDirectoryPath, errorCode);
+}
+
+void BakeService::bakeGI(BakeJournal& journal, AsyncWriter& writer)
 {
     const auto stage = get<Stage>();
     const auto game = stage->getGame();
     const auto scene = stage->getScene();
     const auto params = get<StageParams>();
 
+    BakeScheduler scheduler((size_t)params->memoryBudget * 1024 * 1024);
+
+    Logger::logFormatted(LogType::Normal, "Memory budget: %.2f GB", (double)scheduler.getMemoryBudget() / (1024.0 * 1024.0 * 1024.0));
+
+    // Buffers retained for reuse aren't tracked by the scheduler, keep them to a small share of the budget
+    BitmapPool::get().setCapacity(scheduler.getMemoryBudget() / 8);
+
+    const std::string costModelFilePath = params->getCacheDirectoryPath() + "/timings.bin";
+
+    BakeCostModel costModel;
+    costModel.load(costModelFilePath);
+
+    const std::string manifestFilePath = params->outputDirectoryPath + "/manifest.bin";
+
+    BakeManifest manifest;
+    manifest.load(manifestFilePath);
+
+    manifest.hashBitmaps(*scene);
+
+    const uint64_t paramsHash = computeBakeParamsHash(*params, game);
+    const uint64_t accumulatorParamsHash = computeBakeParamsHash(*params, game, false);
+
+    NumaArenas arenas;
+
+    // Replicas are built from within the arena of their node
+    const bool replicate = params->replicateScenePerNode && arenas.getCount() > 1;
+
+    if (replicate)
+    {
+        for (size_t i = 0; i < arenas.getCount(); i++)
+            arenas.execute(i, [&] { scene->createRTCSceneReplica(i); });
+    }
+
+    const auto finish = [this, &scheduler, &manifest, &journal](const GIBakerContextPtr& context, const bool written)
+    {
+        if (written)
+        {
+            journal.record(BakeJournalEntryType::Instance, context->instance->name, context->hash, { context->lightMapFileName, context->shadowMapFileName });
+            manifest.record(*context->instance, context->hash);
+        }
+
+        ++progress;
+        lastBakedInstance = context->instance;
+
+        context->coverageMap = nullptr;
+        context->pair = {};
+        context->combined = nullptr;
+
+        scheduler.release(context->postProcessMemory);
+    };
+
+    // Instances get spread across NUMA nodes, everything allocated while baking stays local to the node
+    const auto bakeInstance = [=, &costModel, &arenas](const GIBakerContextPtr& context)
+    {
+        const size_t node = arenas.acquire(context->cost);
+
+        arenas.execute(node, [&]
+        {
+            const auto begin = std::chrono::high_resolution_clock::now();
+
+            context->coverageMap = CoverageMap::createOrLoad(*context->instance, context->resolution, params->getCacheDirectoryPath());
+            const uint64_t cost = (uint64_t)(context->cost * 1000.0);
+            runningCost += cost;
+
+            const std::string accumulatorFilePath = SampleAccumulator::getFilePath(params->getCacheDirectoryPath(), context->instance->name, context->accumulatorHash);
+
+            if (params->accumulateSamples)
+            {
+                context->accumulator = std::make_unique<SampleAccumulator>();
+                context->accumulator->load(accumulatorFilePath, context->accumulatorHash);
+            }
+
+            const RaytracingContext raytracingContext = replicate ? scene->getRaytracingContext(node) : scene->getRaytracingContext();
+
+            context->pair = (context->isSg ? SGGIBaker::bake : GIBaker::bake)(raytracingContext, *context->instance, *context->coverageMap,
+                *static_cast<BakeParams*>(params), &kernelProgress, context->accumulator.get());
+
+            runningCost -= cost;
+
+            if (!cancel && context->accumulator != nullptr)
+            {
+                if (!context->accumulator->save(accumulatorFilePath, context->accumulatorHash))
+                    Logger::logFormatted(LogType::Warning, "%s: Failed to save accumulated samples", context->instance->name.c_str());
+
+                Logger::logFormatted(LogType::Normal, "%s: %.2f%% noise after %d sessions", context->instance->name.c_str(),
+                    context->accumulator->noise * 100.0f, context->accumulator->sessionCount);
+            }
+
+            context->accumulator = nullptr;
+
+            if (!cancel)
+            {
+                completedCost += cost;
+
+                costModel.record(*context->instance, context->resolution, context->isSg, *params,
+                    std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count());
+            }
+        });
+
+        arenas.release(node, context->cost);
+    };
+
     //====// 
     // GI //
     //====//
 
-    GIBakerFunctionNode bake(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
+    GIBakerFunctionNode bake(g, tbb::flow::unlimited, [&bakeInstance](GIBakerContextPtr context)
     {
-        context->pair = GIBaker::bake(scene->getRaytracingContext(), *context->instance, context->resolution, *static_cast<BakeParams*>(params));
+        bakeInstance(context);
         return std::move(context);
     });
 
-    GIBakerFunctionNode dilate(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
+    GIBakerFunctionNode combine(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
     {
-        context->pair.lightMap = BitmapHelper::dilate(*context->pair.lightMap);
-        context->pair.shadowMap = BitmapHelper::dilate(*context->pair.shadowMap);
+        context->combined = BitmapHelper::dilateAndCombine(*context->pair.lightMap, *context->pair.shadowMap, context->coverageMap.get());
+        context->pair = {};
 
         return std::move(context);
     });
 
-    GIBakerFunctionNode combine(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
-    {
-        context->combined = BitmapHelper::combine(*context->pair.lightMap, *context->pair.shadowMap);
-        return std::move(context);
-    });
+    // GPU and oidn denoisers go through a single device, the bilateral one runs anywhere
+    const size_t denoiseConcurrency = params->getDenoiserType() == DenoiserType::Bilateral ? tbb::flow::unlimited : 1;
 
-    GIBakerFunctionNode denoise(g, 1, [=](GIBakerContextPtr context)
+    // The bilateral denoiser is guided by the surface, it gets reconstructed once per instance
+    const auto createDenoiserGuide = [=](const GIBakerContextPtr& context)
     {
-        context->combined = BitmapHelper::denoise(*context->combined, params->getDenoiserType(), params->postProcess.denoiseShadowMap);
-        return std::move(context);
-    });
+        return params->getDenoiserType() == DenoiserType::Bilateral ? 
+            BilateralDenoiserGuide::create(*context->coverageMap, *context->instance) : nullptr;
+    };
 
-    GIBakerFunctionNode optimizeSeams(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
+    GIBakerFunctionNode denoise(g, denoiseConcurrency, [=](GIBakerContextPtr context)
     {
-        context->combined = BitmapHelper::optimizeSeams(*context->combined, *context->instance);
-        return std::move(context);
-    });
+        const std::unique_ptr<BilateralDenoiserGuide> guide = createDenoiserGuide(context);
 
-    GIBakerFunctionNode encodeReady(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
-    {
-        context->combined = BitmapHelper::makeEncodeReady(*context->combined, ENCODE_READY_FLAGS_SQRT);
+        context->combined = BitmapHelper::denoise(*context->combined, params->getDenoiserType(), params->postProcess.denoiseShadowMap, guide.get());
         return std::move(context);
     });
 
-    GIBakerFunctionNode saveSeparated(g, 1, [=](GIBakerContextPtr context)
+    GIBakerFunctionNode finalize(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
     {
-        context->combined->save(context->lightMapFileName, game == Game::Generations ? DXGI_FORMAT_R16G16B16A16_FLOAT : SGGIBaker::LIGHT_MAP_FORMAT,
-            Bitmap::transformToLightMap, params->resolutionSuperSampleScale);
+        std::unique_ptr<SeamOptimizer> seamOptimizer;
+        if (params->postProcess.optimizeSeams)
+            seamOptimizer = std::make_unique<SeamOptimizer>(*context->instance);
 
-        context->combined->save(context->shadowMapFileName, game == Game::Generations ? DXGI_FORMAT_R8_UNORM : SGGIBaker::SHADOW_MAP_FORMAT,
-            Bitmap::transformToShadowMap, params->resolutionSuperSampleScale);
-
-        ++progress;
-        lastBakedInstance = context->instance;
+        BitmapHelper::finalize(*context->combined, seamOptimizer.get(), 
+            params->targetEngine == TargetEngine::HE1 ? ENCODE_READY_FLAGS_SQRT : ENCORE_READY_FLAGS_NONE);
 
         return std::move(context);
     });
 
-    GIBakerFunctionNode save(g, tbb::flow::unlimited, [=, &saveSeparated](GIBakerContextPtr context)
+    // Outputs are handed off to the writer, the graph is kept waiting until they are on disk
+    GIBakerFunctionNode save(g, tbb::flow::unlimited, [=, &writer](GIBakerContextPtr context)
     {
+        std::vector<std::string> filePaths;
+        AsyncWriter::WriteFunction write;
+
         if (game == Game::Unleashed || (game == Game::Generations && params->targetEngine == TargetEngine::HE1))
         {
-            context->combined->save(context->lightMapFileName, Bitmap::transformToLightMap, params->resolutionSuperSampleScale);
-            context->combined->save(context->shadowMapFileName, Bitmap::transformToShadowMap, params->resolutionSuperSampleScale);
+            filePaths = { context->lightMapFileName, context->shadowMapFileName };
+            write = [=](const std::vector<std::string>& temporaryFilePaths)
+            {
+                return context->combined->save(temporaryFilePaths[0], Bitmap::transformToLightMap, params->resolutionSuperSampleScale) &&
+                    context->combined->save(temporaryFilePaths[1], Bitmap::transformToShadowMap, params->resolutionSuperSampleScale);
+            };
         }
         else if (game == Game::LostWorld)
         {
-            context->combined->save(context->lightMapFileName, DXGI_FORMAT_BC3_UNORM, nullptr, params->resolutionSuperSampleScale);
+            filePaths = { context->lightMapFileName };
+            write = [=](const std::vector<std::string>& temporaryFilePaths)
+            {
+                return context->combined->save(temporaryFilePaths[0], DXGI_FORMAT_BC3_UNORM, nullptr, params->resolutionSuperSampleScale, params->postProcess.compressionQuality);
+            };
         }
         else if (params->targetEngine == TargetEngine::HE2)
         {
-            saveSeparated.try_put(context);
+            filePaths = { context->lightMapFileName, context->shadowMapFileName };
+            write = [=](const std::vector<std::string>& temporaryFilePaths)
+            {
+                return context->combined->save(temporaryFilePaths[0], game == Game::Generations ? DXGI_FORMAT_R16G16B16A16_FLOAT : SGGIBaker::LIGHT_MAP_FORMAT,
+                    Bitmap::transformToLightMap, params->resolutionSuperSampleScale, params->postProcess.compressionQuality) &&
+
+                    context->combined->save(temporaryFilePaths[1], game == Game::Generations ? DXGI_FORMAT_R8_UNORM : SGGIBaker::SHADOW_MAP_FORMAT,
+                    Bitmap::transformToShadowMap, params->resolutionSuperSampleScale, params->postProcess.compressionQuality);
+            };
+        }
+        else
+        {
+            finish(context, false);
             return std::move(context);
         }
 
-        ++progress;
-        lastBakedInstance = context->instance;
+        g.reserve_wait();
+
+        writer.submit(std::move(filePaths), context->combined->getDataSize(), std::move(write), [=](const bool written)
+        {
+            finish(context, written);
+            g.release_wait();
+        });
 
         return std::move(context);
     });
 
-    // bake -> dilate -> combine -> denoise -> optimizeSeams -> encodeReady -> save
-    tbb::flow::make_edge(bake, dilate);
-    tbb::flow::make_edge(dilate, combine);
+    // bake -> combine (dilated) -> denoise -> finalize (seams, encode ready) -> save
+    tbb::flow::make_edge(bake, combine);
 
     GIBakerFunctionNode* output = &combine;
 
@@ -203,16 +636,10 @@ void BakeService::bakeGI()
         output = &denoise;
     }
 
-    if (params->postProcess.optimizeSeams)
+    if (params->postProcess.optimizeSeams || params->targetEngine == TargetEngine::HE1)
     {
-        tbb::flow::make_edge(*output, optimizeSeams);
-        output = &optimizeSeams;
-    }
-
-    if (params->targetEngine == TargetEngine::HE1)
-    {
-        tbb::flow::make_edge(*output, encodeReady);
-        output = &encodeReady;
+        tbb::flow::make_edge(*output, finalize);
+        output = &finalize;
     }
 
     tbb::flow::make_edge(*output, save);
@@ -221,26 +648,28 @@ void BakeService::bakeGI()
     // SGGI //
     //======//
 
-    GIBakerFunctionNode bakeSg(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
+    GIBakerFunctionNode bakeSg(g, tbb::flow::unlimited, [&bakeInstance](GIBakerContextPtr context)
     {
-        context->pair = SGGIBaker::bake(scene->getRaytracingContext(), *context->instance, context->resolution, *static_cast<BakeParams*>(params));
+        bakeInstance(context);
         return std::move(context);
     });
 
     GIBakerFunctionNode dilateSg(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
     {
-        context->pair.lightMap = BitmapHelper::dilate(*context->pair.lightMap);
-        context->pair.shadowMap = BitmapHelper::dilate(*context->pair.shadowMap);
+        context->pair.lightMap = BitmapHelper::dilate(*context->pair.lightMap, context->coverageMap.get());
+        context->pair.shadowMap = BitmapHelper::dilate(*context->pair.shadowMap, context->coverageMap.get());
 
         return std::move(context);
     });
 
-    GIBakerFunctionNode denoiseSg(g, 1, [=](GIBakerContextPtr context)
+    GIBakerFunctionNode denoiseSg(g, denoiseConcurrency, [=](GIBakerContextPtr context)
     {
-        context->pair.lightMap = BitmapHelper::denoise(*context->pair.lightMap, params->getDenoiserType());
+        const std::unique_ptr<BilateralDenoiserGuide> guide = createDenoiserGuide(context);
+
+        context->pair.lightMap = BitmapHelper::denoise(*context->pair.lightMap, params->getDenoiserType(), false, guide.get());
 
         if (params->postProcess.denoiseShadowMap)
-            context->pair.shadowMap = BitmapHelper::denoise(*context->pair.shadowMap, params->getDenoiserType());
+            context->pair.shadowMap = BitmapHelper::denoise(*context->pair.shadowMap, params->getDenoiserType(), false, guide.get());
 
         return std::move(context);
     });
@@ -248,36 +677,32 @@ void BakeService::bakeGI()
     GIBakerFunctionNode optimizeSeamsSg(g, tbb::flow::unlimited, [=](GIBakerContextPtr context)
     {
         const SeamOptimizer seamOptimizer(*context->instance);
-        context->pair.lightMap = seamOptimizer.optimize(*context->pair.lightMap);
-        context->pair.shadowMap = seamOptimizer.optimize(*context->pair.shadowMap);
+        seamOptimizer.apply(*context->pair.lightMap);
+        seamOptimizer.apply(*context->pair.shadowMap);
 
         return std::move(context);
     });
 	
-    GIBakerFunctionNode saveSgCompressed(g, 1, [=](GIBakerContextPtr context)
+    GIBakerFunctionNode saveSg(g, tbb::flow::unlimited, [=, &writer](GIBakerContextPtr context)
     {
-        context->pair.lightMap->save(context->lightMapFileName, SGGIBaker::LIGHT_MAP_FORMAT, nullptr, params->resolutionSuperSampleScale);
-        context->pair.shadowMap->save(context->shadowMapFileName, SGGIBaker::SHADOW_MAP_FORMAT, nullptr, params->resolutionSuperSampleScale);
-
-        ++progress;
-        lastBakedInstance = context->instance;
-
-        return std::move(context);
-    });
+        g.reserve_wait();
 
-    GIBakerFunctionNode saveSg(g, tbb::flow::unlimited, [=, &saveSgCompressed](GIBakerContextPtr context)
-    {
-        if (game == Game::Generations)
+        writer.submit({ context->lightMapFileName, context->shadowMapFileName }, 
+            context->pair.lightMap->getDataSize() + context->pair.shadowMap->getDataSize(), [=](const std::vector<std::string>& temporaryFilePaths)
         {
-            context->pair.lightMap->save(context->lightMapFileName, DXGI_FORMAT_R16G16B16A16_FLOAT, nullptr, params->resolutionSuperSampleScale);
-            context->pair.shadowMap->save(context->shadowMapFileName, DXGI_FORMAT_R8_UNORM, nullptr, params->resolutionSuperSampleScale);
-
-            ++progress;
-            lastBakedInstance = context->instance;
-        }
+            if (game == Game::Generations)
+            {
+                return context->pair.lightMap->save(temporaryFilePaths[0], DXGI_FORMAT_R16G16B16A16_FLOAT, nullptr, params->resolutionSuperSampleScale) &&
+                    context->pair.shadowMap->save(temporaryFilePaths[1], DXGI_FORMAT_R8_UNORM, nullptr, params->resolutionSuperSampleScale);
+            }
 
-        else
-            saveSgCompressed.try_put(context);
+            return context->pair.lightMap->save(temporaryFilePaths[0], SGGIBaker::LIGHT_MAP_FORMAT, nullptr, params->resolutionSuperSampleScale, params->postProcess.compressionQuality) &&
+                context->pair.shadowMap->save(temporaryFilePaths[1], SGGIBaker::SHADOW_MAP_FORMAT, nullptr, params->resolutionSuperSampleScale, params->postProcess.compressionQuality);
+        }, [=](const bool written)
+        {
+            finish(context, written);
+            g.release_wait();
+        });
 
         return std::move(context);
     });
@@ -301,8 +726,47 @@ void BakeService::bakeGI()
 
     tbb::flow::make_edge(*output, saveSg);
 
-    tbb::flow::function_node<const Instance*> root(g, tbb::flow::unlimited, [=, &bake, &bakeSg](const Instance* instance)
+    //==========//
+    // Schedule //
+    //==========//
+
+    tbb::flow::queue_node<GIBakerContextPtr> queue(g);
+    // Bakes are admitted against the memory budget, this additionally
+    // caps how many instances compete for the cores at the same time
+    tbb::flow::limiter_node<GIBakerContextPtr> limiter(g, params->maxConcurrentBakes > 0 ? params->maxConcurrentBakes : SIZE_MAX);
+
+    tbb::flow::function_node<GIBakerContextPtr> dispatch(g, tbb::flow::unlimited, [&bake, &bakeSg](GIBakerContextPtr context)
+    {
+        (context->isSg ? bakeSg : bake).try_put(std::move(context));
+    });
+
+    // Bake points are released once baking finishes, keep only what post-processing needs reserved
+    tbb::flow::function_node<GIBakerContextPtr, tbb::flow::continue_msg> release(g, tbb::flow::unlimited, [&scheduler](GIBakerContextPtr context)
+    {
+        scheduler.release(std::max(context->bakeMemory, context->postProcessMemory) - context->postProcessMemory);
+        return tbb::flow::continue_msg();
+    });
+
+    // queue -> limiter -> dispatch -> bake/bakeSg -> release -> limiter
+    tbb::flow::make_edge(queue, limiter);
+    tbb::flow::make_edge(limiter, dispatch);
+    tbb::flow::make_edge(bake, release);
+    tbb::flow::make_edge(bakeSg, release);
+    tbb::flow::make_edge(release, limiter.decrementer());
+
+    std::vector<GIBakerContextPtr> contexts;
+    contexts.reserve(scene->instances.size());
+
+    const bool targeted = !targetInstances.empty();
+    const bool forced = targeted && forceTargets;
+
+    for (auto& instancePtr : scene->instances)
     {
+        const Instance* instance = instancePtr.get();
+
+        if (targeted && !targetInstances.contains(instance))
+            continue;
+
         bool skip = instance->name.find("_NoGI") != std::string::npos || instance->name.find("_noGI") != std::string::npos;
 
         const bool isSg = !skip && params->targetEngine == TargetEngine::HE2 && params->propertyBag.get(instance->name + ".isSg", true);
@@ -328,13 +792,42 @@ void BakeService::bakeGI()
             }
         }
 
+        const uint16_t resolution = (uint16_t)((params->resolution.override > 0 ? params->resolution.override :
+            instance->getResolution(params->propertyBag)) * params->resolutionSuperSampleScale);
+
+        // Geometry, materials and lights only get hashed once, both bake parameter hashes are folded into the result
+        const uint64_t sceneHash = skip ? 0 : manifest.computeHash(*scene, *instance, hashValue(isSg, resolution));
+        const uint64_t hash = skip ? 0 : hashValue(paramsHash, sceneHash);
+
         lightMapFileName = params->outputDirectoryPath + "/" + lightMapFileName;
-        skip |= params->skipExistingFiles && std::filesystem::exists(lightMapFileName);
+        bool exists = std::filesystem::exists(lightMapFileName);
 
         if (!shadowMapFileName.empty())
         {
             shadowMapFileName = params->outputDirectoryPath + "/" + shadowMapFileName;
-            skip |= params->skipExistingFiles && std::filesystem::exists(shadowMapFileName);
+            exists |= std::filesystem::exists(shadowMapFileName);
+        }
+
+        const uint64_t accumulatorHash = skip || !params->accumulateSamples ? 0 : hashValue(accumulatorParamsHash, sceneHash);
+
+        // Accumulating bakes keep refining existing outputs until they get below the target noise
+        bool refine = false;
+
+        if (!skip && params->accumulateSamples)
+        {
+            float noise;
+            refine = !SampleAccumulator::readNoise(SampleAccumulator::getFilePath(params->getCacheDirectoryPath(), instance->name, accumulatorHash), accumulatorHash, noise) ||
+                noise * 100.0f > params->targetNoise;
+        }
+
+        // Outputs from before the manifest existed have no hash to compare against, keep them
+        skip |= !forced && !refine && params->skipExistingFiles && exists && (!manifest.contains(*instance) || manifest.matches(*instance, hash));
+
+        // Finished by an earlier bake that didn't get to complete
+        if (!skip && !forced && journal.verify(BakeJournalEntryType::Instance, instance->name, hash))
+        {
+            manifest.record(*instance, hash);
+            skip = true;
         }
 
         if (skip)
@@ -344,29 +837,63 @@ void BakeService::bakeGI()
             ++progress;
             lastBakedInstance = instance;
 
-            return;
+            continue;
         }
 
         auto context = std::make_shared<GIBakerContext>();
 
         context->instance = instance;
 
-        context->resolution = (uint16_t)((params->resolution.override > 0 ? params->resolution.override :
-            instance->getResolution(params->propertyBag)) * params->resolutionSuperSampleScale);
+        context->resolution = resolution;
+        context->hash = hash;
+        context->accumulatorHash = accumulatorHash;
 
         context->lightMapFileName = std::move(lightMapFileName);
         context->shadowMapFileName = std::move(shadowMapFileName);
+        context->isSg = isSg;
+
+        context->bakeMemory = isSg ? SGGIBaker::estimateMemory(context->resolution, GIBakeStage::Bake, params->getDenoiserType()) :
+            GIBaker::estimateMemory(context->resolution, GIBakeStage::Bake, params->getDenoiserType());
+
+        context->postProcessMemory = isSg ? SGGIBaker::estimateMemory(context->resolution, GIBakeStage::PostProcess, params->getDenoiserType()) :
+            GIBaker::estimateMemory(context->resolution, GIBakeStage::PostProcess, params->getDenoiserType());
+
+        // Spherical gaussians accumulate four lobes per texel
+        if (params->accumulateSamples)
+            context->bakeMemory += SampleAccumulator::estimateMemory(context->resolution, isSg ? 4u : 1u);
 
-        (isSg ? bakeSg : bake).try_put(std::move(context));
+        context->cost = costModel.estimate(*instance, context->resolution, isSg, *params);
+        totalCost += (uint64_t)(context->cost * 1000.0);
+
+        contexts.push_back(std::move(context));
+    }
+
+    // Longest jobs go first so a large instance doesn't end up baking alone at the end
+    std::stable_sort(contexts.begin(), contexts.end(), [](const GIBakerContextPtr& left, const GIBakerContextPtr& right)
+    {
+        return left->cost > right->cost;
     });
 
-    for (auto& instance : scene->instances)
-        root.try_put(instance.get());
+    for (auto& context : contexts)
+    {
+        scheduler.submit(std::max(context->bakeMemory, context->postProcessMemory), [&queue, context]
+        {
+            queue.try_put(context);
+        });
+    }
+
+    contexts.clear();
 
     g.wait_for_all();
+
+    // Shard workers keep their own copies which get merged by the coordinator
+    manifest.save(params->getShardFilePath(manifestFilePath));
+
+    if (!cancel)
+        costModel.save(params->getShardFilePath(costModelFilePath));
 }
 
-void BakeService::bakeLightField()
+void BakeService::bakeLightField(BakeJournal& journal, AsyncWriter& writer)
 {
     const auto stage = get<Stage>();
     const auto scene = stage->getScene();
@@ -374,38 +901,58 @@ void BakeService::bakeLightField()
 
     if (params->targetEngine == TargetEngine::HE2)
     {
+        const uint64_t paramsHash = computeBakeParamsHash(*params, stage->getGame());
+
         SHLFBakerFunctionNode bake(g, tbb::flow::unlimited, [=](SHLFBakerContextPtr context)
         {
-            context->bitmap = SHLightFieldBaker::bake(scene->getRaytracingContext(), *context->shlf, *static_cast<BakeParams*>(params));
+            context->bitmap = SHLightFieldBaker::bake(scene->getRaytracingContext(), *context->shlf, *static_cast<BakeParams*>(params), &kernelProgress);
             return std::move(context);
         });      
 
-        SHLFBakerFunctionNode denoise(g, 1, [=](SHLFBakerContextPtr context)
+        SHLFBakerFunctionNode save(g, tbb::flow::unlimited, [=, &journal, &writer](SHLFBakerContextPtr context)
         {
-            context->bitmap = BitmapHelper::denoise(*context->bitmap, params->getDenoiserType());
-            return std::move(context);
-        });
+            const std::string filePath = params->outputDirectoryPath + "/" + context->shlf->name + ".dds";
 
-        SHLFBakerFunctionNode save(g, tbb::flow::unlimited, [=](SHLFBakerContextPtr context)
-        {
-            context->bitmap->save(params->outputDirectoryPath + "/" + context->shlf->name + ".dds", DXGI_FORMAT_R16G16B16A16_FLOAT);
+            g.reserve_wait();
 
-            ++progress;
-            lastBakedShlf = context->shlf;
+            writer.submit({ filePath }, context->bitmap->getDataSize(), [=](const std::vector<std::string>& temporaryFilePaths)
+            {
+                return context->bitmap->save(temporaryFilePaths[0], DXGI_FORMAT_R16G16B16A16_FLOAT);
+            }, [=, &journal](const bool written)
+            {
+                if (written)
+                    journal.record(BakeJournalEntryType::SHLightField, context->shlf->name, computeSHLFHash(*context->shlf, paramsHash), { filePath });
+
+                ++progress;
+                lastBakedShlf = context->shlf;
+
+                context->bitmap = nullptr;
+                g.release_wait();
+            });
 
             return std::move(context);
         });
 
-        if (params->getDenoiserType() != DenoiserType::None)
-        {
-            tbb::flow::make_edge(bake, denoise);
-            tbb::flow::make_edge(denoise, save);
-        }
-        else
-            tbb::flow::make_edge(bake, save);
+        // SHLFs get denoised in probe space by the baker
+        tbb::flow::make_edge(bake, save);
 
         for (auto& shlf : scene->shLightFields)
+        {
+            if (!targetShLightFields.empty() && !targetShLightFields.contains(shlf.get()))
+                continue;
+
+            if ((targetShLightFields.empty() || !forceTargets) && journal.verify(BakeJournalEntryType::SHLightField, shlf->name, computeSHLFHash(*shlf, paramsHash)))
+            {
+                Logger::logFormatted(LogType::Normal, "Skipped %s", shlf->name.c_str());
+
+                ++progress;
+                lastBakedShlf = shlf.get();
+
+                continue;
+            }
+
             bake.try_put(std::make_shared<SHLFBakerContext>(shlf.get()));
+        }
 
         g.wait_for_all();
     }
@@ -415,12 +962,20 @@ void BakeService::bakeLightField()
         if (cancel)
             return;
 
-        LightFieldBaker::bake(scene->lightField, scene->getRaytracingContext(), *static_cast<BakeParams*>(params), !params->useExistingLightField);
+        LightFieldBaker::bake(scene->lightField, scene->getRaytracingContext(), *static_cast<BakeParams*>(params), !params->useExistingLightField, &kernelProgress);
 
         Logger::log(LogType::Normal, "Saving...\n");
 
         if (!cancel)
-            scene->lightField.save(params->outputDirectoryPath + "/light-field.lft");
+        {
+            writer.submit({ params->outputDirectoryPath + "/light-field.lft" }, 0, [=](const std::vector<std::string>& temporaryFilePaths)
+            {
+                scene->lightField.save(temporaryFilePaths[0]);
+                return true;
+            });
+
+            writer.wait();
+        }
 
         // Keep cells for future baking processes
         scene->lightField.clear(false);
@@ -430,22 +985,53 @@ void BakeService::bakeLightField()
     }
 }
 
-void BakeService::bakeMetaInstancer()
+void BakeService::bakeMetaInstancer(BakeJournal& journal, AsyncWriter& writer)
 {
     const auto stage = get<Stage>();
     const auto scene = stage->getScene();
     const auto params = get<StageParams>();
 
+    const uint64_t paramsHash = hashValue(params->postProcess.denoiseProbes, computeBakeParamsHash(*params, stage->getGame()));
+
     tbb::parallel_for(tbb::blocked_range<size_t>(0, scene->metaInstancers.size()), [&](const tbb::blocked_range<size_t> range)
     {
         for (size_t i = range.begin(); i < range.end(); i++)
         {
             auto& mti = *scene->metaInstancers[i];
-            MetaInstancerBaker::bake(mti, scene->getRaytracingContext(), *static_cast<BakeParams*>(params));
 
-            mti.save(params->outputDirectoryPath + "/" + mti.name + ".mti");
+            if (!targetMetaInstancers.empty() && !targetMetaInstancers.contains(&mti))
+                continue;
+
+            const uint64_t hash = computeMTIHash(mti, paramsHash);
+            const std::string filePath = params->outputDirectoryPath + "/" + mti.name + ".mti";
 
-            Logger::logFormatted(LogType::Normal, "Saved %s.mti", mti.name.c_str());
+            if ((targetMetaInstancers.empty() || !forceTargets) && journal.verify(BakeJournalEntryType::MetaInstancer, mti.name, hash))
+            {
+                Logger::logFormatted(LogType::Normal, "Skipped %s.mti", mti.name.c_str());
+
+                ++progress;
+                continue;
+            }
+
+            MetaInstancerBaker::bake(mti, scene->getRaytracingContext(), *static_cast<BakeParams*>(params), &kernelProgress);
+
+            if (cancel)
+                return;
+
+            writer.submit({ filePath }, 0, [&mti](const std::vector<std::string>& temporaryFilePaths)
+            {
+                mti.save(temporaryFilePaths[0]);
+                return true;
+            }, [=, &mti, &journal](const bool written)
+            {
+                if (written)
+                {
+                    journal.record(BakeJournalEntryType::MetaInstancer, mti.name, hash, { filePath });
+                    Logger::logFormatted(LogType::Normal, "Saved %s.mti", mti.name.c_str());
+                }
+
+                ++progress;
+            });
         }
     });
 }
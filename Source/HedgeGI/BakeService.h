@@ -1,8 +1,12 @@
 ﻿#pragma once
 
+#include "BakeProgress.h"
 #include "Component.h"
 
+class AsyncWriter;
+class BakeJournal;
 class Instance;
+class MetaInstancer;
 class SHLightField;
 
 class BakeService final : public Component
@@ -10,20 +14,45 @@ class BakeService final : public Component
     tbb::flow::graph g;
 
     std::atomic<size_t> progress{};
+    std::atomic<uint64_t> totalCost{};
+    std::atomic<uint64_t> completedCost{};
+    std::atomic<uint64_t> runningCost{};
+    std::atomic<std::chrono::high_resolution_clock::rep> beginTime{};
     std::atomic<const Instance*> lastBakedInstance{};
     std::atomic<const SHLightField*> lastBakedShlf{};
     std::atomic<bool> cancel{};
+    BakeProgress kernelProgress;
+
+    phmap::flat_hash_set<const Instance*> targetInstances;
+    phmap::flat_hash_set<const SHLightField*> targetShLightFields;
+    phmap::flat_hash_set<const MetaInstancer*> targetMetaInstancers;
+    bool forceTargets{};
 
 public:
     size_t getProgress() const;
+
+    // Progress and remaining time weighted by the estimated cost of instances, only available for GI bakes
+    float getProgressFraction() const;
+    double getRemainingSeconds() const;
+
+    // Bake points finished by the kernels that are currently running
+    const BakeProgress& getKernelProgress() const;
+
     const Instance* getLastBakedInstance() const;
     const SHLightField* getLastBakedShlf() const;
 
     bool isPendingCancel() const;
     void requestCancel();
 
+    // Restricts the next bake to the given instances, SH light fields and meta instancers.
+    // Forced targets get baked even if their outputs exist. The targets are cleared once the bake finishes.
+    void setTargets(const std::vector<const Instance*>& instances, const std::vector<const SHLightField*>& shLightFields,
+        const std::vector<const MetaInstancer*>& metaInstancers = {}, bool force = true);
+    bool hasTargets() const;
+
     void bake();
-    void bakeGI();
-    void bakeLightField();
-    void bakeMetaInstancer();
+    void bakeSharded();
+    void bakeGI(BakeJournal& journal, AsyncWriter& writer);
+    void bakeLightField(BakeJournal& journal, AsyncWriter& writer);
+    void bakeMetaInstancer(BakeJournal& journal, AsyncWriter& writer);
 };
@@ -0,0 +1,392 @@
+﻿#include "BakeShard.h"
+
+#include "BakeCostModel.h"
+#include "BakeScheduler.h"
+#include "BakeService.h"
+#include "FileStream.h"
+#include "HeadlessBaker.h"
+#include "Instance.h"
+#include "Logger.h"
+#include "MetaInstancer.h"
+#include "Scene.h"
+#include "SHLightField.h"
+#include "Stage.h"
+#include "StageParams.h"
+
+namespace
+{
+    constexpr uint32_t BAKE_SHARD_SIGNATURE = 0x48534748; // HGSH
+    constexpr uint32_t BAKE_SHARD_VERSION = 2;
+
+    PipeOutput output;
+    std::atomic<size_t> errorCount;
+
+    void logListener(void* owner, const LogType logType, const char* text)
+    {
+        if (logType == LogType::Error)
+            ++errorCount;
+
+        output.writeLine("L%d %s", (int)logType, text);
+    }
+
+    template<typename T>
+    std::vector<const T*> findByName(const std::vector<std::unique_ptr<T>>& items, const std::vector<std::string>& names)
+    {
+        std::vector<const T*> result = SceneLookup::findByName(items, phmap::flat_hash_set<std::string>(names.begin(), names.end()));
+
+        if (result.size() != names.size())
+            Logger::logFormatted(LogType::Warning, "Unable to find %lld items of the shard in the stage", (long long)(names.size() - result.size()));
+
+        return result;
+    }
+}
+
+bool BakeShard::canSplit(const StageParams& params)
+{
+    // HE1 light fields are baked as a single tree
+    return params.mode == BakingFactoryMode::GI || params.mode == BakingFactoryMode::MetaInstancer ||
+        (params.mode == BakingFactoryMode::LightField && params.targetEngine == TargetEngine::HE2);
+}
+
+std::vector<BakeShard> BakeShard::split(const Scene& scene, const StageParams& params, BakeCostModel& costModel, const size_t shardCount)
+{
+    struct Item
+    {
+        const std::string* name;
+        double cost;
+    };
+
+    std::vector<Item> items;
+
+    if (params.mode == BakingFactoryMode::GI)
+    {
+        for (auto& instance : scene.instances)
+        {
+            const uint16_t resolution = (uint16_t)((params.resolution.override > 0 ? params.resolution.override :
+                instance->getResolution(params.propertyBag)) * params.resolutionSuperSampleScale);
+
+            const bool isSg = params.targetEngine == TargetEngine::HE2 && params.propertyBag.get(instance->name + ".isSg", true);
+
+            items.push_back({ &instance->name, costModel.estimate(*instance, resolution, isSg, params) });
+        }
+    }
+    else if (params.mode == BakingFactoryMode::LightField)
+    {
+        for (auto& shlf : scene.shLightFields)
+            items.push_back({ &shlf->name, (double)shlf->resolution.prod() });
+    }
+    else if (params.mode == BakingFactoryMode::MetaInstancer)
+    {
+        for (auto& mti : scene.metaInstancers)
+            items.push_back({ &mti->name, (double)mti->instances.size() });
+    }
+
+    // Greedily hand the most expensive remaining item to the least loaded shard
+    std::stable_sort(items.begin(), items.end(), [](const Item& left, const Item& right)
+    {
+        return left.cost > right.cost;
+    });
+
+    std::vector<BakeShard> shards(std::max<size_t>(1, shardCount));
+
+    for (auto& item : items)
+    {
+        BakeShard& shard = *std::min_element(shards.begin(), shards.end(), [](const BakeShard& left, const BakeShard& right)
+        {
+            return left.cost < right.cost;
+        });
+
+        shard.cost += item.cost;
+
+        if (params.mode == BakingFactoryMode::GI)
+            shard.instances.push_back(*item.name);
+
+        else if (params.mode == BakingFactoryMode::LightField)
+            shard.shLightFields.push_back(*item.name);
+
+        else if (params.mode == BakingFactoryMode::MetaInstancer)
+            shard.metaInstancers.push_back(*item.name);
+    }
+
+    shards.erase(std::remove_if(shards.begin(), shards.end(), [](const BakeShard& shard) { return shard.getCount() == 0; }), shards.end());
+
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        char name[16];
+        sprintf(name, "shard%02lld", (long long)i);
+
+        shards[i].name = name;
+    }
+
+    configure(params, shards);
+    return shards;
+}
+
+bool BakeShard::resume(const std::string& directoryPath, const StageParams& params, std::vector<BakeShard>& shards)
+{
+    std::vector<std::string> filePaths;
+    std::error_code errorCode;
+
+    for (auto& entry : std::filesystem::directory_iterator(directoryPath, errorCode))
+    {
+        if (entry.path().extension() == ".bin")
+            filePaths.push_back(entry.path().string());
+    }
+
+    if (filePaths.empty())
+        return false;
+
+    std::sort(filePaths.begin(), filePaths.end());
+
+    std::vector<BakeShard> previousShards(filePaths.size());
+
+    for (size_t i = 0; i < filePaths.size(); i++)
+    {
+        if (!previousShards[i].load(filePaths[i]))
+            return false;
+    }
+
+    // The shards have to cover exactly what is about to be baked, otherwise the assignment is stale
+    const auto collect = [](const std::vector<BakeShard>& shards)
+    {
+        std::vector<std::string> allNames;
+
+        for (auto& shard : shards)
+        {
+            for (auto names : { &shard.instances, &shard.shLightFields, &shard.metaInstancers })
+                allNames.insert(allNames.end(), names->begin(), names->end());
+        }
+
+        std::sort(allNames.begin(), allNames.end());
+        return allNames;
+    };
+
+    if (collect(previousShards) != collect(shards))
+        return false;
+
+    // Settings come from the current bake, only the assignment and the names the journals go by are carried over
+    shards = std::move(previousShards);
+    configure(params, shards);
+
+    return true;
+}
+
+void BakeShard::configure(const StageParams& params, std::vector<BakeShard>& shards)
+{
+    if (shards.empty())
+        return;
+
+    // Without a split, every worker would assume the whole machine for itself
+    const size_t memoryBudget = params.memoryBudget > 0 ? params.memoryBudget : BakeScheduler::getDefaultMemoryBudget() / (1024 * 1024);
+    const uint32_t memoryBudgetPerShard = (uint32_t)std::max<size_t>(1, memoryBudget / shards.size());
+    const uint32_t threadCountPerShard = (uint32_t)std::max<size_t>(1, (size_t)tbb::info::default_concurrency() / shards.size());
+
+    for (auto& shard : shards)
+    {
+        shard.properties = params.propertyBag;
+        shard.properties.set(PROP("memoryBudget"), memoryBudgetPerShard);
+        shard.threadCount = threadCountPerShard;
+    }
+}
+
+int32_t BakeShard::runWorker(const std::string& filePath)
+{
+    output.setHandle(GetStdHandle(STD_OUTPUT_HANDLE));
+    Logger::addListener(nullptr, logListener);
+
+    BakeShard shard;
+    if (!shard.load(filePath))
+    {
+        Logger::logFormatted(LogType::Error, "Unable to load shard from %s", filePath.c_str());
+        return 1;
+    }
+
+    // Applies to every arena of the process, including the ones created while loading the stage
+    std::unique_ptr<tbb::global_control> threadControl;
+
+    if (shard.threadCount > 0)
+        threadControl = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, shard.threadCount);
+
+    const HeadlessBaker baker;
+    if (!baker.loadStage(shard.stageDirectoryPath))
+        return 1;
+
+    const auto params = baker.getParams();
+    const auto bakeService = baker.getBakeService();
+
+    // Use the settings the coordinator had at the time the bake started
+    params->propertyBag = shard.properties;
+    params->loadProperties();
+    params->shardName = shard.name;
+
+    const Scene& scene = *baker.getStage()->getScene();
+
+    bakeService->setTargets(findByName(scene.instances, shard.instances),
+        findByName(scene.shLightFields, shard.shLightFields), findByName(scene.metaInstancers, shard.metaInstancers), false);
+
+    if (!bakeService->hasTargets())
+        return 1;
+
+    baker.bake([](const size_t progress, const char* name)
+    {
+        output.writeLine("P %lld %s", (long long)progress, name);
+    });
+
+    // The coordinator only learns about failures through the exit code
+    return errorCount > 0 ? 1 : 0;
+}
+
+size_t BakeShard::getCount() const
+{
+    return instances.size() + shLightFields.size() + metaInstancers.size();
+}
+
+bool BakeShard::load(const std::string& filePath)
+{
+    const FileStream file(filePath.c_str(), "rb");
+    if (!file.isOpen())
+        return false;
+
+    if (file.read<uint32_t>() != BAKE_SHARD_SIGNATURE || file.read<uint32_t>() != BAKE_SHARD_VERSION)
+        return false;
+
+    name = file.readString();
+    stageDirectoryPath = file.readString();
+    cost = file.read<double>();
+    threadCount = file.read<uint32_t>();
+
+    for (auto names : { &instances, &shLightFields, &metaInstancers })
+    {
+        names->resize(file.read<uint32_t>());
+
+        for (auto& value : *names)
+            value = file.readString();
+    }
+
+    properties.read(file);
+
+    return true;
+}
+
+void BakeShard::save(const std::string& filePath) const
+{
+    const FileStream file(filePath.c_str(), "wb");
+    if (!file.isOpen())
+        return;
+
+    file.write(BAKE_SHARD_SIGNATURE);
+    file.write(BAKE_SHARD_VERSION);
+    file.write(name);
+    file.write(stageDirectoryPath);
+    file.write(cost);
+    file.write(threadCount);
+
+    for (auto names : { &instances, &shLightFields, &metaInstancers })
+    {
+        file.write((uint32_t)names->size());
+
+        for (auto& value : *names)
+            file.write(value);
+    }
+
+    properties.write(file);
+}
+
+BakeShardProcess::~BakeShardProcess()
+{
+    if (outputPipe)
+        CloseHandle(outputPipe);
+
+    if (process)
+        CloseHandle(process);
+}
+
+bool BakeShardProcess::launch(const std::string& shardFilePath)
+{
+    SECURITY_ATTRIBUTES securityAttributes = { sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+
+    HANDLE writePipe;
+    if (!CreatePipe(&outputPipe, &writePipe, &securityAttributes, 0))
+        return false;
+
+    // Only the write end should be inherited by the worker
+    SetHandleInformation(outputPipe, HANDLE_FLAG_INHERIT, 0);
+
+    wchar_t modulePath[MAX_PATH];
+    GetModuleFileNameW(nullptr, modulePath, MAX_PATH);
+
+    std::wstring commandLine = L"\"";
+    commandLine += modulePath;
+    commandLine += L"\" --bake-shard \"";
+    commandLine += toNchar(shardFilePath.c_str()).data();
+    commandLine += L"\"";
+
+    STARTUPINFOW startupInfo{};
+    startupInfo.cb = sizeof(STARTUPINFOW);
+    startupInfo.dwFlags = STARTF_USESTDHANDLES;
+    startupInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    startupInfo.hStdOutput = writePipe;
+    startupInfo.hStdError = writePipe;
+
+    PROCESS_INFORMATION processInformation{};
+
+    const bool result = CreateProcessW(nullptr, commandLine.data(), nullptr, nullptr, TRUE,
+        CREATE_NO_WINDOW, nullptr, nullptr, &startupInfo, &processInformation);
+
+    // Reads only finish once every write end is closed
+    CloseHandle(writePipe);
+
+    if (!result)
+        return false;
+
+    CloseHandle(processInformation.hThread);
+    process = processInformation.hProcess;
+
+    return true;
+}
+
+void BakeShardProcess::readLines(const std::function<void(const char*)>& function) const
+{
+    std::string line;
+    char buffer[4096];
+    DWORD read;
+
+    while (ReadFile(outputPipe, buffer, sizeof(buffer), &read, nullptr) && read > 0)
+    {
+        for (DWORD i = 0; i < read; i++)
+        {
+            if (buffer[i] == '\r')
+                continue;
+
+            if (buffer[i] != '\n')
+            {
+                line += buffer[i];
+                continue;
+            }
+
+            function(line.c_str());
+            line.clear();
+        }
+    }
+
+    if (!line.empty())
+        function(line.c_str());
+
+    WaitForSingleObject(process, INFINITE);
+}
+
+void BakeShardProcess::terminate() const
+{
+    if (process)
+        TerminateProcess(process, 1);
+}
+
+uint32_t BakeShardProcess::getExitCode() const
+{
+    DWORD exitCode = 1;
+
+    if (process)
+        GetExitCodeProcess(process, &exitCode);
+
+    return exitCode;
+}
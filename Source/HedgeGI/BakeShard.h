@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "PropertyBag.h"
+
+class BakeCostModel;
+class Scene;
+class StageParams;
+
+// Part of a bake handled by a separate worker process. Workers load the stage on their own,
+// bake only what is listed here and write to the same output directory as the coordinator.
+struct BakeShard
+{
+    std::string name;
+    std::string stageDirectoryPath;
+    std::vector<std::string> instances;
+    std::vector<std::string> shLightFields;
+    std::vector<std::string> metaInstancers;
+    PropertyBag properties;
+    double cost{};
+
+    // Worker threads the process is allowed to use, 0 leaves it to TBB
+    uint32_t threadCount{};
+
+    static bool canSplit(const StageParams& params);
+
+    // Splits the work of the current bake mode into shards of similar estimated cost, shards without any work get left out.
+    // Local workers run side by side, so each one gets an equal part of the memory budget and the cores.
+    static std::vector<BakeShard> split(const Scene& scene, const StageParams& params, BakeCostModel& costModel, size_t shardCount);
+
+    // Journals are kept per shard, so an unfinished bake has to be resumed with the shards it was split into.
+    // Replaces the shards with the ones saved in the directory, unless there are none or they don't cover the same items.
+    static bool resume(const std::string& directoryPath, const StageParams& params, std::vector<BakeShard>& shards);
+
+    // Splits the memory budget and the cores between the shards and hands them the current settings.
+    static void configure(const StageParams& params, std::vector<BakeShard>& shards);
+
+    // Entry point of worker processes, logs and progress are reported through the standard output.
+    static int32_t runWorker(const std::string& filePath);
+
+    size_t getCount() const;
+
+    bool load(const std::string& filePath);
+    void save(const std::string& filePath) const;
+};
+
+// Worker process launched by the coordinator, its standard output gets read back through a pipe.
+class BakeShardProcess
+{
+    HANDLE process{};
+    HANDLE outputPipe{};
+
+public:
+    BakeShardProcess() = default;
+    BakeShardProcess(const BakeShardProcess&) = delete;
+    ~BakeShardProcess();
+
+    bool launch(const std::string& shardFilePath);
+
+    // Blocks until the worker exits, calls the function for every line it writes.
+    void readLines(const std::function<void(const char*)>& function) const;
+
+    void terminate() const;
+    uint32_t getExitCode() const;
+};
@@ -593,12 +593,12 @@ void BakingFactory::bake(const RaytracingContext& raytracingContext, const Bitma
 
     tbb::parallel_for(tbb::blocked_range2d<size_t>(0, width, 0, height), [&](const tbb::blocked_range2d<size_t>& range)
     {
-        Random& random = Random::get();
-
         for (size_t x = range.rows().begin(); x < range.rows().end(); x++)
         {
             for (size_t y = range.cols().begin(); y < range.cols().end(); y++)
             {
+                Random random(progress, width * y + x);
+
                 float dx, dy;
 
                 if (antiAliasing && progress > 0)
@@ -660,7 +660,9 @@ bool BakingFactory::rayCast(const RaytracingContext& raytracingContext, const Ve
     RTCIntersectArguments intersectArgs;
     rtcInitIntersectArguments(&intersectArgs);
 
-    IntersectContext context(raytracingContext, Random::get());
+    Random random(0);
+
+    IntersectContext context(raytracingContext, random);
     intersectArgs.flags = static_cast<RTCRayQueryFlags>(RTC_RAY_QUERY_FLAG_INVOKE_ARGUMENT_FILTER | RTC_RAY_QUERY_FLAG_COHERENT);
     intersectArgs.context = &context;
     intersectArgs.filter = targetEngine == TargetEngine::HE2 ?
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "BakeParams.h"
+#include "BakeProgress.h"
 #include "BakePoint.h"
 #include "Bitmap.h"
 #include "Light.h"
@@ -40,8 +41,12 @@ public:
     static float sampleShadow(const RaytracingContext& raytracingContext, 
         const Vector3& position, const Vector3& direction, const Vector3& tangent, const Vector3& binormal, float distance, float radius, const BakeParams& bakeParams, Random& random);
 
+    // Stops early if the progress gets cancelled, leaving the remaining bake points untouched.
+    // Luminance moments receive the mean and mean squared luminance of the samples of every bake point.
+    // Random numbers only depend on the seed, the bake point index and the sample index, the thread count doesn't matter.
     template<typename TBakePoint>
-    static void bake(const RaytracingContext& raytracingContext, std::vector<TBakePoint>& bakePoints, const BakeParams& bakeParams);
+    static void bake(const RaytracingContext& raytracingContext, BakePointArray<TBakePoint>& bakePoints, const BakeParams& bakeParams,
+        BakeProgress* progress = nullptr, std::vector<Vector2>* luminanceMoments = nullptr, uint64_t seed = 0);
 
     static void bake(const RaytracingContext& raytracingContext, const Bitmap& bitmap,
         size_t width, size_t height, const Camera& camera, const BakeParams& bakeParams, size_t progress = 0, bool antiAliasing = true);
@@ -183,7 +188,8 @@ float BakingFactory::sampleShadow(const RaytracingContext& raytracingContext,
 }
 
 template <typename TBakePoint>
-void BakingFactory::bake(const RaytracingContext& raytracingContext, std::vector<TBakePoint>& bakePoints, const BakeParams& bakeParams)
+void BakingFactory::bake(const RaytracingContext& raytracingContext, BakePointArray<TBakePoint>& bakePoints, const BakeParams& bakeParams,
+    BakeProgress* progress, std::vector<Vector2>* luminanceMoments, const uint64_t seed)
 {
     const Light* sunLight = raytracingContext.lightBVH->getSunLight();
 
@@ -191,31 +197,50 @@ void BakingFactory::bake(const RaytracingContext& raytracingContext, std::vector
     if (sunLight != nullptr)
         computeTangent(sunLight->position, sunLightTangent, sunLightBinormal);
 
+    BakeProgress::Context taskContext(progress);
+
+    if (progress != nullptr)
+        progress->begin(bakePoints.size());
+
+    if (luminanceMoments != nullptr)
+        luminanceMoments->assign(bakePoints.size(), Vector2::Zero());
+
     tbb::parallel_for(tbb::blocked_range<size_t>(0, bakePoints.size()), [&](const tbb::blocked_range<size_t>& range)
     {
         for (size_t r = range.begin(); r < range.end(); r++)
         {
+            // Chunks can take seconds with high sample counts, don't wait for them to finish
+            if (progress != nullptr && progress->isCancelled())
+                return;
+
             TBakePoint& bakePoint = bakePoints[r];
 
             if (!bakePoint.valid())
                 continue;
 
-            Random& random = Random::get();
-
             bakePoint.begin();
 
             size_t backFacing = 0;
+            Vector2 luminanceMoment = Vector2::Zero();
 
             for (uint32_t i = 0; i < bakeParams.light.sampleCount; i++)
             {
+                Random random(seed, r, i);
+
                 const Vector3 tangentSpaceDirection = TBakePoint::sampleDirection(i, bakeParams.light.sampleCount, random.next(), random.next()).normalized();
                 const Vector3 worldSpaceDirection = tangentToWorld(tangentSpaceDirection, bakePoint.tangent, bakePoint.binormal, bakePoint.normal).normalized();
                 const TraceResult result = pathTrace(raytracingContext, bakePoint.position, worldSpaceDirection, bakeParams, random);
 
                 backFacing += result.backFacing;
                 bakePoint.addSample(result.color, worldSpaceDirection);
+
+                const float luminance = getLuminance(result.color);
+                luminanceMoment += Vector2(luminance, luminance * luminance);
             }
 
+            if (luminanceMoments != nullptr)
+                (*luminanceMoments)[r] = luminanceMoment / (float)bakeParams.light.sampleCount;
+
             // If most rays point to backfaces, discard the pixel.
             // This will fix the shadow leaks when dilated.
             if constexpr ((TBakePoint::FLAGS & BAKE_POINT_FLAGS_DISCARD_BACKFACE) != 0)
@@ -229,6 +254,9 @@ void BakingFactory::bake(const RaytracingContext& raytracingContext, std::vector
 
             bakePoint.end(bakeParams.light.sampleCount);
 
+            // Shadows get a stream of their own so they stay the same when only the sample count changes
+            Random random(seed, r, ~0ull);
+
             if ((TBakePoint::FLAGS & BAKE_POINT_FLAGS_LOCAL_LIGHT) != 0 && bakeParams.targetEngine == TargetEngine::HE1)
             {
                 std::array<const Light*, 32> lights;
@@ -269,5 +297,12 @@ void BakingFactory::bake(const RaytracingContext& raytracingContext, std::vector
                     bakePoint.position, sunLight->position, sunLightTangent, sunLightBinormal, INFINITY, bakeParams.shadow.radius, bakeParams, random);
             }
         }
-    });
+
+        if (progress != nullptr)
+            progress->advance(range.size());
+
+    }, taskContext.get());
+
+    if (progress != nullptr)
+        progress->end(bakePoints.size());
 }
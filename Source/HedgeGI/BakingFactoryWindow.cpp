@@ -1,5 +1,6 @@
 ﻿#include "BakingFactoryWindow.h"
 #include "AppData.h"
+#include "BlockCompressor.h"
 #include "FileDialog.h"
 #include "Math.h"
 #include "OidnDenoiserDevice.h"
@@ -47,6 +48,10 @@ const Label AABB_SIZE_MULTIPLIER_LABEL = { "AABB Size Multiplier",
     "You can increase this in case the light field fails to cover enough space in the air.\n\n"
     "This option has no effect if \"Use Pre-generated Light Field Tree\" is enabled." };
 
+const Label DENOISE_PROBES_LABEL = { "Denoise Probes",
+    "Smooths baked probes against the neighboring probes they can see.\n\n"
+    "Reduces noise in sparsely sampled areas, but can soften lighting changes between nearby probes." };
+
 const Label USE_EXISTING_LIGHT_FIELD_TREE_LABEL = { "Use Pre-generated Light Field Tree",
     "Uses the pre-generated light field tree data contained in stage files.\n\n"
     "This is useful if you want to bake light field for a stage that already contains one.\n\n"
@@ -70,6 +75,16 @@ const Label SAVE_AS_BC7_LABEL = { "Save as BC7",
     "Saves lightmap atlases using the higher-quality BC7 compression.\n\n" 
     "This will only work in games that support handling said format, such as Unleashed Recompiled or Sonic Generations with the D3D11 mod." };
 
+const Label COMPRESSION_QUALITY_FAST_LABEL = { "Fast",
+    "Compresses textures quickly with noticeably lower quality. Useful for previewing bakes." };
+
+const Label COMPRESSION_QUALITY_NORMAL_LABEL = { "Normal",
+    "Balances compression speed and quality.\n\n"
+    "Recommended to be used." };
+
+const Label COMPRESSION_QUALITY_HIGH_LABEL = { "High",
+    "Searches harder for the best colors of every block. Slower, but reduces banding and blockiness." };
+
 const Label DENOISER_NONE_LABEL = { "None",
     "Disables denoising. This is going to cause resulting images to look really noisy." };
 
@@ -82,6 +97,12 @@ const Label DENOISER_OIDN_LABEL = { "oidn",
     "Denoises on the CPU.\n\n"
     "This runs slower than Optix AI, but it handles dark areas better." };
 
+const Label DENOISER_BILATERAL_LABEL = { "Bilateral",
+    "Denoises on the CPU with an edge-aware filter that never blends across UV charts.
+
+"
+    "This runs much faster than the other denoisers and works on any machine, but it blurs fine detail. Useful for quick iteration bakes with low sample counts." };
+
 const Label RESOLUTION_OVERRIDE_LABEL = { "Resolution Override",
     "Makes every instance get baked at the specified resolution, regardless of their original settings.\n\n"
     "Set to -1 to disable this option." };
@@ -90,6 +111,32 @@ const Label RESOLUTION_SUPERSAMPLE_SCALE = { "Resolution Supersample Scale",
     "Makes every instance get baked at a higher resolution than the original, and downscales it back to the original resolution.\n\n"
     "This is going to make resulting images look cleaner, but it will take significantly longer to bake." };
 
+const Label MEMORY_BUDGET_LABEL = { "Memory Budget (MB)",
+    "Maximum amount of memory instances being baked at the same time are allowed to use.\n\n"
+    "Instances that don't fit wait until others finish. An instance bigger than the budget still gets baked on its own.\n\n"
+    "Set to 0 to use three quarters of the physical memory." };
+
+const Label MAX_CONCURRENT_BAKES_LABEL = { "Max Concurrent Bakes",
+    "Maximum amount of instances baked at the same time, regardless of how many would fit in the memory budget.\n\n"
+    "Set to 0 to let the memory budget alone decide." };
+
+const Label ACCUMULATE_SAMPLES_LABEL = { "Accumulate Samples",
+    "Adds the samples of this bake to the ones of earlier bakes instead of starting over.\n\n"
+    "Baking the same stage multiple times keeps reducing the noise of instances. Changing anything other than the sample count starts over." };
+
+const Label TARGET_NOISE_LABEL = { "Target Noise (%)",
+    "When accumulating samples, existing instances whose estimated noise is already below this value get skipped.\n\n"
+    "Set to 0 to refine every instance." };
+
+const Label REPLICATE_SCENE_PER_NODE_LABEL = { "Replicate Scene per NUMA Node",
+    "Builds a copy of the scene's BVH for every NUMA node of the machine.\n\n"
+    "Speeds up baking on multi-socket workstations at the cost of memory. Has no effect on single node machines." };
+
+const Label SHARD_COUNT_LABEL = { "Shard Count",
+    "Splits the bake across the specified amount of worker processes, each baking a part of similar cost.\n\n"
+    "Useful for huge stages that don't fit into the memory of a single process.\n\n"
+    "Set to 0 or 1 to bake within HedgeGI. Light field baking for HE1 can't be split." };
+
 const char* const BAKE_DESC = "Bakes the current stage.";
 
 #define PACK_DESC_ "\n\nFor Sonic Generations & Sonic Unleashed, please ensure your stage has correctly gone through the Pre-Render pass in GI Atlas Converter."
@@ -199,6 +246,8 @@ void BakingFactoryWindow::update(const float deltaTime)
                 params->targetEngine
                 );
 
+            property(SHARD_COUNT_LABEL, ImGuiDataType_U32, &params->shardCount);
+
             if (params->targetEngine != TargetEngine::HE1 && params->mode == BakingFactoryMode::MetaInstancer)
                 params->mode = BakingFactoryMode::GI;
 
@@ -214,10 +263,21 @@ void BakingFactoryWindow::update(const float deltaTime)
                 property(MIN_CELL_RADIUS_LABEL, ImGuiDataType_Float, &params->lightField.minCellRadius);
                 property(AABB_SIZE_MULTIPLIER_LABEL, ImGuiDataType_Float, &params->lightField.aabbSizeMultiplier);
                 property(USE_EXISTING_LIGHT_FIELD_TREE_LABEL, params->useExistingLightField);
+                property(DENOISE_PROBES_LABEL, params->postProcess.denoiseProbes);
 
                 endProperties();
             }
         }
+        else if (params->mode == BakingFactoryMode::MetaInstancer)
+        {
+            ImGui::Separator();
+
+            if (beginProperties("##Meta Instancer Settings"))
+            {
+                property(DENOISE_PROBES_LABEL, params->postProcess.denoiseProbes);
+                endProperties();
+            }
+        }
         else if (params->mode == BakingFactoryMode::GI)
         {
             ImGui::Separator();
@@ -231,21 +291,31 @@ void BakingFactoryWindow::update(const float deltaTime)
                 if(params->targetEngine == TargetEngine::HE1)
                     property(SAVE_AS_BC7_LABEL, params->saveAsBc7);
 
+                property("Compression Quality",
+                    {
+                        { COMPRESSION_QUALITY_FAST_LABEL, BlockCompressionQuality::Fast },
+                        { COMPRESSION_QUALITY_NORMAL_LABEL, BlockCompressionQuality::Normal },
+                        { COMPRESSION_QUALITY_HIGH_LABEL, BlockCompressionQuality::High }
+                    },
+                    params->postProcess.compressionQuality
+                    );
+
                 // Denoiser types need special handling since they might not be available
-                if (OptixDenoiserDevice::available || OidnDenoiserDevice::available)
                 {
                     const Label* labels[] =
                     {
                         &DENOISER_NONE_LABEL,
                         &DENOISER_OPTIX_AI_LABEL,
-                        &DENOISER_OIDN_LABEL
+                        &DENOISER_OIDN_LABEL,
+                        &DENOISER_BILATERAL_LABEL
                     };
 
                     const bool flags[] =
                     {
                         true,
                         OptixDenoiserDevice::available,
-                        OidnDenoiserDevice::available
+                        OidnDenoiserDevice::available,
+                        true
                     };
 
                     beginProperty("Denoiser Type");
@@ -268,6 +338,15 @@ void BakingFactoryWindow::update(const float deltaTime)
                 if (property(RESOLUTION_SUPERSAMPLE_SCALE, ImGuiDataType_U64, &params->resolutionSuperSampleScale))
                     params->resolutionSuperSampleScale = nextPowerOfTwo(std::max<size_t>(1, params->resolutionSuperSampleScale));
 
+                property(MEMORY_BUDGET_LABEL, ImGuiDataType_U32, &params->memoryBudget);
+                property(MAX_CONCURRENT_BAKES_LABEL, ImGuiDataType_U32, &params->maxConcurrentBakes);
+                property(ACCUMULATE_SAMPLES_LABEL, params->accumulateSamples);
+
+                if (params->accumulateSamples)
+                    property(TARGET_NOISE_LABEL, ImGuiDataType_Float, &params->targetNoise);
+
+                property(REPLICATE_SCENE_PER_NODE_LABEL, params->replicateScenePerNode);
+
                 endProperties();
             }
         }
@@ -0,0 +1,226 @@
+﻿#include "BilateralDenoiserDevice.h"
+
+#include "BakePoint.h"
+#include "Bitmap.h"
+#include "CoverageMap.h"
+#include "Instance.h"
+#include "Math.h"
+#include "Mesh.h"
+
+namespace
+{
+    constexpr size_t PASS_COUNT = 5;
+    constexpr size_t TILE_SIZE = 32;
+
+    // B3 spline, spread further apart with every pass
+    constexpr float KERNEL[] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+    constexpr float NORMAL_SHARPNESS = 64.0f;
+    constexpr float COLOR_SIGMA = 0.5f;
+
+    void filter(const Color4* input, Color4* output, const size_t width, const size_t height, 
+        const BilateralDenoiserGuide* guide, const size_t stepSize, const float colorSigma, const bool denoiseAlpha)
+    {
+        const float planeScale = guide != nullptr && guide->texelSize > 0.0f ? 1.0f / (guide->texelSize * (float)stepSize) : 0.0f;
+
+        tbb::parallel_for(tbb::blocked_range2d<size_t>(0, height, TILE_SIZE, 0, width, TILE_SIZE), [&](const tbb::blocked_range2d<size_t>& range)
+        {
+            for (size_t y = range.rows().begin(); y < range.rows().end(); y++)
+            {
+                for (size_t x = range.cols().begin(); x < range.cols().end(); x++)
+                {
+                    const size_t index = y * width + x;
+                    const Color4 center = input[index];
+
+                    const BilateralGuideTexel* centerGuide = guide != nullptr ? &guide->texels[index] : nullptr;
+
+                    if (centerGuide != nullptr && centerGuide->chart == COVERAGE_INVALID_INDEX)
+                    {
+                        output[index] = center;
+                        continue;
+                    }
+
+                    const float centerLength = center.head<3>().square().sum();
+
+                    Color4 colorSum = Color4::Zero();
+                    float weightSum = 0.0f;
+
+                    for (ptrdiff_t i = -2; i <= 2; i++)
+                    {
+                        const ptrdiff_t sampleY = (ptrdiff_t)y + i * (ptrdiff_t)stepSize;
+                        if (sampleY < 0 || sampleY >= (ptrdiff_t)height)
+                            continue;
+
+                        for (ptrdiff_t j = -2; j <= 2; j++)
+                        {
+                            const ptrdiff_t sampleX = (ptrdiff_t)x + j * (ptrdiff_t)stepSize;
+                            if (sampleX < 0 || sampleX >= (ptrdiff_t)width)
+                                continue;
+
+                            const size_t sampleIndex = (size_t)sampleY * width + (size_t)sampleX;
+                            const Color4 sample = input[sampleIndex];
+
+                            float weight = KERNEL[i + 2] * KERNEL[j + 2];
+
+                            // The center always contributes, otherwise a texel rejecting every tap would divide by zero
+                            if (i == 0 && j == 0)
+                            {
+                                colorSum += sample * weight;
+                                weightSum += weight;
+                                continue;
+                            }
+
+                            if (centerGuide != nullptr)
+                            {
+                                const BilateralGuideTexel& sampleGuide = guide->texels[sampleIndex];
+                                if (sampleGuide.chart != centerGuide->chart)
+                                    continue;
+
+                                const float cosTheta = centerGuide->normal.dot(sampleGuide.normal);
+                                if (cosTheta <= 0.0f)
+                                    continue;
+
+                                const float planeDistance = std::abs(centerGuide->normal.dot(sampleGuide.position - centerGuide->position));
+
+                                weight *= std::pow(cosTheta, NORMAL_SHARPNESS) * std::exp(-planeDistance * planeScale);
+                            }
+
+                            // Relative distance so bright and dark areas get filtered alike
+                            const float colorDistance = (sample - center).head<3>().square().sum() / 
+                                (centerLength + sample.head<3>().square().sum() + 1e-4f);
+
+                            weight *= std::exp(-colorDistance / colorSigma);
+
+                            colorSum += sample * weight;
+                            weightSum += weight;
+                        }
+                    }
+
+                    Color4 result = colorSum / weightSum;
+                    if (!denoiseAlpha)
+                        result.w() = center.w();
+
+                    output[index] = result;
+                }
+            }
+        });
+    }
+}
+
+size_t BilateralDenoiserGuide::estimateMemory(const uint16_t size)
+{
+    return (size_t)size * size * sizeof(BilateralGuideTexel);
+}
+
+std::unique_ptr<BilateralDenoiserGuide> BilateralDenoiserGuide::create(const CoverageMap& coverageMap, const Instance& instance)
+{
+    const uint16_t size = coverageMap.size;
+    const float factor = 0.5f * (1.0f / (float)size);
+
+    std::unique_ptr<BilateralDenoiserGuide> guide = std::make_unique<BilateralDenoiserGuide>();
+
+    guide->size = size;
+    guide->texels.resize((size_t)size * size);
+
+    tbb::parallel_for(tbb::blocked_range<uint16_t>(0, size), [&](const tbb::blocked_range<uint16_t>& range)
+    {
+        for (uint16_t y = range.begin(); y < range.end(); y++)
+        {
+            for (uint16_t x = 0; x < size; x++)
+            {
+                const CoverageTexel& texel = coverageMap.getTexel(x, y);
+                if (!texel.valid())
+                    continue;
+
+                const size_t meshIndex = coverageMap.getMeshIndex(texel.triangle);
+                const Mesh* mesh = instance.meshes[meshIndex];
+
+                const Triangle& triangle = mesh->triangles[texel.triangle - coverageMap.triangleOffsets[meshIndex]];
+                const Vertex& a = mesh->vertices[triangle.a];
+                const Vertex& b = mesh->vertices[triangle.b];
+                const Vertex& c = mesh->vertices[triangle.c];
+
+                const Vector2 offsetScaled = BAKE_POINT_OFFSETS[texel.offset] * factor;
+
+                const Vector2 vPos(((float)x + 0.5f) / (float)size, ((float)y + 0.5f) / (float)size);
+                const Vector2 baryUV = getBarycentricCoords(vPos, a.vPos + offsetScaled, b.vPos + offsetScaled, c.vPos + offsetScaled);
+
+                BilateralGuideTexel& guideTexel = guide->texels[coverageMap.getIndex(x, y)];
+                guideTexel.position = barycentricLerp(a.position, b.position, c.position, baryUV);
+
+                // Opposing vertex normals can cancel out, such texels only keep their own color
+                const Vector3 normal = barycentricLerp(a.normal, b.normal, c.normal, baryUV);
+                guideTexel.normal = normal.squaredNorm() > 0.0f ? normal.normalized() : Vector3::Zero();
+                guideTexel.chart = texel.chart;
+            }
+        }
+    });
+
+    // Average world space distance between neighboring texels, scales how far off the surface is too far
+    double distanceSum = 0.0;
+    size_t distanceCount = 0;
+
+    for (size_t y = 0; y < size; y++)
+    {
+        for (size_t x = 1; x < size; x++)
+        {
+            const BilateralGuideTexel& left = guide->texels[y * size + x - 1];
+            const BilateralGuideTexel& right = guide->texels[y * size + x];
+
+            if (left.chart == COVERAGE_INVALID_INDEX || left.chart != right.chart)
+                continue;
+
+            distanceSum += (double)(right.position - left.position).norm();
+            distanceCount++;
+        }
+    }
+
+    guide->texelSize = distanceCount > 0 ? (float)(distanceSum / (double)distanceCount) : 0.0f;
+
+    return guide;
+}
+
+size_t BilateralDenoiserDevice::estimateMemory(const uint16_t width, const uint16_t height)
+{
+    // Ping-pong buffers of a slice
+    return (size_t)width * height * sizeof(Color4) * 2;
+}
+
+std::unique_ptr<Bitmap> BilateralDenoiserDevice::denoise(const Bitmap& bitmap, const bool denoiseAlpha, const BilateralDenoiserGuide* guide)
+{
+    if (guide != nullptr && (guide->size != bitmap.width || guide->size != bitmap.height))
+        guide = nullptr;
+
+    std::unique_ptr<Bitmap> denoised = std::make_unique<Bitmap>(bitmap, false);
+
+    const size_t sliceSize = bitmap.width * bitmap.height;
+
+    std::vector<Color4> front(sliceSize);
+    std::vector<Color4> back(sliceSize);
+
+    for (size_t i = 0; i < bitmap.arraySize; i++)
+    {
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, sliceSize), [&](const tbb::blocked_range<size_t>& range)
+        {
+            for (size_t j = range.begin(); j < range.end(); j++)
+                front[j] = bitmap.getColor(sliceSize * i + j);
+        });
+
+        // Edges get stricter as the kernel grows, coarse passes only smooth what earlier passes agreed on
+        for (size_t j = 0; j < PASS_COUNT; j++)
+        {
+            filter(front.data(), back.data(), bitmap.width, bitmap.height, guide, 
+                (size_t)1 << j, COLOR_SIGMA / (float)(1 << j), denoiseAlpha);
+
+            std::swap(front, back);
+        }
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, sliceSize), [&](const tbb::blocked_range<size_t>& range)
+        {
+            for (size_t j = range.begin(); j < range.end(); j++)
+                denoised->setColor(front[j], sliceSize * i + j);
+        });
+    }
+
+    return denoised;
+}
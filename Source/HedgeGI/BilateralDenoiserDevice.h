@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include "CoverageMap.h"
+
+class Bitmap;
+class Instance;
+
+struct BilateralGuideTexel
+{
+    Vector3 position;
+    Vector3 normal;
+    uint32_t chart{ COVERAGE_INVALID_INDEX };
+};
+
+// Surface the texels of an instance were baked from, reconstructed the same way bake points are.
+// It only depends on the coverage map, so it gets built once and shared by every bitmap of the instance.
+class BilateralDenoiserGuide
+{
+public:
+    uint16_t size{};
+    std::vector<BilateralGuideTexel> texels;
+    float texelSize{};
+
+    static size_t estimateMemory(uint16_t size);
+
+    static std::unique_ptr<BilateralDenoiserGuide> create(const CoverageMap& coverageMap, const Instance& instance);
+};
+
+// Edge-avoiding à-trous filter, cheap enough to run on every bake. When a guide is given, texels only
+// blend with texels of the same chart lying on a similar surface, so the filter never bleeds across charts.
+class BilateralDenoiserDevice
+{
+public:
+    // Scratch memory on top of the input and output bitmaps.
+    static size_t estimateMemory(uint16_t width, uint16_t height);
+
+    static std::unique_ptr<Bitmap> denoise(const Bitmap& bitmap, bool denoiseAlpha = false, const BilateralDenoiserGuide* guide = nullptr);
+};
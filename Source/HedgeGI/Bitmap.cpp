@@ -1,7 +1,9 @@
 ﻿#include "Bitmap.h"
 
-#include "D3D11Device.h"
+#include "BitmapPool.h"
+#include "BlockCompressor.h"
 #include "Math.h"
+#include "PngWriter.h"
 
 void Bitmap::transformToLightMap(Color4& color)
 {
@@ -19,6 +21,44 @@ void Bitmap::transformToLinearSpace(Color4& color)
     color.head<3>() = color.head<3>().pow(2.2f);
 }
 
+size_t Bitmap::getTexelSize(const BitmapFormat format)
+{
+    switch (format)
+    {
+    case BitmapFormat::U8: return sizeof(BitmapTexel<BitmapFormat::U8>);
+    case BitmapFormat::R8: return sizeof(BitmapTexel<BitmapFormat::R8>);
+    case BitmapFormat::R16F: return sizeof(BitmapTexel<BitmapFormat::R16F>);
+    case BitmapFormat::RG16F: return sizeof(BitmapTexel<BitmapFormat::RG16F>);
+    case BitmapFormat::RGBA16F: return sizeof(BitmapTexel<BitmapFormat::RGBA16F>);
+    case BitmapFormat::R11G11B10F: return sizeof(BitmapTexel<BitmapFormat::R11G11B10F>);
+    default: return sizeof(BitmapTexel<BitmapFormat::F32>);
+    }
+}
+
+DXGI_FORMAT Bitmap::getDxgiFormat(const BitmapFormat format)
+{
+    switch (format)
+    {
+    case BitmapFormat::U8: return BitmapFormatTraits<BitmapFormat::U8>::DXGI;
+    case BitmapFormat::R8: return BitmapFormatTraits<BitmapFormat::R8>::DXGI;
+    case BitmapFormat::R16F: return BitmapFormatTraits<BitmapFormat::R16F>::DXGI;
+    case BitmapFormat::RG16F: return BitmapFormatTraits<BitmapFormat::RG16F>::DXGI;
+    case BitmapFormat::RGBA16F: return BitmapFormatTraits<BitmapFormat::RGBA16F>::DXGI;
+    case BitmapFormat::R11G11B10F: return BitmapFormatTraits<BitmapFormat::R11G11B10F>::DXGI;
+    default: return BitmapFormatTraits<BitmapFormat::F32>::DXGI;
+    }
+}
+
+size_t Bitmap::getTexelSize() const
+{
+    return getTexelSize(format);
+}
+
+size_t Bitmap::getDataSize() const
+{
+    return width * height * arraySize * getTexelSize();
+}
+
 size_t FORCEINLINE Bitmap::getIndex(const size_t x, const size_t y, const size_t arrayIndex) const
 {
     return width * height * arrayIndex + width * y + x;
@@ -31,34 +71,25 @@ size_t FORCEINLINE Bitmap::getIndex(const Vector2& texCoord, const size_t arrayI
 
 void* Bitmap::getColorPtr(const size_t index) const
 {
-    return (char*)data + index * (size_t) format;
+    return (char*)data + index * getTexelSize();
 }
 
 Color4 Bitmap::getColor(const size_t index) const
 {
-    void* color = getColorPtr(index);
-
-    if (format == BitmapFormat::U8)
+    return visit([&](auto traits)
     {
-        Color4 result;
-
-        DirectX::XMStoreFloat4((DirectX::XMFLOAT4*) &result,
-            DirectX::PackedVector::XMLoadUByteN4((const DirectX::PackedVector::XMUBYTEN4*)color));
-
-        return result;
-    }
-    else
-        return *(Color4*)color;
+        using Traits = decltype(traits);
+        return Traits::load(((const typename Traits::Texel*)data)[index]);
+    });
 }
 
 float Bitmap::getAlpha(const size_t index) const
 {
-    void* color = getColorPtr(index);
-
-    if (format == BitmapFormat::U8)
-        return (float) ((Color4i*)color)->w() / 255.0f;
-    else
-        return ((Color4*)color)->w();
+    return visit([&](auto traits)
+    {
+        using Traits = decltype(traits);
+        return Traits::loadAlpha(((const typename Traits::Texel*)data)[index]);
+    });
 }
 
 Color4 Bitmap::getColor(const size_t x, const size_t y, const size_t arrayIndex) const
@@ -141,20 +172,20 @@ template float Bitmap::getAlpha<true>(const Vector2& texCoord, size_t arrayIndex
 
 void Bitmap::setColor(const Color4& color, const size_t index) const
 {
-    if (format == BitmapFormat::U8)
-        *(Color4i*)getColorPtr(index) = (color * 255.0f).cast<uint8_t>();
-
-    else
-        *(Color4*)getColorPtr(index) = color;
+    visit([&](auto traits)
+    {
+        using Traits = decltype(traits);
+        Traits::store(((typename Traits::Texel*)data)[index], color);
+    });
 }
 
 void Bitmap::setAlpha(const float alpha, const size_t index) const
 {
-    if (format == BitmapFormat::U8)
-        ((Color4i*)getColorPtr(index))->w() = (uint8_t)(alpha * 255.0f);
-
-    else
-        ((Color4*)getColorPtr(index))->w() = alpha;
+    visit([&](auto traits)
+    {
+        using Traits = decltype(traits);
+        Traits::storeAlpha(((typename Traits::Texel*)data)[index], alpha);
+    });
 }
 
 void Bitmap::setColor(const Color4& color, const size_t x, const size_t y, const size_t arrayIndex) const
@@ -177,124 +208,181 @@ void Bitmap::setAlpha(const float alpha, const Vector2& texCoord, const size_t a
     setAlpha(alpha, getIndex(texCoord, arrayIndex));
 }
 
-void Bitmap::save(const std::string& filePath, BitmapTransformer* const transformer, const size_t downScaleFactor) const
+bool Bitmap::save(const std::string& filePath, BitmapTransformer* const transformer, const size_t downScaleFactor) const
 {
     DirectX::ScratchImage scratchImage;
+    HRESULT result;
+
+    if (transformer == nullptr && downScaleFactor <= 1)
+    {
+        const std::vector<DirectX::Image> images = getImages();
+
+        result = Convert(images.data(), images.size(), getMetadata(),
+            DXGI_FORMAT_R8G8B8A8_UNORM, DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, scratchImage);
+    }
+    else
     {
         const DirectX::ScratchImage images = toScratchImage(transformer, downScaleFactor);
 
-        Convert(images.GetImages(), images.GetImageCount(), images.GetMetadata(), 
-            DXGI_FORMAT_B8G8R8A8_UNORM, DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, scratchImage);
+        result = Convert(images.GetImages(), images.GetImageCount(), images.GetMetadata(), 
+            DXGI_FORMAT_R8G8B8A8_UNORM, DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, scratchImage);
     }
 
-    WCHAR wideCharFilePath[MAX_PATH];
-    MultiByteToWideChar(CP_UTF8, NULL, filePath.c_str(), -1, wideCharFilePath, MAX_PATH);
+    if (FAILED(result))
+        return false;
 
-    SaveToWICFile(scratchImage.GetImages(), scratchImage.GetImageCount(), DirectX::WIC_FLAGS_NONE, GetWICCodec(DirectX::WIC_CODEC_PNG), wideCharFilePath);
+    // PNG only holds a single image
+    const DirectX::Image* image = scratchImage.GetImage(0, 0, 0);
+    return image != nullptr && PngWriter::save(filePath, image->pixels, image->width, image->height, image->rowPitch);
 }
 
-void Bitmap::save(const std::string& filePath, const DXGI_FORMAT dxgiFormat, BitmapTransformer* const transformer, const size_t downScaleFactor) const
+bool Bitmap::save(const std::string& filePath, const DXGI_FORMAT dxgiFormat, BitmapTransformer* const transformer, const size_t downScaleFactor,
+    const BlockCompressionQuality quality) const
 {
-    DirectX::ScratchImage scratchImage;
-
-    if ((format == BitmapFormat::F32 && dxgiFormat == DXGI_FORMAT_R32G32B32A32_FLOAT) ||
-        (format == BitmapFormat::U8 && dxgiFormat == DXGI_FORMAT_R8G8B8A8_UNORM))
-        scratchImage = toScratchImage(transformer, downScaleFactor);
+    // Without a transformer or downscaling, DirectXTex reads straight from the bitmap
+    DirectX::ScratchImage transformed;
+    std::vector<DirectX::Image> images;
+    DirectX::TexMetadata metadata;
 
+    if (transformer != nullptr || downScaleFactor > 1)
+    {
+        transformed = toScratchImage(transformer, downScaleFactor);
+        images.assign(transformed.GetImages(), transformed.GetImages() + transformed.GetImageCount());
+        metadata = transformed.GetMetadata();
+    }
     else
     {
-        DirectX::ScratchImage images = toScratchImage(transformer, downScaleFactor);
+        images = getImages();
+        metadata = getMetadata();
+    }
 
+    DirectX::ScratchImage scratchImage;
+
+    if (metadata.format != dxgiFormat)
+    {
         if (DirectX::IsCompressed(dxgiFormat))
         {
-            {
-                DirectX::ScratchImage tmpImage;
+            DirectX::ScratchImage mipMaps;
 
-                DirectX::GenerateMipMaps(
-                    images.GetImages(),
-                    images.GetImageCount(),
-                    images.GetMetadata(),
-                    DirectX::TEX_FILTER_BOX | DirectX::TEX_FILTER_FORCE_NON_WIC | DirectX::TEX_FILTER_SEPARATE_ALPHA,
-                    0,
-                    tmpImage);
+            if (FAILED(DirectX::GenerateMipMaps(
+                images.data(),
+                images.size(),
+                metadata,
+                DirectX::TEX_FILTER_BOX | DirectX::TEX_FILTER_FORCE_NON_WIC | DirectX::TEX_FILTER_SEPARATE_ALPHA,
+                0,
+                mipMaps)))
+                return false;
 
-                std::swap(images, tmpImage);
-            }
+            transformed.Release();
 
-            if (dxgiFormat >= DXGI_FORMAT_BC6H_TYPELESS && dxgiFormat <= DXGI_FORMAT_BC7_UNORM_SRGB)
+            if (BlockCompressor::isSupported(dxgiFormat))
             {
-                std::unique_lock<CriticalSection> lock = D3D11Device::lock();
-
-                Compress(D3D11Device::get(), images.GetImages(), images.GetImageCount(), images.GetMetadata(),
-                    dxgiFormat, DirectX::TEX_COMPRESS_PARALLEL, DirectX::TEX_THRESHOLD_DEFAULT, scratchImage);
+                if (!BlockCompressor::compress(mipMaps.GetImages(), mipMaps.GetImageCount(), mipMaps.GetMetadata(), dxgiFormat, scratchImage, quality))
+                    return false;
             }
 
-            else
+            else if (FAILED(Compress(mipMaps.GetImages(), mipMaps.GetImageCount(), mipMaps.GetMetadata(),
+                dxgiFormat, DirectX::TEX_COMPRESS_PARALLEL, DirectX::TEX_THRESHOLD_DEFAULT, scratchImage)))
             {
-                Compress(images.GetImages(), images.GetImageCount(), images.GetMetadata(),
-                    dxgiFormat, DirectX::TEX_COMPRESS_PARALLEL, DirectX::TEX_THRESHOLD_DEFAULT, scratchImage);
+                return false;
             }
         }
-        else
+        else if (FAILED(Convert(images.data(), images.size(), metadata, 
+            dxgiFormat, DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, scratchImage)))
         {
-            Convert(images.GetImages(), images.GetImageCount(), images.GetMetadata(), 
-                dxgiFormat, DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT,scratchImage);
+            return false;
         }
+
+        images.assign(scratchImage.GetImages(), scratchImage.GetImages() + scratchImage.GetImageCount());
+        metadata = scratchImage.GetMetadata();
     }
 
     WCHAR wideCharFilePath[MAX_PATH];
     MultiByteToWideChar(CP_UTF8, NULL, filePath.c_str(), -1, wideCharFilePath, MAX_PATH);
 
-    SaveToDDSFile(scratchImage.GetImages(), scratchImage.GetImageCount(), scratchImage.GetMetadata(), DirectX::DDS_FLAGS_NONE, wideCharFilePath);
+    return SUCCEEDED(SaveToDDSFile(images.data(), images.size(), metadata, DirectX::DDS_FLAGS_NONE, wideCharFilePath));
 }
 
-DirectX::ScratchImage Bitmap::toScratchImage(BitmapTransformer* const transformer, const size_t downScaleFactor) const
+DirectX::TexMetadata Bitmap::getMetadata() const
 {
-    DXGI_FORMAT dxgiFormat = DXGI_FORMAT_UNKNOWN;
+    DirectX::TexMetadata metadata{};
+
+    metadata.width = width;
+    metadata.height = height;
+    metadata.depth = type == BITMAP_TYPE_3D ? arraySize : 1;
+    metadata.arraySize = type == BITMAP_TYPE_3D ? 1 : arraySize;
+    metadata.mipLevels = 1;
+    metadata.miscFlags = type == BITMAP_TYPE_CUBE ? DirectX::TEX_MISC_TEXTURECUBE : 0;
+    metadata.format = getDxgiFormat(format);
+    metadata.dimension = type == BITMAP_TYPE_3D ? DirectX::TEX_DIMENSION_TEXTURE3D : DirectX::TEX_DIMENSION_TEXTURE2D;
+
+    return metadata;
+}
 
-    switch (format)
-    {
-    case BitmapFormat::F32:
-        dxgiFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
-        break;
+std::vector<DirectX::Image> Bitmap::getImages() const
+{
+    std::vector<DirectX::Image> images(arraySize);
 
-    case BitmapFormat::U8:
-        dxgiFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
-        break;
-    }
+    const size_t rowPitch = width * getTexelSize();
+    const size_t slicePitch = rowPitch * height;
 
+    for (size_t i = 0; i < arraySize; i++)
+        images[i] = { width, height, getDxgiFormat(format), rowPitch, slicePitch, (uint8_t*)data + i * slicePitch };
+
+    return images;
+}
+
+DirectX::ScratchImage Bitmap::toScratchImage(BitmapTransformer* const transformer, const size_t downScaleFactor) const
+{
     DirectX::ScratchImage scratchImage;
 
-    switch(type)
+    if (transformer == nullptr)
     {
-    case BITMAP_TYPE_2D:
-        scratchImage.Initialize2D(dxgiFormat, width, height, arraySize, 1);
-        break;
+        const std::vector<DirectX::Image> images = getImages();
 
-    case BITMAP_TYPE_3D:
-        scratchImage.Initialize3D(dxgiFormat, width, height, arraySize, 1);
-        break;
+        if (downScaleFactor > 1)
+        {
+            DirectX::Resize(images.data(), images.size(), getMetadata(),
+                std::max<size_t>(1, width / downScaleFactor), std::max<size_t>(1, height / downScaleFactor), DirectX::TEX_FILTER_BOX, scratchImage);
+        }
+        else
+        {
+            scratchImage.Initialize(getMetadata());
 
-    case BITMAP_TYPE_CUBE:
-        scratchImage.InitializeCube(dxgiFormat, width, height, arraySize / 6, 1);
-        break;
+            for (size_t i = 0; i < images.size(); i++)
+                memcpy(scratchImage.GetImages()[i].pixels, images[i].pixels, images[i].slicePitch);
+        }
+
+        return scratchImage;
     }
 
-    for (size_t i = 0; i < arraySize; i++)
-    {
-        Color4* const pixels = (Color4*)scratchImage.GetImages()[i].pixels;
+    // Transformers operate on full precision colors
+    DirectX::TexMetadata metadata = getMetadata();
+    metadata.format = DXGI_FORMAT_R32G32B32A32_FLOAT;
 
-        memcpy(pixels, &((Color4*)data)[i * width * height], sizeof(Color4) * width * height);
+    scratchImage.Initialize(metadata);
+
+    visit([&](auto traits)
+    {
+        using Traits = decltype(traits);
 
-        if (transformer != nullptr)
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, arraySize * height), [&](const tbb::blocked_range<size_t>& range)
         {
-            for (size_t x = 0; x < width; x++)
+            for (size_t r = range.begin(); r < range.end(); r++)
             {
-                for (size_t y = 0; y < height; y++)
-                    transformer(pixels[getIndex(x, y, i)]);
+                const DirectX::Image& image = scratchImage.GetImages()[r / height];
+
+                const typename Traits::Texel* const texels = (const typename Traits::Texel*)data + r * width;
+                Color4* const pixels = (Color4*)(image.pixels + (r % height) * image.rowPitch);
+
+                for (size_t x = 0; x < width; x++)
+                {
+                    pixels[x] = Traits::load(texels[x]);
+                    transformer(pixels[x]);
+                }
             }
-        }
-    }
+        });
+    });
 
     if (downScaleFactor > 1)
     {
@@ -308,12 +396,12 @@ DirectX::ScratchImage Bitmap::toScratchImage(BitmapTransformer* const transforme
     return scratchImage;
 }
 
-#define MEMORY_SIZE (width * height * arraySize * (size_t)format)
+#define MEMORY_SIZE (width * height * arraySize * getTexelSize(format))
 
 Bitmap::Bitmap() = default;
 
 Bitmap::Bitmap(const size_t width, const size_t height, const size_t arraySize, const BitmapType type, const BitmapFormat format)
-    : data(operator new(MEMORY_SIZE)), width(width), height(height), arraySize(arraySize), type(type), format(format)
+    : data(BitmapPool::get().acquire(MEMORY_SIZE)), width(width), height(height), arraySize(arraySize), type(type), format(format)
 {
     memset(data, 0, MEMORY_SIZE);
 }
@@ -321,7 +409,7 @@ Bitmap::Bitmap(const size_t width, const size_t height, const size_t arraySize,
 Bitmap::Bitmap(const Bitmap& bitmap, const bool copyData)
     : width(bitmap.width), height(bitmap.height), arraySize(bitmap.arraySize), type(bitmap.type), format(bitmap.format)
 {
-    data = operator new(MEMORY_SIZE);
+    data = BitmapPool::get().acquire(MEMORY_SIZE);
 
     if (copyData)
         memcpy(data, bitmap.data, MEMORY_SIZE);
@@ -331,6 +419,5 @@ Bitmap::Bitmap(const Bitmap& bitmap, const bool copyData)
 
 Bitmap::~Bitmap()
 {
-    if (data)
-        operator delete(data);
+    BitmapPool::get().release(data, MEMORY_SIZE);
 }
@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include "BlockCompressor.h"
+
 class FileStream;
 
 enum BitmapType : size_t
@@ -9,14 +11,160 @@ enum BitmapType : size_t
     BITMAP_TYPE_CUBE
 };
 
+// Single channel formats replicate their value to every channel when read, writing a color stores its red channel.
+// Formats without alpha read it back as 1 and ignore writes to it.
 enum class BitmapFormat : size_t
 {
-    F32 = sizeof(Color4),
-    U8 = sizeof(Color4i)
+    F32,
+    U8,
+    R8,
+    R16F,
+    RG16F,
+    RGBA16F,
+    R11G11B10F
 };
 
 typedef void BitmapTransformer(Color4& color);
 
+// Storage type and conversions of a format, lets kernels run over texels without switching on the format every time.
+template<BitmapFormat format>
+struct BitmapFormatTraits;
+
+template<>
+struct BitmapFormatTraits<BitmapFormat::F32>
+{
+    using Texel = Color4;
+    static constexpr DXGI_FORMAT DXGI = DXGI_FORMAT_R32G32B32A32_FLOAT;
+
+    static Color4 load(const Texel& texel) { return texel; }
+    static float loadAlpha(const Texel& texel) { return texel.w(); }
+
+    static void store(Texel& texel, const Color4& color) { texel = color; }
+    static void storeAlpha(Texel& texel, const float alpha) { texel.w() = alpha; }
+};
+
+template<>
+struct BitmapFormatTraits<BitmapFormat::U8>
+{
+    using Texel = Color4i;
+    static constexpr DXGI_FORMAT DXGI = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+    static Color4 load(const Texel& texel)
+    {
+        Color4 color;
+        DirectX::XMStoreFloat4((DirectX::XMFLOAT4*)&color, DirectX::PackedVector::XMLoadUByteN4((const DirectX::PackedVector::XMUBYTEN4*)&texel));
+        return color;
+    }
+
+    static float loadAlpha(const Texel& texel) { return (float)texel.w() / 255.0f; }
+
+    static void store(Texel& texel, const Color4& color) { texel = (color * 255.0f).cast<uint8_t>(); }
+    static void storeAlpha(Texel& texel, const float alpha) { texel.w() = (uint8_t)(alpha * 255.0f); }
+};
+
+template<>
+struct BitmapFormatTraits<BitmapFormat::R8>
+{
+    using Texel = uint8_t;
+    static constexpr DXGI_FORMAT DXGI = DXGI_FORMAT_R8_UNORM;
+
+    static Color4 load(const Texel& texel) { return Color4::Constant(loadAlpha(texel)); }
+    static float loadAlpha(const Texel& texel) { return (float)texel / 255.0f; }
+
+    static void store(Texel& texel, const Color4& color) { storeAlpha(texel, color.x()); }
+    static void storeAlpha(Texel& texel, const float alpha) { texel = (uint8_t)(std::max(0.0f, std::min(1.0f, alpha)) * 255.0f + 0.5f); }
+};
+
+template<>
+struct BitmapFormatTraits<BitmapFormat::R16F>
+{
+    using Texel = DirectX::PackedVector::HALF;
+    static constexpr DXGI_FORMAT DXGI = DXGI_FORMAT_R16_FLOAT;
+
+    static Color4 load(const Texel& texel) { return Color4::Constant(loadAlpha(texel)); }
+    static float loadAlpha(const Texel& texel) { return DirectX::PackedVector::XMConvertHalfToFloat(texel); }
+
+    static void store(Texel& texel, const Color4& color) { storeAlpha(texel, color.x()); }
+    static void storeAlpha(Texel& texel, const float alpha) { texel = DirectX::PackedVector::XMConvertFloatToHalf(alpha); }
+};
+
+template<>
+struct BitmapFormatTraits<BitmapFormat::RG16F>
+{
+    using Texel = DirectX::PackedVector::XMHALF2;
+    static constexpr DXGI_FORMAT DXGI = DXGI_FORMAT_R16G16_FLOAT;
+
+    static Color4 load(const Texel& texel)
+    {
+        return { DirectX::PackedVector::XMConvertHalfToFloat(texel.x), DirectX::PackedVector::XMConvertHalfToFloat(texel.y), 0.0f, 1.0f };
+    }
+
+    static float loadAlpha(const Texel&) { return 1.0f; }
+
+    static void store(Texel& texel, const Color4& color)
+    {
+        texel.x = DirectX::PackedVector::XMConvertFloatToHalf(color.x());
+        texel.y = DirectX::PackedVector::XMConvertFloatToHalf(color.y());
+    }
+
+    static void storeAlpha(Texel&, float) {}
+};
+
+template<>
+struct BitmapFormatTraits<BitmapFormat::RGBA16F>
+{
+    using Texel = DirectX::PackedVector::XMHALF4;
+    static constexpr DXGI_FORMAT DXGI = DXGI_FORMAT_R16G16B16A16_FLOAT;
+
+    static Color4 load(const Texel& texel)
+    {
+        Color4 color;
+        DirectX::XMStoreFloat4((DirectX::XMFLOAT4*)&color, DirectX::PackedVector::XMLoadHalf4(&texel));
+        return color;
+    }
+
+    static float loadAlpha(const Texel& texel) { return DirectX::PackedVector::XMConvertHalfToFloat(texel.w); }
+
+    static void store(Texel& texel, const Color4& color) { DirectX::PackedVector::XMStoreHalf4(&texel, DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)&color)); }
+    static void storeAlpha(Texel& texel, const float alpha) { texel.w = DirectX::PackedVector::XMConvertFloatToHalf(alpha); }
+};
+
+template<>
+struct BitmapFormatTraits<BitmapFormat::R11G11B10F>
+{
+    using Texel = DirectX::PackedVector::XMFLOAT3PK;
+    static constexpr DXGI_FORMAT DXGI = DXGI_FORMAT_R11G11B10_FLOAT;
+
+    static Color4 load(const Texel& texel)
+    {
+        Color4 color;
+        DirectX::XMStoreFloat4((DirectX::XMFLOAT4*)&color, DirectX::PackedVector::XMLoadFloat3PK(&texel));
+        color.w() = 1.0f;
+        return color;
+    }
+
+    static float loadAlpha(const Texel&) { return 1.0f; }
+
+    static void store(Texel& texel, const Color4& color) { DirectX::PackedVector::XMStoreFloat3PK(&texel, DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)&color)); }
+    static void storeAlpha(Texel&, float) {}
+};
+
+template<BitmapFormat format>
+using BitmapTexel = typename BitmapFormatTraits<format>::Texel;
+
+// Contiguous texels of a single row.
+template<typename TTexel>
+struct BitmapRow
+{
+    TTexel* texels{};
+    size_t width{};
+
+    TTexel* begin() const { return texels; }
+    TTexel* end() const { return texels + width; }
+
+    TTexel& operator[](const size_t x) const { return texels[x]; }
+};
+
 class Bitmap
 {
 public:
@@ -32,6 +180,22 @@ public:
     static void transformToShadowMap(Color4& color);
     static void transformToLinearSpace(Color4& color);
 
+    static size_t getTexelSize(BitmapFormat format);
+    static DXGI_FORMAT getDxgiFormat(BitmapFormat format);
+
+    size_t getTexelSize() const;
+    size_t getDataSize() const;
+
+    // Invokes the function with the traits of the format, do it outside of per texel loops.
+    template<typename TFunction>
+    decltype(auto) visit(TFunction&& function) const;
+
+    template<BitmapFormat format>
+    BitmapTexel<format>* getTexels(size_t arrayIndex = 0) const;
+
+    template<BitmapFormat format>
+    BitmapRow<BitmapTexel<format>> getRow(size_t y, size_t arrayIndex = 0) const;
+
     size_t getIndex(size_t x, size_t y, size_t arrayIndex = 0) const;
     size_t getIndex(const Vector2& texCoord, size_t arrayIndex = 0) const;
 
@@ -58,8 +222,13 @@ public:
     void setColor(const Color4& color, const Vector2& texCoord, size_t arrayIndex = 0) const;
     void setAlpha(float alpha, const Vector2& texCoord, size_t arrayIndex = 0) const;
 
-    void save(const std::string& filePath, BitmapTransformer* transformer = nullptr, size_t downScaleFactor = 1) const;
-    void save(const std::string& filePath, DXGI_FORMAT dxgiFormat, BitmapTransformer* transformer = nullptr, size_t downScaleFactor = 1) const;
+    bool save(const std::string& filePath, BitmapTransformer* transformer = nullptr, size_t downScaleFactor = 1) const;
+    bool save(const std::string& filePath, DXGI_FORMAT dxgiFormat, BitmapTransformer* transformer = nullptr, size_t downScaleFactor = 1,
+        BlockCompressionQuality quality = BlockCompressionQuality::Normal) const;
+
+    // Describe the storage of the bitmap without copying it, the images point into the bitmap's data.
+    DirectX::TexMetadata getMetadata() const;
+    std::vector<DirectX::Image> getImages() const;
 
     DirectX::ScratchImage toScratchImage(BitmapTransformer* transformer = nullptr, size_t downScaleFactor = 1) const;
 
@@ -67,4 +236,32 @@ public:
     Bitmap(size_t width, size_t height, size_t arraySize = 1, BitmapType type = BITMAP_TYPE_2D, BitmapFormat format = BitmapFormat::F32);
     Bitmap(const Bitmap& bitmap, bool copyData);
     ~Bitmap();
-};
\ No newline at end of file
+};
+
+template <typename TFunction>
+decltype(auto) Bitmap::visit(TFunction&& function) const
+{
+    switch (format)
+    {
+    case BitmapFormat::U8: return function(BitmapFormatTraits<BitmapFormat::U8>());
+    case BitmapFormat::R8: return function(BitmapFormatTraits<BitmapFormat::R8>());
+    case BitmapFormat::R16F: return function(BitmapFormatTraits<BitmapFormat::R16F>());
+    case BitmapFormat::RG16F: return function(BitmapFormatTraits<BitmapFormat::RG16F>());
+    case BitmapFormat::RGBA16F: return function(BitmapFormatTraits<BitmapFormat::RGBA16F>());
+    case BitmapFormat::R11G11B10F: return function(BitmapFormatTraits<BitmapFormat::R11G11B10F>());
+    default: return function(BitmapFormatTraits<BitmapFormat::F32>());
+    }
+}
+
+template <BitmapFormat format>
+BitmapTexel<format>* Bitmap::getTexels(const size_t arrayIndex) const
+{
+    assert(this->format == format);
+    return (BitmapTexel<format>*)data + width * height * arrayIndex;
+}
+
+template <BitmapFormat format>
+BitmapRow<BitmapTexel<format>> Bitmap::getRow(const size_t y, const size_t arrayIndex) const
+{
+    return { getTexels<format>(arrayIndex) + width * y, width };
+}
\ No newline at end of file
@@ -1,13 +1,54 @@
 ﻿#include "BitmapHelper.h"
 
 #include "BakeParams.h"
+#include "BilateralDenoiserDevice.h"
+#include "CoverageMap.h"
 #include "Math.h"
 #include "OidnDenoiserDevice.h"
 #include "OptixDenoiserDevice.h"
 #include "SeamOptimizer.h"
 
-std::unique_ptr<Bitmap> BitmapHelper::denoise(const Bitmap& bitmap, const DenoiserType denoiserType, const bool denoiseAlpha)
+std::unique_ptr<Bitmap> BitmapHelper::convert(const Bitmap& bitmap, const BitmapFormat format)
 {
+    std::unique_ptr<Bitmap> converted = std::make_unique<Bitmap>(bitmap.width, bitmap.height, bitmap.arraySize, bitmap.type, format);
+
+    bitmap.visit([&](auto sourceTraits)
+    {
+        using SourceTraits = decltype(sourceTraits);
+
+        converted->visit([&](auto traits)
+        {
+            using Traits = decltype(traits);
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, bitmap.height * bitmap.arraySize), [&](const tbb::blocked_range<size_t>& range)
+            {
+                for (size_t r = range.begin(); r < range.end(); r++)
+                {
+                    const typename SourceTraits::Texel* const source = (const typename SourceTraits::Texel*)bitmap.data + r * bitmap.width;
+                    typename Traits::Texel* const destination = (typename Traits::Texel*)converted->data + r * bitmap.width;
+
+                    for (size_t x = 0; x < bitmap.width; x++)
+                        Traits::store(destination[x], SourceTraits::load(source[x]));
+                }
+            });
+        });
+    });
+
+    return converted;
+}
+
+std::unique_ptr<Bitmap> BitmapHelper::denoise(const Bitmap& bitmap, const DenoiserType denoiserType, const bool denoiseAlpha,
+    const BilateralDenoiserGuide* guide)
+{
+    if (denoiserType == DenoiserType::Bilateral)
+        return BilateralDenoiserDevice::denoise(bitmap, denoiseAlpha, guide);
+
+    if (bitmap.format != BitmapFormat::F32)
+    {
+        const std::unique_ptr<Bitmap> denoised = denoise(*convert(bitmap, BitmapFormat::F32), denoiserType, denoiseAlpha);
+        return denoised != nullptr ? convert(*denoised, bitmap.format) : nullptr;
+    }
+
     return denoiserType == DenoiserType::Optix && OptixDenoiserDevice::available ? OptixDenoiserDevice::denoise(bitmap, denoiseAlpha) :
 #if defined(ENABLE_OIDN)
         denoiserType == DenoiserType::Oidn ? OidnDenoiserDevice::denoise(bitmap, denoiseAlpha) : nullptr;
@@ -16,115 +57,269 @@ std::unique_ptr<Bitmap> BitmapHelper::denoise(const Bitmap& bitmap, const Denois
 #endif
 }
 
-std::unique_ptr<Bitmap> BitmapHelper::dilate(const Bitmap& bitmap)
+namespace
 {
-    std::unique_ptr<Bitmap> dilated = std::make_unique<Bitmap>(bitmap, true);
+    // Push-pull pyramid of a single array slice. Valid texels get averaged down the levels, invalid texels
+    // then take the color of the smallest enclosing block that had any valid texels.
+    class DilationPyramid
+    {
+        struct Level
+        {
+            size_t width{};
+            size_t height{};
+            std::vector<Color4> colors;
+            std::vector<float> weights;
+        };
+
+        std::vector<Level> levels;
+
+    public:
+        DilationPyramid(size_t width, size_t height);
+
+        void build(const Bitmap& bitmap, size_t arrayIndex, const CoverageMap* coverageMap);
+
+        bool valid(size_t x, size_t y) const;
+        const Color4& getColor(size_t x, size_t y) const;
+    };
+
+    DilationPyramid::DilationPyramid(const size_t width, const size_t height)
+    {
+        levels.push_back({ width, height });
+
+        while (levels.back().width > 1 || levels.back().height > 1)
+        {
+            const Level& previous = levels.back();
+            levels.push_back({ (previous.width + 1) / 2, (previous.height + 1) / 2 });
+        }
 
-    if (bitmap.width == bitmap.height)
+        for (auto& level : levels)
+        {
+            level.colors.resize(level.width * level.height);
+            level.weights.resize(level.width * level.height);
+        }
+    }
+
+    void DilationPyramid::build(const Bitmap& bitmap, const size_t arrayIndex, const CoverageMap* coverageMap)
     {
-        for (uint32_t arrayIndex = 0; arrayIndex < bitmap.arraySize; arrayIndex++)
+        Level& base = levels[0];
+
+        bitmap.visit([&](auto traits)
         {
-            uint32_t blockSize = 2;
+            using Traits = decltype(traits);
 
-            while (blockSize <= bitmap.width)
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, base.height), [&](const tbb::blocked_range<size_t>& range)
             {
-                for (uint32_t x = 0; x < bitmap.width / blockSize; x++)
+                for (size_t y = range.begin(); y < range.end(); y++)
                 {
-                    for (uint32_t y = 0; y < bitmap.height / blockSize; y++)
+                    const typename Traits::Texel* const row = (const typename Traits::Texel*)bitmap.data + bitmap.getIndex(0, y, arrayIndex);
+
+                    for (size_t x = 0; x < base.width; x++)
                     {
-                        size_t count = 0;
-                        Color4 resultColor(0);
+                        const size_t index = y * base.width + x;
+                        const Color4 color = Traits::load(row[x]);
 
-                        for (uint32_t i = 0; i < blockSize; i++)
-                        {
-                            for (uint32_t j = 0; j < blockSize; j++)
-                            {
-                                const Color4 color = dilated->getColor(x * blockSize + i, y * blockSize + j, arrayIndex);
-                                if (color.maxCoeff() <= 0.0f)
-                                    continue;
+                        // Without coverage, black texels are the only hint of emptiness
+                        const bool valid = coverageMap != nullptr ? coverageMap->texels[index].valid() : color.maxCoeff() > 0.0f;
 
-                                resultColor += color;
-                                ++count;
-                            }
-                        }
+                        base.colors[index] = valid ? color : Color4::Zero();
+                        base.weights[index] = valid ? 1.0f : 0.0f;
+                    }
+                }
+            });
+        });
 
-                        if (count == 0 || count == blockSize * blockSize)
-                            continue;
+        // Push, weights count the valid texels below so every level holds their exact average
+        for (size_t i = 1; i < levels.size(); i++)
+        {
+            const Level& source = levels[i - 1];
+            Level& level = levels[i];
 
-                        resultColor /= (float)count;
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, level.height), [&](const tbb::blocked_range<size_t>& range)
+            {
+                for (size_t y = range.begin(); y < range.end(); y++)
+                {
+                    for (size_t x = 0; x < level.width; x++)
+                    {
+                        Color4 color = Color4::Zero();
+                        float weight = 0.0f;
 
-                        for (uint32_t i = 0; i < blockSize; i++)
+                        for (size_t j = y * 2; j < std::min(y * 2 + 2, source.height); j++)
                         {
-                            for (uint32_t j = 0; j < blockSize; j++)
+                            for (size_t k = x * 2; k < std::min(x * 2 + 2, source.width); k++)
                             {
-                                const Color4& color = dilated->getColor(x * blockSize + i, y * blockSize + j, arrayIndex);
-                                dilated->setColor(color.maxCoeff() > 0.0f ? color : resultColor, x * blockSize + i, y * blockSize + j, arrayIndex);
+                                const size_t index = j * source.width + k;
+
+                                color += source.colors[index] * source.weights[index];
+                                weight += source.weights[index];
                             }
                         }
+
+                        const size_t index = y * level.width + x;
+
+                        level.colors[index] = weight > 0.0f ? color / weight : Color4::Zero();
+                        level.weights[index] = weight;
                     }
                 }
+            });
+        }
 
-                blockSize *= 2;
-            }
+        // Pull, parents are complete by the time their children get filled. The base level
+        // is left alone, getColor looks invalid texels up from the level above instead.
+        for (size_t i = levels.size() - 1; i > 1; i--)
+        {
+            const Level& source = levels[i];
+            Level& level = levels[i - 1];
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, level.height), [&](const tbb::blocked_range<size_t>& range)
+            {
+                for (size_t y = range.begin(); y < range.end(); y++)
+                {
+                    for (size_t x = 0; x < level.width; x++)
+                    {
+                        const size_t index = y * level.width + x;
+
+                        if (level.weights[index] <= 0.0f)
+                            level.colors[index] = source.colors[(y / 2) * source.width + x / 2];
+                    }
+                }
+            });
         }
     }
 
-    return dilated;
+    bool DilationPyramid::valid(const size_t x, const size_t y) const
+    {
+        return levels[0].weights[y * levels[0].width + x] > 0.0f;
+    }
+
+    const Color4& DilationPyramid::getColor(const size_t x, const size_t y) const
+    {
+        if (levels.size() < 2 || valid(x, y))
+            return levels[0].colors[y * levels[0].width + x];
+
+        return levels[1].colors[(y / 2) * levels[1].width + x / 2];
+    }
+
+    void encodeTexel(Color4& color, const EncodeReadyFlags encodeReadyFlags)
+    {
+        color.head<3>() = ldrReady(color.head<3>());
+
+        if (encodeReadyFlags & ENCODE_READY_FLAGS_SRGB) color.head<3>() = color.head<3>().pow(1.0f / 2.2f);
+        if (encodeReadyFlags & ENCODE_READY_FLAGS_SQRT) color.head<3>() = color.head<3>().sqrt();
+    }
 }
 
-std::unique_ptr<Bitmap> BitmapHelper::optimizeSeams(const Bitmap& bitmap, const Instance& instance)
+size_t BitmapHelper::estimateDilateMemory(size_t width, size_t height)
 {
-    const SeamOptimizer optimizer(instance);
-    return optimizer.optimize(bitmap);
+    size_t memory = 0;
+
+    while (true)
+    {
+        memory += width * height * (sizeof(Color4) + sizeof(float));
+
+        if (width <= 1 && height <= 1)
+            break;
+
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+
+    return memory;
 }
 
-std::unique_ptr<Bitmap> BitmapHelper::makeEncodeReady(const Bitmap& bitmap, const EncodeReadyFlags encodeReadyFlags)
+std::unique_ptr<Bitmap> BitmapHelper::dilate(const Bitmap& bitmap, const CoverageMap* coverageMap)
 {
-    std::unique_ptr<Bitmap> encoded = std::make_unique<Bitmap>(bitmap, false);
+    assert(coverageMap == nullptr || (coverageMap->size == bitmap.width && coverageMap->size == bitmap.height));
 
-    for (size_t i = 0; i < bitmap.arraySize; i++)
+    std::unique_ptr<Bitmap> dilated = std::make_unique<Bitmap>(bitmap, true);
+    DilationPyramid pyramid(bitmap.width, bitmap.height);
+
+    for (size_t arrayIndex = 0; arrayIndex < bitmap.arraySize; arrayIndex++)
     {
-        for (size_t x = 0; x < bitmap.width; x++)
-        {
-            for (size_t y = 0; y < bitmap.height; y++)
-            {
-                const size_t index = bitmap.getIndex(x, y, i);
+        pyramid.build(bitmap, arrayIndex, coverageMap);
 
-                Color4 color = bitmap.getColor(index);
-                color.head<3>() = ldrReady(color.head<3>());
+        dilated->visit([&](auto traits)
+        {
+            using Traits = decltype(traits);
 
-                if (encodeReadyFlags & ENCODE_READY_FLAGS_SRGB) color.head<3>() = color.head<3>().pow(1.0f / 2.2f);
-                if (encodeReadyFlags & ENCODE_READY_FLAGS_SQRT) color.head<3>() = color.head<3>().sqrt();
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, bitmap.height), [&](const tbb::blocked_range<size_t>& range)
+            {
+                for (size_t y = range.begin(); y < range.end(); y++)
+                {
+                    typename Traits::Texel* const row = (typename Traits::Texel*)dilated->data + dilated->getIndex(0, y, arrayIndex);
 
-                encoded->setColor(color, index);
-            }
-        }
+                    // Valid texels are already in place from the copy
+                    for (size_t x = 0; x < bitmap.width; x++)
+                    {
+                        if (!pyramid.valid(x, y))
+                            Traits::store(row[x], pyramid.getColor(x, y));
+                    }
+                }
+            });
+        });
     }
 
-    return encoded;
+    return dilated;
 }
 
-std::unique_ptr<Bitmap> BitmapHelper::combine(const Bitmap& lightMap, const Bitmap& shadowMap)
+std::unique_ptr<Bitmap> BitmapHelper::dilateAndCombine(const Bitmap& lightMap, const Bitmap& shadowMap, const CoverageMap* coverageMap)
 {
     assert(lightMap.width == shadowMap.width && lightMap.height == shadowMap.height);
 
-    std::unique_ptr<Bitmap> bitmap = std::make_unique<Bitmap>(lightMap, false);
+    std::unique_ptr<Bitmap> bitmap = std::make_unique<Bitmap>(lightMap.width, lightMap.height, lightMap.arraySize, lightMap.type);
 
-    for (size_t i = 0; i < bitmap->arraySize; i++)
+    DilationPyramid lightPyramid(lightMap.width, lightMap.height);
+    DilationPyramid shadowPyramid(shadowMap.width, shadowMap.height);
+
+    shadowPyramid.build(shadowMap, 0, coverageMap);
+
+    for (size_t i = 0; i < lightMap.arraySize; i++)
     {
-        for (size_t x = 0; x < bitmap->width; x++)
+        lightPyramid.build(lightMap, i, coverageMap);
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, bitmap->height), [&](const tbb::blocked_range<size_t>& range)
         {
-            for (size_t y = 0; y < bitmap->height; y++)
+            for (size_t y = range.begin(); y < range.end(); y++)
             {
-                const size_t index = bitmap->getIndex(x, y, i);
-
-                Color4 color = lightMap.getColor(index);
-                color.w() = shadowMap.getColor(index).head<3>().sum() / 3.0f;
+                const BitmapRow<Color4> row = bitmap->getRow<BitmapFormat::F32>(y, i);
 
-                bitmap->setColor(color, index);
+                for (size_t x = 0; x < bitmap->width; x++)
+                {
+                    row[x] = lightPyramid.getColor(x, y);
+                    row[x].w() = shadowPyramid.getColor(x, y).head<3>().sum() / 3.0f;
+                }
             }
-        }
+        });
     }
 
     return bitmap;
 }
+
+void BitmapHelper::finalize(const Bitmap& bitmap, const SeamOptimizer* seamOptimizer, const EncodeReadyFlags encodeReadyFlags)
+{
+    // Seam blending moves texels around, it has to be done before encoding touches them
+    if (seamOptimizer != nullptr)
+        seamOptimizer->apply(bitmap);
+
+    if (encodeReadyFlags == ENCORE_READY_FLAGS_NONE)
+        return;
+
+    bitmap.visit([&](auto traits)
+    {
+        using Traits = decltype(traits);
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, bitmap.height * bitmap.arraySize), [&](const tbb::blocked_range<size_t>& range)
+        {
+            for (size_t r = range.begin(); r < range.end(); r++)
+            {
+                typename Traits::Texel* const row = (typename Traits::Texel*)bitmap.data + r * bitmap.width;
+
+                for (size_t x = 0; x < bitmap.width; x++)
+                {
+                    Color4 color = Traits::load(row[x]);
+                    encodeTexel(color, encodeReadyFlags);
+                    Traits::store(row[x], color);
+                }
+            }
+        });
+    });
+}
@@ -1,9 +1,12 @@
 ﻿#pragma once
 
 #include "Bitmap.h"
+#include "BitmapPool.h"
 
+class BilateralDenoiserGuide;
+class CoverageMap;
 enum class DenoiserType;
-class Instance;
+class SeamOptimizer;
 
 enum PaintFlags
 {
@@ -21,65 +24,87 @@ enum EncodeReadyFlags
 class BitmapHelper
 {
 public:
-    static std::unique_ptr<Bitmap> denoise(const Bitmap& bitmap, DenoiserType denoiserType, bool denoiseAlpha = false);
+    static std::unique_ptr<Bitmap> convert(const Bitmap& bitmap, BitmapFormat format);
 
-    static std::unique_ptr<Bitmap> dilate(const Bitmap& bitmap);
+    // The guide only applies to the bilateral denoiser, other denoisers ignore it. Bitmaps
+    // in other formats than F32 get converted for the denoisers that only take F32 texels.
+    static std::unique_ptr<Bitmap> denoise(const Bitmap& bitmap, DenoiserType denoiserType, bool denoiseAlpha = false,
+        const BilateralDenoiserGuide* guide = nullptr);
 
-    static std::unique_ptr<Bitmap> optimizeSeams(const Bitmap& bitmap, const Instance& instance);
+    // Fills invalid texels from nearby valid ones. Validity comes from the coverage map if there is one,
+    // otherwise black texels are considered invalid.
+    static std::unique_ptr<Bitmap> dilate(const Bitmap& bitmap, const CoverageMap* coverageMap = nullptr);
+
+    // Scratch memory of the pyramid a dilation builds, dilateAndCombine builds two.
+    static size_t estimateDilateMemory(size_t width, size_t height);
 
     template <typename TBakePoint>
-    static void paint(const Bitmap& bitmap, const std::vector<TBakePoint>& bakePoints, PaintFlags paintFlags);
+    static void paint(const Bitmap& bitmap, const BakePointArray<TBakePoint>& bakePoints, PaintFlags paintFlags);
 
     template<typename TBakePoint>
-    static std::unique_ptr<Bitmap> createAndPaint(const std::vector<TBakePoint>& bakePoints, uint16_t width, uint16_t height, PaintFlags paintFlags);
+    static std::unique_ptr<Bitmap> createAndPaint(const BakePointArray<TBakePoint>& bakePoints, uint16_t width, uint16_t height, 
+        PaintFlags paintFlags, BitmapFormat format = BitmapFormat::F32);
 
-    static std::unique_ptr<Bitmap> makeEncodeReady(const Bitmap& bitmap, EncodeReadyFlags encodeReadyFlags);
+    // Dilates both maps and combines them into one, the shadow ending up in alpha.
+    static std::unique_ptr<Bitmap> dilateAndCombine(const Bitmap& lightMap, const Bitmap& shadowMap, const CoverageMap* coverageMap);
 
-    static std::unique_ptr<Bitmap> combine(const Bitmap& lightMap, const Bitmap& shadowMap);
+    // Optimizes seams and makes the bitmap encode ready in place.
+    static void finalize(const Bitmap& bitmap, const SeamOptimizer* seamOptimizer, EncodeReadyFlags encodeReadyFlags);
 };
 
 template <typename TBakePoint>
-void BitmapHelper::paint(const Bitmap& bitmap, const std::vector<TBakePoint>& bakePoints, const PaintFlags paintFlags)
+void BitmapHelper::paint(const Bitmap& bitmap, const BakePointArray<TBakePoint>& bakePoints, const PaintFlags paintFlags)
 {
     const size_t dataSize = bitmap.width * bitmap.height * bitmap.arraySize;
     const std::unique_ptr<uint8_t[]> counts = std::make_unique<uint8_t[]>(dataSize);
 
     memset(&counts[0], 0, dataSize * sizeof(counts[0]));
 
-    for (auto& bakePoint : bakePoints)
+    bitmap.visit([&](auto traits)
     {
-        if (!bakePoint.valid())
-            continue;
+        using Traits = decltype(traits);
+
+        typename Traits::Texel* const texels = (typename Traits::Texel*)bitmap.data;
 
-        for (size_t i = 0; i < std::min(bitmap.arraySize, TBakePoint::BASIS_COUNT); i++)
+        for (auto& bakePoint : bakePoints)
         {
-            Color4 color{};
+            if (!bakePoint.valid())
+                continue;
 
-            if (paintFlags & PAINT_FLAGS_COLOR)
+            for (size_t i = 0; i < std::min(bitmap.arraySize, TBakePoint::BASIS_COUNT); i++)
             {
-                for (size_t j = 0; j < 3; j++)
-                    color[j] = std::max(0.0f, std::min(65504.0f, bakePoint.colors[i][j]));
+                Color4 color{};
 
-                color[3] = paintFlags & PAINT_FLAGS_SHADOW ? saturate(bakePoint.shadow) : 1.0f;
-            }
-            else if (paintFlags & PAINT_FLAGS_SHADOW)
-            {
-                for (size_t j = 0; j < 3; j++)
-                    color[j] = saturate(bakePoint.shadow);
+                if (paintFlags & PAINT_FLAGS_COLOR)
+                {
+                    for (size_t j = 0; j < 3; j++)
+                        color[j] = std::max(0.0f, std::min(65504.0f, bakePoint.colors[i][j]));
 
-                color[3] = 1.0f;
-            }
+                    color[3] = paintFlags & PAINT_FLAGS_SHADOW ? saturate(bakePoint.shadow) : 1.0f;
+                }
+                else if (paintFlags & PAINT_FLAGS_SHADOW)
+                {
+                    for (size_t j = 0; j < 3; j++)
+                        color[j] = saturate(bakePoint.shadow);
+
+                    color[3] = 1.0f;
+                }
 
-            const size_t index = bitmap.getIndex(bakePoint.x, bakePoint.y, i);
-            bitmap.setColor((bitmap.getColor(index) * counts[index] + color) / ++counts[index], index);
+                const size_t index = bitmap.getIndex(bakePoint.x, bakePoint.y, i);
+                typename Traits::Texel& texel = texels[index];
+
+                Traits::store(texel, counts[index] > 0 ? (Traits::load(texel) * counts[index] + color) / (counts[index] + 1) : color);
+                ++counts[index];
+            }
         }
-    }
+    });
 }
 
 template <typename TBakePoint>
-std::unique_ptr<Bitmap> BitmapHelper::createAndPaint(const std::vector<TBakePoint>& bakePoints, uint16_t width, uint16_t height, const PaintFlags paintFlags)
+std::unique_ptr<Bitmap> BitmapHelper::createAndPaint(const BakePointArray<TBakePoint>& bakePoints, uint16_t width, uint16_t height, 
+    const PaintFlags paintFlags, const BitmapFormat format)
 {
-    std::unique_ptr<Bitmap> bitmap = std::make_unique<Bitmap>(width, height, paintFlags != PAINT_FLAGS_SHADOW ? TBakePoint::BASIS_COUNT : 1);
+    std::unique_ptr<Bitmap> bitmap = std::make_unique<Bitmap>(width, height, paintFlags != PAINT_FLAGS_SHADOW ? TBakePoint::BASIS_COUNT : 1, BITMAP_TYPE_2D, format);
     paint(*bitmap, bakePoints, paintFlags);
     return bitmap;
 }
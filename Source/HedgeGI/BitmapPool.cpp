@@ -0,0 +1,175 @@
+﻿#include "BitmapPool.h"
+
+BitmapPool& BitmapPool::get()
+{
+    // Never destroyed, bitmaps may still get released while exiting
+    static BitmapPool* pool = new BitmapPool();
+    return *pool;
+}
+
+void* BitmapPool::allocate(const size_t size)
+{
+    return operator new(size, std::align_val_t(ALIGNMENT));
+}
+
+void BitmapPool::deallocate(void* data, const size_t size)
+{
+    operator delete(data, std::align_val_t(ALIGNMENT));
+}
+
+uint16_t BitmapPool::getCurrentNode()
+{
+    PROCESSOR_NUMBER processorNumber;
+    GetCurrentProcessorNumberEx(&processorNumber);
+
+    USHORT node;
+    if (!GetNumaProcessorNodeEx(&processorNumber, &node) || node == 0xFFFF)
+        return 0;
+
+    return node;
+}
+
+size_t BitmapPool::getSizeClass(const size_t size)
+{
+    if (size < MIN_BLOCK_SIZE)
+        return size;
+
+    size_t power = MIN_BLOCK_SIZE;
+    while (power <= size / 2)
+        power *= 2;
+
+    // Quarter steps between powers of two waste at most 25%
+    const size_t step = power / 4;
+    return (size + step - 1) / step * step;
+}
+
+BitmapPool::BitmapPool() : capacity(1024ull * 1024 * 1024)
+{
+    ULONG highestNode;
+    if (!GetNumaHighestNodeNumber(&highestNode))
+        highestNode = 0;
+
+    blocks.resize(highestNode + 1);
+}
+
+void* BitmapPool::acquire(const size_t size)
+{
+    const size_t sizeClass = getSizeClass(size);
+
+    if (sizeClass >= MIN_BLOCK_SIZE)
+    {
+        const uint16_t node = std::min<uint16_t>(getCurrentNode(), (uint16_t)(blocks.size() - 1));
+
+        std::lock_guard lock(criticalSection);
+
+        const auto pair = blocks[node].find(sizeClass);
+        if (pair != blocks[node].end() && !pair->second.empty())
+        {
+            void* data = pair->second.back();
+            pair->second.pop_back();
+
+            retainedSize -= sizeClass;
+            ++hitCount;
+
+            return data;
+        }
+
+        ++missCount;
+
+        // Pages end up on the node of the thread touching them first, which is usually the one allocating
+        void* data = allocate(sizeClass);
+        blockNodes[data] = node;
+
+        return data;
+    }
+
+    return allocate(sizeClass);
+}
+
+void BitmapPool::release(void* data, const size_t size)
+{
+    if (data == nullptr)
+        return;
+
+    const size_t sizeClass = getSizeClass(size);
+
+    if (sizeClass >= MIN_BLOCK_SIZE)
+    {
+        std::lock_guard lock(criticalSection);
+
+        const auto pair = blockNodes.find(data);
+
+        if (pair != blockNodes.end() && retainedSize + sizeClass <= capacity)
+        {
+            blocks[pair->second][sizeClass].push_back(data);
+            retainedSize += sizeClass;
+            return;
+        }
+
+        if (pair != blockNodes.end())
+            blockNodes.erase(pair);
+    }
+
+    deallocate(data, sizeClass);
+}
+
+void BitmapPool::setCapacity(const size_t capacity)
+{
+    std::lock_guard lock(criticalSection);
+
+    this->capacity = capacity;
+
+    // Free the largest blocks first, they are the least likely to get reused
+    while (retainedSize > capacity)
+    {
+        std::vector<void*>* largest = nullptr;
+        size_t largestSizeClass = 0;
+
+        for (auto& nodeBlocks : blocks)
+        {
+            for (auto& pair : nodeBlocks)
+            {
+                if (!pair.second.empty() && pair.first > largestSizeClass)
+                {
+                    largest = &pair.second;
+                    largestSizeClass = pair.first;
+                }
+            }
+        }
+
+        blockNodes.erase(largest->back());
+        deallocate(largest->back(), largestSizeClass);
+        largest->pop_back();
+
+        retainedSize -= largestSizeClass;
+    }
+}
+
+void BitmapPool::trim()
+{
+    const size_t capacity = this->capacity;
+
+    setCapacity(0);
+    setCapacity(capacity);
+}
+
+size_t BitmapPool::getHitCount() const
+{
+    return hitCount;
+}
+
+size_t BitmapPool::getMissCount() const
+{
+    return missCount;
+}
+
+size_t BitmapPool::getRetainedSize() const
+{
+    return retainedSize;
+}
+
+void BitmapPool::resetStatistics()
+{
+    hitCount = 0;
+    missCount = 0;
+}
@@ -0,0 +1,80 @@
+﻿#pragma once
+
+// Recycles the large buffers of bitmaps and bake point arrays between instances, so long bakes don't keep
+// fragmenting the heap. Blocks are rounded up to size classes, four per power of two, and the total amount
+// of memory kept around for reuse is capped. Free blocks are kept per NUMA node and only handed out to threads
+// running on the node they were allocated on, so a bake never ends up working on another node's memory.
+class BitmapPool
+{
+    CriticalSection criticalSection;
+    std::vector<phmap::flat_hash_map<size_t, std::vector<void*>>> blocks;
+    phmap::flat_hash_map<void*, uint16_t> blockNodes;
+    size_t capacity{};
+    size_t retainedSize{};
+
+    std::atomic<size_t> hitCount{};
+    std::atomic<size_t> missCount{};
+
+    static void* allocate(size_t size);
+    static void deallocate(void* data, size_t size);
+
+    static uint16_t getCurrentNode();
+
+public:
+    // Anything smaller goes straight to the heap.
+    static constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+    static constexpr size_t ALIGNMENT = 64;
+
+    static BitmapPool& get();
+
+    static size_t getSizeClass(size_t size);
+
+    BitmapPool();
+
+    void* acquire(size_t size);
+    void release(void* data, size_t size);
+
+    // Frees retained blocks until they fit into the capacity.
+    void setCapacity(size_t capacity);
+
+    // Frees every retained block.
+    void trim();
+
+    size_t getHitCount() const;
+    size_t getMissCount() const;
+    size_t getRetainedSize() const;
+
+    void resetStatistics();
+};
+
+template<typename T>
+class BitmapPoolAllocator
+{
+public:
+    using value_type = T;
+
+    BitmapPoolAllocator() = default;
+
+    template<typename U>
+    BitmapPoolAllocator(const BitmapPoolAllocator<U>&) {}
+
+    T* allocate(const size_t count)
+    {
+        return (T*)BitmapPool::get().acquire(count * sizeof(T));
+    }
+
+    void deallocate(T* data, const size_t count)
+    {
+        BitmapPool::get().release(data, count * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const BitmapPoolAllocator<U>&) const { return true; }
+
+    template<typename U>
+    bool operator!=(const BitmapPoolAllocator<U>&) const { return false; }
+};
+
+template<typename TBakePoint>
+using BakePointArray = std::vector<TBakePoint, BitmapPoolAllocator<TBakePoint>>;
@@ -0,0 +1,765 @@
+﻿#include "BlockCompressor.h"
+
+#include "Logger.h"
+
+namespace
+{
+    constexpr size_t BLOCK_TEXEL_COUNT = 16;
+
+    constexpr uint32_t BC7_WEIGHTS[] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    class BitWriter
+    {
+        uint64_t bits[2]{};
+        size_t position{};
+
+    public:
+        void write(const uint32_t value, const size_t count)
+        {
+            for (size_t i = 0; i < count; i++, position++)
+                bits[position >> 6] |= (uint64_t)((value >> i) & 1) << (position & 63);
+        }
+
+        void copyTo(uint8_t* block) const
+        {
+            memcpy(block, bits, sizeof(bits));
+        }
+    };
+
+    // Indices of BC6H and BC7 blocks, the anchor index drops its most significant bit.
+    template<typename TEndpoints>
+    void makeAnchorImplicit(TEndpoints& endpoints, uint8_t* indices)
+    {
+        if (indices[0] < 8)
+            return;
+
+        std::swap(endpoints.values[0], endpoints.values[1]);
+
+        for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    void writeIndices4(BitWriter& writer, const uint8_t* indices)
+    {
+        writer.write(indices[0], 3);
+
+        for (size_t i = 1; i < BLOCK_TEXEL_COUNT; i++)
+            writer.write(indices[i], 4);
+    }
+
+    // 4 color mode, used by BC1 and the color half of BC3.
+    struct BC1Codec
+    {
+        struct Endpoints
+        {
+            uint16_t values[2];
+        };
+
+        static constexpr size_t INDEX_COUNT = 4;
+
+        static Color4 getMask() { return { 1, 1, 1, 0 }; }
+        static Color4 load(const Color4& color) { return color.max(0.0f).min(1.0f); }
+        static float getWeight(const size_t index) { return index < 2 ? (float)index : (float)(index - 1) / 3.0f; }
+
+        static uint16_t pack(const Color4& color)
+        {
+            const Color4 clamped = load(color);
+
+            return (uint16_t)(
+                ((uint16_t)std::roundf(clamped.x() * 31.0f) << 11) |
+                ((uint16_t)std::roundf(clamped.y() * 63.0f) << 5) |
+                (uint16_t)std::roundf(clamped.z() * 31.0f));
+        }
+
+        static Color4 unpack(const uint16_t value)
+        {
+            return
+            {
+                (float)((value >> 11) & 0x1F) / 31.0f,
+                (float)((value >> 5) & 0x3F) / 63.0f,
+                (float)(value & 0x1F) / 31.0f,
+                0.0f
+            };
+        }
+
+        static Endpoints quantize(const Color4& first, const Color4& second)
+        {
+            return { { pack(first), pack(second) } };
+        }
+
+        static void getPalette(const Endpoints& endpoints, Color4* palette)
+        {
+            palette[0] = unpack(endpoints.values[0]);
+            palette[1] = unpack(endpoints.values[1]);
+            palette[2] = (palette[0] * 2.0f + palette[1]) / 3.0f;
+            palette[3] = (palette[0] + palette[1] * 2.0f) / 3.0f;
+        }
+
+        static void write(Endpoints endpoints, uint8_t* indices, uint8_t* block)
+        {
+            // The first endpoint has to be the larger one, equal endpoints would switch to 3 color mode in BC1
+            if (endpoints.values[0] < endpoints.values[1])
+            {
+                std::swap(endpoints.values[0], endpoints.values[1]);
+
+                for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+                    indices[i] ^= 1;
+            }
+            else if (endpoints.values[0] == endpoints.values[1])
+            {
+                memset(indices, 0, BLOCK_TEXEL_COUNT);
+            }
+
+            uint32_t bits = 0;
+            for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+                bits |= (uint32_t)indices[i] << (i * 2);
+
+            memcpy(block, endpoints.values, sizeof(endpoints.values));
+            memcpy(block + 4, &bits, sizeof(bits));
+        }
+    };
+
+    // 8 value mode of a single channel, used by BC4, BC5 and the alpha half of BC3.
+    template<size_t channel>
+    struct BC4Codec
+    {
+        struct Endpoints
+        {
+            uint8_t values[2];
+        };
+
+        static constexpr size_t INDEX_COUNT = 8;
+
+        static Color4 getMask() { return { 1, 0, 0, 0 }; }
+        static Color4 load(const Color4& color) { return { std::clamp(color[channel], 0.0f, 1.0f), 0, 0, 0 }; }
+        static float getWeight(const size_t index) { return index < 2 ? (float)index : (float)(index - 1) / 7.0f; }
+
+        static Endpoints quantize(const Color4& first, const Color4& second)
+        {
+            return
+            { {
+                (uint8_t)std::roundf(std::clamp(first.x(), 0.0f, 1.0f) * 255.0f),
+                (uint8_t)std::roundf(std::clamp(second.x(), 0.0f, 1.0f) * 255.0f)
+            } };
+        }
+
+        static void getPalette(const Endpoints& endpoints, Color4* palette)
+        {
+            for (size_t i = 0; i < INDEX_COUNT; i++)
+            {
+                const float weight = getWeight(i);
+                palette[i] = Color4::Zero();
+                palette[i].x() = ((1.0f - weight) * (float)endpoints.values[0] + weight * (float)endpoints.values[1]) / 255.0f;
+            }
+        }
+
+        static void write(Endpoints endpoints, uint8_t* indices, uint8_t* block)
+        {
+            // The first endpoint has to be the larger one, otherwise the block switches to 6 value mode
+            if (endpoints.values[0] < endpoints.values[1])
+            {
+                std::swap(endpoints.values[0], endpoints.values[1]);
+
+                for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+                    indices[i] = indices[i] < 2 ? indices[i] ^ 1 : 9 - indices[i];
+            }
+            else if (endpoints.values[0] == endpoints.values[1])
+            {
+                memset(indices, 0, BLOCK_TEXEL_COUNT);
+            }
+
+            uint64_t bits = 0;
+            for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+                bits |= (uint64_t)indices[i] << (i * 3);
+
+            block[0] = endpoints.values[0];
+            block[1] = endpoints.values[1];
+            memcpy(block + 2, &bits, 6);
+        }
+    };
+
+    // Mode 6, 7-bit RGBA endpoints with a unique p-bit each and 4-bit indices.
+    struct BC7Codec
+    {
+        struct Endpoint
+        {
+            uint8_t color[4];
+            uint8_t pBit;
+        };
+
+        struct Endpoints
+        {
+            Endpoint values[2];
+        };
+
+        static constexpr size_t INDEX_COUNT = 16;
+
+        static Color4 getMask() { return { 1, 1, 1, 1 }; }
+        static Color4 load(const Color4& color) { return color.max(0.0f).min(1.0f); }
+        static float getWeight(const size_t index) { return (float)BC7_WEIGHTS[index] / 64.0f; }
+
+        static Endpoint quantize(const Color4& color)
+        {
+            const Color4 clamped = load(color) * 255.0f;
+
+            Endpoint result{};
+            float bestError = INFINITY;
+
+            for (uint8_t pBit = 0; pBit < 2; pBit++)
+            {
+                Endpoint endpoint{};
+                endpoint.pBit = pBit;
+
+                float error = 0.0f;
+                for (size_t i = 0; i < 4; i++)
+                {
+                    endpoint.color[i] = (uint8_t)std::clamp((int)std::roundf((clamped[i] - (float)pBit) / 2.0f), 0, 127);
+
+                    const float delta = (float)((endpoint.color[i] << 1) | pBit) - clamped[i];
+                    error += delta * delta;
+                }
+
+                if (error < bestError)
+                {
+                    result = endpoint;
+                    bestError = error;
+                }
+            }
+
+            return result;
+        }
+
+        static Endpoints quantize(const Color4& first, const Color4& second)
+        {
+            return { { quantize(first), quantize(second) } };
+        }
+
+        static void getPalette(const Endpoints& endpoints, Color4* palette)
+        {
+            for (size_t i = 0; i < INDEX_COUNT; i++)
+            {
+                for (size_t j = 0; j < 4; j++)
+                {
+                    const uint32_t first = (endpoints.values[0].color[j] << 1) | endpoints.values[0].pBit;
+                    const uint32_t second = (endpoints.values[1].color[j] << 1) | endpoints.values[1].pBit;
+
+                    palette[i][j] = (float)((first * (64 - BC7_WEIGHTS[i]) + second * BC7_WEIGHTS[i] + 32) >> 6) / 255.0f;
+                }
+            }
+        }
+
+        static void write(Endpoints endpoints, uint8_t* indices, uint8_t* block)
+        {
+            makeAnchorImplicit(endpoints, indices);
+
+            BitWriter writer;
+            writer.write(1 << 6, 7);
+
+            for (size_t i = 0; i < 4; i++)
+            {
+                writer.write(endpoints.values[0].color[i], 7);
+                writer.write(endpoints.values[1].color[i], 7);
+            }
+
+            writer.write(endpoints.values[0].pBit, 1);
+            writer.write(endpoints.values[1].pBit, 1);
+
+            writeIndices4(writer, indices);
+            writer.copyTo(block);
+        }
+    };
+
+    // Mode 11, 10-bit unsigned endpoints without deltas and 4-bit indices. Fitting happens on the bit patterns
+    // of the half floats, which is the space the hardware interpolates in.
+    struct BC6HCodec
+    {
+        struct Endpoints
+        {
+            uint16_t values[2][3];
+        };
+
+        static constexpr size_t INDEX_COUNT = 16;
+        static constexpr uint32_t MAX_HALF = 0x7BFF;
+
+        static Color4 getMask() { return { 1, 1, 1, 0 }; }
+        static float getWeight(const size_t index) { return (float)BC7_WEIGHTS[index] / 64.0f; }
+
+        static Color4 load(const Color4& color)
+        {
+            Color4 result = Color4::Zero();
+
+            for (size_t i = 0; i < 3; i++)
+                result[i] = !(color[i] > 0.0f) ? 0.0f : (float)DirectX::PackedVector::XMConvertFloatToHalf(std::min(color[i], 65504.0f));
+
+            return result;
+        }
+
+        static uint32_t unquantize(const uint32_t value)
+        {
+            if (value == 0)
+                return 0;
+
+            if (value == 0x3FF)
+                return 0xFFFF;
+
+            return ((value << 16) + 0x8000) >> 10;
+        }
+
+        static uint32_t finishUnquantize(const uint32_t value)
+        {
+            return (value * 31) >> 6;
+        }
+
+        static uint16_t quantize(const float value)
+        {
+            const float clamped = std::clamp(value, 0.0f, (float)MAX_HALF);
+            const int estimate = std::clamp((int)((clamped * 64.0f / 31.0f - 32.0f) / 64.0f), 0, 0x3FF);
+
+            uint16_t result = (uint16_t)estimate;
+            float bestError = INFINITY;
+
+            for (int candidate = std::max(0, estimate - 1); candidate <= std::min(0x3FF, estimate + 1); candidate++)
+            {
+                const float error = std::abs((float)finishUnquantize(unquantize(candidate)) - clamped);
+                if (error < bestError)
+                {
+                    result = (uint16_t)candidate;
+                    bestError = error;
+                }
+            }
+
+            return result;
+        }
+
+        static Endpoints quantize(const Color4& first, const Color4& second)
+        {
+            Endpoints endpoints{};
+
+            for (size_t i = 0; i < 3; i++)
+            {
+                endpoints.values[0][i] = quantize(first[i]);
+                endpoints.values[1][i] = quantize(second[i]);
+            }
+
+            return endpoints;
+        }
+
+        static void getPalette(const Endpoints& endpoints, Color4* palette)
+        {
+            for (size_t i = 0; i < INDEX_COUNT; i++)
+            {
+                palette[i] = Color4::Zero();
+
+                for (size_t j = 0; j < 3; j++)
+                {
+                    const uint32_t first = unquantize(endpoints.values[0][j]);
+                    const uint32_t second = unquantize(endpoints.values[1][j]);
+
+                    palette[i][j] = (float)finishUnquantize((first * (64 - BC7_WEIGHTS[i]) + second * BC7_WEIGHTS[i] + 32) >> 6);
+                }
+            }
+        }
+
+        static void write(Endpoints endpoints, uint8_t* indices, uint8_t* block)
+        {
+            makeAnchorImplicit(endpoints, indices);
+
+            BitWriter writer;
+            writer.write(0x03, 5);
+
+            for (size_t i = 0; i < 2; i++)
+            {
+                for (size_t j = 0; j < 3; j++)
+                    writer.write(endpoints.values[i][j], 10);
+            }
+
+            writeIndices4(writer, indices);
+            writer.copyTo(block);
+        }
+    };
+
+    Color4 getMean(const Color4* texels)
+    {
+        Color4 mean = Color4::Zero();
+        for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+            mean += texels[i];
+
+        return mean / (float)BLOCK_TEXEL_COUNT;
+    }
+
+    // Uses the bounding box diagonal, flipped for channels that fall while the widest one rises.
+    void fitBox(const Color4* texels, const Color4& mask, Color4& first, Color4& second)
+    {
+        const Color4 mean = getMean(texels);
+
+        first = texels[0];
+        second = texels[0];
+
+        for (size_t i = 1; i < BLOCK_TEXEL_COUNT; i++)
+        {
+            first = first.min(texels[i]);
+            second = second.max(texels[i]);
+        }
+
+        Eigen::Index widest;
+        ((second - first) * mask).maxCoeff(&widest);
+
+        for (Eigen::Index i = 0; i < 4; i++)
+        {
+            float covariance = 0.0f;
+            for (size_t j = 0; j < BLOCK_TEXEL_COUNT; j++)
+                covariance += (texels[j][i] - mean[i]) * (texels[j][widest] - mean[widest]);
+
+            if (covariance < 0.0f)
+                std::swap(first[i], second[i]);
+        }
+    }
+
+    // Uses the principal axis of the texels, the endpoints cover every texel projected onto it.
+    void fitPrincipalAxis(const Color4* texels, const Color4& mask, Color4& first, Color4& second)
+    {
+        const Color4 mean = getMean(texels);
+
+        Matrix4 covariance = Matrix4::Zero();
+        Color4 minColor = texels[0];
+        Color4 maxColor = texels[0];
+
+        for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+        {
+            const Vector4 delta = ((texels[i] - mean) * mask).matrix();
+            covariance += delta * delta.transpose();
+
+            minColor = minColor.min(texels[i]);
+            maxColor = maxColor.max(texels[i]);
+        }
+
+        // Power iteration converges quickly enough for 16 texels
+        Vector4 axis = ((maxColor - minColor) * mask).matrix();
+        for (size_t i = 0; i < 8; i++)
+        {
+            axis = covariance * axis;
+
+            const float length = axis.cwiseAbs().maxCoeff();
+            if (length < 1e-12f)
+                break;
+
+            axis /= length;
+        }
+
+        if (axis.squaredNorm() < 1e-12f)
+        {
+            first = mean;
+            second = mean;
+            return;
+        }
+
+        axis.normalize();
+
+        float minT = INFINITY;
+        float maxT = -INFINITY;
+
+        for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+        {
+            const float t = ((texels[i] - mean) * mask).matrix().dot(axis);
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        first = mean + axis.array() * minT;
+        second = mean + axis.array() * maxT;
+    }
+
+    // Solves for the endpoints that best reproduce the texels with the current indices.
+    template<typename TCodec>
+    bool refineLine(const Color4* texels, const uint8_t* indices, Color4& first, Color4& second)
+    {
+        float alpha2 = 0.0f, beta2 = 0.0f, alphaBeta = 0.0f;
+        Color4 alphaX = Color4::Zero();
+        Color4 betaX = Color4::Zero();
+
+        for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+        {
+            const float beta = TCodec::getWeight(indices[i]);
+            const float alpha = 1.0f - beta;
+
+            alpha2 += alpha * alpha;
+            beta2 += beta * beta;
+            alphaBeta += alpha * beta;
+            alphaX += texels[i] * alpha;
+            betaX += texels[i] * beta;
+        }
+
+        const float determinant = alpha2 * beta2 - alphaBeta * alphaBeta;
+        if (std::abs(determinant) < 1e-6f)
+            return false;
+
+        first = (alphaX * beta2 - betaX * alphaBeta) / determinant;
+        second = (betaX * alpha2 - alphaX * alphaBeta) / determinant;
+
+        return true;
+    }
+
+    template<typename TCodec>
+    float assignIndices(const typename TCodec::Endpoints& endpoints, const Color4* texels, uint8_t* indices)
+    {
+        Color4 palette[TCodec::INDEX_COUNT];
+        TCodec::getPalette(endpoints, palette);
+
+        const Color4 mask = TCodec::getMask();
+        float error = 0.0f;
+
+        for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+        {
+            float bestError = INFINITY;
+
+            for (size_t j = 0; j < TCodec::INDEX_COUNT; j++)
+            {
+                const float candidateError = ((palette[j] - texels[i]) * mask).square().sum();
+                if (candidateError < bestError)
+                {
+                    indices[i] = (uint8_t)j;
+                    bestError = candidateError;
+                }
+            }
+
+            error += bestError;
+        }
+
+        return error;
+    }
+
+    template<typename TCodec>
+    struct BlockCandidate
+    {
+        typename TCodec::Endpoints endpoints;
+        uint8_t indices[BLOCK_TEXEL_COUNT];
+        float error;
+
+        BlockCandidate(const Color4* texels, const Color4& first, const Color4& second)
+            : endpoints(TCodec::quantize(first, second)), error(assignIndices<TCodec>(endpoints, texels, indices))
+        {
+        }
+
+        // Refits the endpoints to the chosen indices, keeps going for as long as the error improves.
+        void refine(const Color4* texels, const size_t iterationCount)
+        {
+            for (size_t i = 0; i < iterationCount && error > 0.0f; i++)
+            {
+                Color4 first, second;
+                if (!refineLine<TCodec>(texels, indices, first, second))
+                    break;
+
+                const BlockCandidate candidate(texels, first, second);
+                if (candidate.error >= error)
+                    break;
+
+                *this = candidate;
+            }
+        }
+    };
+
+    template<typename TCodec>
+    void encodeBlock(const Color4* colors, const BlockCompressionQuality quality, uint8_t* block)
+    {
+        Color4 texels[BLOCK_TEXEL_COUNT];
+        for (size_t i = 0; i < BLOCK_TEXEL_COUNT; i++)
+            texels[i] = TCodec::load(colors[i]);
+
+        const Color4 mask = TCodec::getMask();
+        Color4 first, second;
+
+        if (quality == BlockCompressionQuality::Fast)
+        {
+            fitBox(texels, mask, first, second);
+
+            BlockCandidate<TCodec> candidate(texels, first, second);
+            TCodec::write(candidate.endpoints, candidate.indices, block);
+            return;
+        }
+
+        fitPrincipalAxis(texels, mask, first, second);
+
+        BlockCandidate<TCodec> best(texels, first, second);
+        best.refine(texels, quality == BlockCompressionQuality::High ? 8 : 1);
+
+        // The box diagonal wins on blocks whose texels cluster around the corners of the box
+        if (quality == BlockCompressionQuality::High && best.error > 0.0f)
+        {
+            fitBox(texels, mask, first, second);
+
+            BlockCandidate<TCodec> candidate(texels, first, second);
+            candidate.refine(texels, 8);
+
+            if (candidate.error < best.error)
+                best = candidate;
+        }
+
+        TCodec::write(best.endpoints, best.indices, block);
+    }
+
+    template<DXGI_FORMAT format>
+    struct BlockEncoder;
+
+    template<>
+    struct BlockEncoder<DXGI_FORMAT_BC1_UNORM>
+    {
+        static constexpr size_t BLOCK_SIZE = 8;
+
+        static void encode(const Color4* colors, const BlockCompressionQuality quality, uint8_t* block)
+        {
+            encodeBlock<BC1Codec>(colors, quality, block);
+        }
+    };
+
+    template<>
+    struct BlockEncoder<DXGI_FORMAT_BC3_UNORM>
+    {
+        static constexpr size_t BLOCK_SIZE = 16;
+
+        static void encode(const Color4* colors, const BlockCompressionQuality quality, uint8_t* block)
+        {
+            encodeBlock<BC4Codec<3>>(colors, quality, block);
+            encodeBlock<BC1Codec>(colors, quality, block + 8);
+        }
+    };
+
+    template<>
+    struct BlockEncoder<DXGI_FORMAT_BC4_UNORM>
+    {
+        static constexpr size_t BLOCK_SIZE = 8;
+
+        static void encode(const Color4* colors, const BlockCompressionQuality quality, uint8_t* block)
+        {
+            encodeBlock<BC4Codec<0>>(colors, quality, block);
+        }
+    };
+
+    template<>
+    struct BlockEncoder<DXGI_FORMAT_BC5_UNORM>
+    {
+        static constexpr size_t BLOCK_SIZE = 16;
+
+        static void encode(const Color4* colors, const BlockCompressionQuality quality, uint8_t* block)
+        {
+            encodeBlock<BC4Codec<0>>(colors, quality, block);
+            encodeBlock<BC4Codec<1>>(colors, quality, block + 8);
+        }
+    };
+
+    template<>
+    struct BlockEncoder<DXGI_FORMAT_BC6H_UF16>
+    {
+        static constexpr size_t BLOCK_SIZE = 16;
+
+        static void encode(const Color4* colors, const BlockCompressionQuality quality, uint8_t* block)
+        {
+            encodeBlock<BC6HCodec>(colors, quality, block);
+        }
+    };
+
+    template<>
+    struct BlockEncoder<DXGI_FORMAT_BC7_UNORM>
+    {
+        static constexpr size_t BLOCK_SIZE = 16;
+
+        static void encode(const Color4* colors, const BlockCompressionQuality quality, uint8_t* block)
+        {
+            encodeBlock<BC7Codec>(colors, quality, block);
+        }
+    };
+
+    template<DXGI_FORMAT format>
+    void compressImage(const DirectX::Image& source, const DirectX::Image& destination, const BlockCompressionQuality quality)
+    {
+        const size_t blockWidth = (source.width + 3) / 4;
+        const size_t blockHeight = (source.height + 3) / 4;
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, blockHeight), [&](const tbb::blocked_range<size_t>& range)
+        {
+            for (size_t blockY = range.begin(); blockY < range.end(); blockY++)
+            {
+                uint8_t* block = destination.pixels + blockY * destination.rowPitch;
+
+                for (size_t blockX = 0; blockX < blockWidth; blockX++)
+                {
+                    // Edge blocks of sizes that aren't multiples of 4 repeat the last row and column
+                    Color4 colors[BLOCK_TEXEL_COUNT];
+
+                    for (size_t y = 0; y < 4; y++)
+                    {
+                        const uint8_t* row = source.pixels + std::min(blockY * 4 + y, source.height - 1) * source.rowPitch;
+
+                        for (size_t x = 0; x < 4; x++)
+                            colors[y * 4 + x] = Eigen::Map<const Color4>((const float*)row + std::min(blockX * 4 + x, source.width - 1) * 4);
+                    }
+
+                    BlockEncoder<format>::encode(colors, quality, block);
+                    block += BlockEncoder<format>::BLOCK_SIZE;
+                }
+            }
+        });
+    }
+}
+
+bool BlockCompressor::isSupported(const DXGI_FORMAT format)
+{
+    switch (format)
+    {
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC4_UNORM:
+    case DXGI_FORMAT_BC5_UNORM:
+    case DXGI_FORMAT_BC6H_UF16:
+    case DXGI_FORMAT_BC7_UNORM:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool BlockCompressor::compress(const DirectX::Image* images, const size_t imageCount, const DirectX::TexMetadata& metadata,
+    const DXGI_FORMAT format, DirectX::ScratchImage& result, const BlockCompressionQuality quality)
+{
+    if (!isSupported(format))
+    {
+        Logger::logFormatted(LogType::Error, "Unsupported block compression format %d", format);
+        return false;
+    }
+
+    DirectX::ScratchImage converted;
+
+    if (metadata.format != DXGI_FORMAT_R32G32B32A32_FLOAT)
+    {
+        if (FAILED(DirectX::Convert(images, imageCount, metadata, DXGI_FORMAT_R32G32B32A32_FLOAT,
+            DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, converted)))
+            return false;
+
+        images = converted.GetImages();
+    }
+
+    DirectX::TexMetadata resultMetadata = metadata;
+    resultMetadata.format = format;
+
+    if (FAILED(result.Initialize(resultMetadata)) || result.GetImageCount() != imageCount)
+        return false;
+
+    tbb::parallel_for((size_t)0, imageCount, [&](const size_t i)
+    {
+        const DirectX::Image& source = images[i];
+        const DirectX::Image& destination = result.GetImages()[i];
+
+        switch (format)
+        {
+        case DXGI_FORMAT_BC1_UNORM: compressImage<DXGI_FORMAT_BC1_UNORM>(source, destination, quality); break;
+        case DXGI_FORMAT_BC3_UNORM: compressImage<DXGI_FORMAT_BC3_UNORM>(source, destination, quality); break;
+        case DXGI_FORMAT_BC4_UNORM: compressImage<DXGI_FORMAT_BC4_UNORM>(source, destination, quality); break;
+        case DXGI_FORMAT_BC5_UNORM: compressImage<DXGI_FORMAT_BC5_UNORM>(source, destination, quality); break;
+        case DXGI_FORMAT_BC6H_UF16: compressImage<DXGI_FORMAT_BC6H_UF16>(source, destination, quality); break;
+        case DXGI_FORMAT_BC7_UNORM: compressImage<DXGI_FORMAT_BC7_UNORM>(source, destination, quality); break;
+        default: break;
+        }
+    });
+
+    return true;
+}
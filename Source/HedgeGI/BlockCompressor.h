@@ -0,0 +1,20 @@
+﻿#pragma once
+
+enum class BlockCompressionQuality
+{
+    Fast,   // Bounding box endpoints
+    Normal, // Principal axis endpoints refined once with least squares
+    High    // Principal axis and bounding box endpoints refined with least squares until the error stops improving, best one wins
+};
+
+// Encodes BC1, BC3, BC4, BC5, BC6H and BC7 textures on the CPU. Blocks get encoded in parallel and the encoder
+// keeps no shared state, so any number of threads can compress at the same time without going through a device.
+// BC6H blocks are always written in the single region 10-bit mode and BC7 blocks in the single subset RGBA mode (mode 6).
+class BlockCompressor
+{
+public:
+    static bool isSupported(DXGI_FORMAT format);
+
+    static bool compress(const DirectX::Image* images, size_t imageCount, const DirectX::TexMetadata& metadata,
+        DXGI_FORMAT format, DirectX::ScratchImage& result, BlockCompressionQuality quality = BlockCompressionQuality::Normal);
+};
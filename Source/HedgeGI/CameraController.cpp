@@ -30,6 +30,15 @@ void CameraController::store(PropertyBag& propertyBag) const
     propertyBag.set(PROP("camera.rotation.w()"), rotation.w());
 }
 
+void CameraController::initialize()
+{
+    get<StageParams>()->propertyListeners.push_back(
+    {
+        [this](const PropertyBag& propertyBag) { load(propertyBag); },
+        [this](PropertyBag& propertyBag) { store(propertyBag); }
+    });
+}
+
 void CameraController::update(const float deltaTime)
 {
     const auto viewportWindow = get<ViewportWindow>();
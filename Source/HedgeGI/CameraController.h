@@ -11,5 +11,6 @@ public:
     void load(const PropertyBag& propertyBag);
     void store(PropertyBag& propertyBag) const;
 
+    void initialize() override;
     void update(float deltaTime) override;
 };
@@ -0,0 +1,241 @@
+﻿#include "CommandLine.h"
+
+#include "BakeServer.h"
+#include "BakeService.h"
+#include "HeadlessBaker.h"
+#include "Logger.h"
+#include "Scene.h"
+#include "Stage.h"
+#include "StageParams.h"
+
+namespace
+{
+    const char* const USAGE =
+        "Usage: hedgegi-bake.exe --bake <stage directory> [options]\n"
+        "\n"
+        "Options:\n"
+        "  --properties <file>   Use settings from the given .hgi file instead of the stage's own,\n"
+        "                        applied before every other option regardless of where it appears\n"
+        "  --output <directory>  Directory to save the resulting files to\n"
+        "  --mode <mode>         gi, light-field or meta-instancer\n"
+        "  --engine <engine>     he1 or he2\n"
+        "  --shards <count>      Split the bake across the given amount of worker processes\n"
+        "  --force [off]         Bake everything, even if the output files already exist\n"
+        "  --accumulate [off]    Add samples to the ones of earlier bakes instead of starting over\n"
+        "  --target-noise <%>    Skip existing instances below the given noise when accumulating\n"
+        "\n"
+        "       hedgegi-bake.exe --serve [pipe name]\n"
+        "\n"
+        "Keeps stages loaded between bakes requested through a named pipe (\\\\.\\pipe\\HedgeGI by default).\n"
+        "\n"
+        "HedgeGI.exe accepts the same arguments.\n";
+
+    // Bake threads log concurrently
+    std::atomic<size_t> errorCount;
+    CriticalSection outputCriticalSection;
+
+    void logListener(void* owner, const LogType logType, const char* text)
+    {
+        const char* prefix = "";
+
+        switch (logType)
+        {
+        case LogType::Success: prefix = "[Success] "; break;
+        case LogType::Warning: prefix = "[Warning] "; break;
+        case LogType::Error: prefix = "[Error] "; ++errorCount; break;
+        }
+
+        FILE* file = logType == LogType::Error ? stderr : stdout;
+
+        std::lock_guard lock(outputCriticalSection);
+
+        fprintf(file, "%s%s", prefix, text);
+
+        if (text[0] == '\0' || text[strlen(text) - 1] != '\n')
+            fputc('\n', file);
+
+        fflush(file);
+    }
+
+    void attachConsole()
+    {
+        // The application uses the windows subsystem, output has to be redirected manually
+        if (!AttachConsole(ATTACH_PARENT_PROCESS))
+            return;
+
+        FILE* file;
+        freopen_s(&file, "CONOUT$", "w", stdout);
+        freopen_s(&file, "CONOUT$", "w", stderr);
+    }
+}
+
+bool CommandLine::applyOption(StageParams& params, const char* option, const char* value)
+{
+    if (strcmp(option, "--force") == 0)
+    {
+        params.skipExistingFiles = value != nullptr && strcmp(value, "off") == 0;
+    }
+    else if (strcmp(option, "--accumulate") == 0)
+    {
+        params.accumulateSamples = value == nullptr || strcmp(value, "off") != 0;
+    }
+    else if (value == nullptr)
+    {
+        Logger::logFormatted(LogType::Error, "Missing value for %s", option);
+        return false;
+    }
+    else if (strcmp(option, "--properties") == 0)
+    {
+        params.propertyBag.load(value);
+        params.loadProperties();
+    }
+    else if (strcmp(option, "--output") == 0)
+    {
+        params.outputDirectoryPath = value;
+    }
+    else if (strcmp(option, "--mode") == 0)
+    {
+        if (strcmp(value, "gi") == 0)
+            params.mode = BakingFactoryMode::GI;
+
+        else if (strcmp(value, "light-field") == 0)
+            params.mode = BakingFactoryMode::LightField;
+
+        else if (strcmp(value, "meta-instancer") == 0)
+            params.mode = BakingFactoryMode::MetaInstancer;
+
+        else
+        {
+            Logger::logFormatted(LogType::Error, "Unknown mode %s", value);
+            return false;
+        }
+    }
+    else if (strcmp(option, "--engine") == 0)
+    {
+        if (strcmp(value, "he1") == 0)
+            params.targetEngine = TargetEngine::HE1;
+
+        else if (strcmp(value, "he2") == 0)
+            params.targetEngine = TargetEngine::HE2;
+
+        else
+        {
+            Logger::logFormatted(LogType::Error, "Unknown engine %s", value);
+            return false;
+        }
+    }
+    else if (strcmp(option, "--shards") == 0)
+    {
+        params.shardCount = (uint32_t)strtoul(value, nullptr, 10);
+    }
+    else if (strcmp(option, "--target-noise") == 0)
+    {
+        params.targetNoise = strtof(value, nullptr);
+    }
+    else
+    {
+        Logger::logFormatted(LogType::Error, "Unknown option %s", option);
+        return false;
+    }
+
+    return true;
+}
+
+bool CommandLine::isBake(const int32_t argc, const char* argv[])
+{
+    return argc >= 2 && strcmp(argv[1], "--bake") == 0;
+}
+
+bool CommandLine::isServe(const int32_t argc, const char* argv[])
+{
+    return argc >= 2 && strcmp(argv[1], "--serve") == 0;
+}
+
+void CommandLine::printUsage()
+{
+    fputs(USAGE, stdout);
+}
+
+int32_t CommandLine::run(const int32_t argc, const char* argv[])
+{
+    attachConsole();
+
+    if (isServe(argc, argv))
+    {
+        Logger::addListener(nullptr, logListener);
+
+        BakeServer server(argc >= 3 ? argv[2] : BakeServer::DEFAULT_PIPE_NAME);
+        return server.run();
+    }
+
+    if (argc < 3)
+    {
+        printUsage();
+        return 1;
+    }
+
+    Logger::addListener(nullptr, logListener);
+
+    const HeadlessBaker baker;
+    if (!baker.loadStage(argv[2]))
+        return 1;
+
+    const auto params = baker.getParams();
+    const auto scene = baker.getStage()->getScene();
+
+    std::vector<std::pair<const char*, const char*>> options;
+
+    for (int32_t i = 3; i < argc; i++)
+    {
+        const char* option = argv[i];
+        const char* value = nullptr;
+
+        if (strcmp(option, "--force") == 0 || strcmp(option, "--accumulate") == 0)
+        {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "on") == 0 || strcmp(argv[i + 1], "off") == 0))
+                value = argv[++i];
+        }
+        else
+        {
+            if (i + 1 >= argc)
+            {
+                Logger::logFormatted(LogType::Error, "Missing value for %s", option);
+                printUsage();
+                return 1;
+            }
+
+            value = argv[++i];
+        }
+
+        options.emplace_back(option, value);
+    }
+
+    // Properties replace every setting, the other options are meant to override them
+    std::stable_partition(options.begin(), options.end(), [](const std::pair<const char*, const char*>& option)
+    {
+        return strcmp(option.first, "--properties") == 0;
+    });
+
+    for (auto& [option, value] : options)
+    {
+        if (!applyOption(*params, option, value))
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    const size_t total =
+        params->mode == BakingFactoryMode::GI ? scene->instances.size() :
+        params->mode == BakingFactoryMode::LightField ? scene->shLightFields.size() : scene->metaInstancers.size();
+
+    baker.bake([total](const size_t progress, const char* name)
+    {
+        std::lock_guard lock(outputCriticalSection);
+
+        fprintf(stdout, "[%lld/%lld] %s\n", (long long)progress, (long long)total, name);
+        fflush(stdout);
+    });
+
+    return errorCount > 0 ? 1 : 0;
+}
@@ -0,0 +1,19 @@
+﻿#pragma once
+
+class StageParams;
+
+// Headless entry point for baking from scripts and render farms, shared by HedgeGI.exe and the UI-free hedgegi-bake.exe:
+// hedgegi-bake.exe --bake <stage directory> [options]
+// hedgegi-bake.exe --serve [pipe name]
+class CommandLine
+{
+public:
+    // Value is optional for --force and --accumulate, "on" or "off" sets them explicitly.
+    static bool applyOption(StageParams& params, const char* option, const char* value);
+
+    static bool isBake(int32_t argc, const char* argv[]);
+    static bool isServe(int32_t argc, const char* argv[]);
+    static int32_t run(int32_t argc, const char* argv[]);
+
+    static void printUsage();
+};
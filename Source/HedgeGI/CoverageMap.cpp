@@ -0,0 +1,366 @@
+﻿#include "CoverageMap.h"
+
+#include "BakePoint.h"
+#include "FileStream.h"
+#include "Instance.h"
+#include "Logger.h"
+#include "Math.h"
+#include "Mesh.h"
+#include "Utilities.h"
+
+namespace
+{
+    constexpr uint32_t COVERAGE_MAP_SIGNATURE = 0x4D475643; // CVGM
+    constexpr uint32_t COVERAGE_MAP_VERSION = 2;
+
+    struct ChartVertexKey
+    {
+        int32_t values[5];
+
+        bool operator==(const ChartVertexKey& other) const
+        {
+            return memcmp(values, other.values, sizeof(values)) == 0;
+        }
+    };
+
+    struct ChartVertexKeyHash
+    {
+        size_t operator()(const ChartVertexKey& key) const
+        {
+            return hashData(key.values, sizeof(key.values));
+        }
+    };
+
+    ChartVertexKey makeChartVertexKey(const Vertex& vertex)
+    {
+        // Quantize so that split vertices sharing both UV and position end up in the same chart
+        return
+        {
+            (int32_t)std::roundf(vertex.vPos.x() * 65536.0f),
+            (int32_t)std::roundf(vertex.vPos.y() * 65536.0f),
+            (int32_t)std::roundf(vertex.position.x() * 1024.0f),
+            (int32_t)std::roundf(vertex.position.y() * 1024.0f),
+            (int32_t)std::roundf(vertex.position.z() * 1024.0f)
+        };
+    }
+
+    uint32_t findRoot(std::vector<uint32_t>& parents, uint32_t index)
+    {
+        while (parents[index] != index)
+        {
+            parents[index] = parents[parents[index]];
+            index = parents[index];
+        }
+
+        return index;
+    }
+
+    void unite(std::vector<uint32_t>& parents, const uint32_t left, const uint32_t right)
+    {
+        const uint32_t leftRoot = findRoot(parents, left);
+        const uint32_t rightRoot = findRoot(parents, right);
+
+        if (leftRoot != rightRoot)
+            parents[std::max(leftRoot, rightRoot)] = std::min(leftRoot, rightRoot);
+    }
+}
+
+bool CoverageTexel::covered() const
+{
+    return triangle != COVERAGE_INVALID_INDEX;
+}
+
+bool CoverageTexel::valid() const
+{
+    return covered() && !discarded;
+}
+
+uint64_t CoverageMap::computeHash(const Instance& instance, const uint16_t size)
+{
+    uint64_t hash = hashValue(size, hashData(&COVERAGE_MAP_VERSION, sizeof(COVERAGE_MAP_VERSION)));
+
+    for (auto& mesh : instance.meshes)
+    {
+        hash = hashValue(mesh->vertexCount, hash);
+        hash = hashValue(mesh->triangleCount, hash);
+
+        for (uint32_t i = 0; i < mesh->vertexCount; i++)
+        {
+            const Vertex& vertex = mesh->vertices[i];
+
+            hash = hashData(vertex.position.data(), sizeof(float) * 3, hash);
+            hash = hashData(vertex.normal.data(), sizeof(float) * 3, hash);
+            hash = hashData(vertex.tangent.data(), sizeof(float) * 3, hash);
+            hash = hashData(vertex.binormal.data(), sizeof(float) * 3, hash);
+            hash = hashData(vertex.vPos.data(), sizeof(float) * 2, hash);
+        }
+
+        hash = hashData(mesh->triangles.get(), sizeof(Triangle) * mesh->triangleCount, hash);
+    }
+
+    return hash;
+}
+
+std::unique_ptr<CoverageMap> CoverageMap::create(const Instance& instance, const uint16_t size)
+{
+    std::unique_ptr<CoverageMap> coverageMap = std::make_unique<CoverageMap>();
+
+    coverageMap->size = size;
+    coverageMap->texels.resize(size * size);
+    coverageMap->triangleOffsets.reserve(instance.meshes.size());
+
+    uint32_t triCount = 0;
+    for (auto& mesh : instance.meshes)
+    {
+        coverageMap->triangleOffsets.push_back(triCount);
+        triCount += mesh->triangleCount;
+    }
+
+    // Charts are groups of triangles connected through vertices sharing the same lightmap UV and position
+    std::vector<uint32_t> parents(triCount);
+    for (uint32_t i = 0; i < triCount; i++)
+        parents[i] = i;
+
+    phmap::flat_hash_map<ChartVertexKey, uint32_t, ChartVertexKeyHash> vertexMap;
+
+    for (size_t i = 0; i < instance.meshes.size(); i++)
+    {
+        const Mesh* mesh = instance.meshes[i];
+
+        for (uint32_t j = 0; j < mesh->triangleCount; j++)
+        {
+            const Triangle& triangle = mesh->triangles[j];
+            const uint32_t triangleIndex = coverageMap->triangleOffsets[i] + j;
+
+            for (const uint32_t vertexIndex : { triangle.a, triangle.b, triangle.c })
+            {
+                const auto result = vertexMap.emplace(makeChartVertexKey(mesh->vertices[vertexIndex]), triangleIndex);
+                if (!result.second)
+                    unite(parents, result.first->second, triangleIndex);
+            }
+        }
+    }
+
+    coverageMap->triangleCharts.resize(triCount);
+
+    std::vector<uint32_t> chartIndices(triCount, COVERAGE_INVALID_INDEX);
+
+    for (uint32_t i = 0; i < triCount; i++)
+    {
+        uint32_t& chartIndex = chartIndices[findRoot(parents, i)];
+        if (chartIndex == COVERAGE_INVALID_INDEX)
+            chartIndex = coverageMap->chartCount++;
+
+        coverageMap->triangleCharts[i] = chartIndex;
+    }
+
+    // Rasterize every triangle at each bake point offset, later writes win like they do for bake points
+    const float factor = 0.5f * (1.0f / (float)size);
+
+    uint32_t validTriCount = 0;
+
+    for (size_t i = 0; i < instance.meshes.size(); i++)
+    {
+        const Mesh* mesh = instance.meshes[i];
+
+        for (uint32_t j = 0; j < mesh->triangleCount; j++)
+        {
+            const Triangle& triangle = mesh->triangles[j];
+            const Vertex& a = mesh->vertices[triangle.a];
+            const Vertex& b = mesh->vertices[triangle.b];
+            const Vertex& c = mesh->vertices[triangle.c];
+
+            const uint32_t triangleIndex = coverageMap->triangleOffsets[i] + j;
+            const uint32_t chartIndex = coverageMap->triangleCharts[triangleIndex];
+
+            // Check if the triangle is valid (but keep processing it to avoid false negatives)
+            validTriCount += validateVPos(a.vPos) && validateVPos(b.vPos) && validateVPos(c.vPos) &&
+                !nearlyEqual(a.vPos, b.vPos) && !nearlyEqual(b.vPos, c.vPos) && !nearlyEqual(c.vPos, a.vPos) ? 1u : 0u;
+
+            for (size_t k = 0; k < _countof(BAKE_POINT_OFFSETS); k++)
+            {
+                const Vector2 offsetScaled = BAKE_POINT_OFFSETS[k] * factor;
+
+                const Vector2 aVPos = a.vPos + offsetScaled;
+                const Vector2 bVPos = b.vPos + offsetScaled;
+                const Vector2 cVPos = c.vPos + offsetScaled;
+
+                const Vector2 begin = aVPos.cwiseMin(bVPos).cwiseMin(cVPos);
+                const Vector2 end = aVPos.cwiseMax(bVPos).cwiseMax(cVPos);
+
+                const uint16_t xBegin = std::max(0, (uint16_t)std::roundf((float)size * begin.x()) - 1);
+                const uint16_t xEnd = std::min(size - 1, (uint16_t)std::roundf((float)size * end.x()) + 1);
+
+                const uint16_t yBegin = std::max(0, (uint16_t)std::roundf((float)size * begin.y()) - 1);
+                const uint16_t yEnd = std::min(size - 1, (uint16_t)std::roundf((float)size * end.y()) + 1);
+
+                for (uint16_t y = yBegin; y <= yEnd; y++)
+                {
+                    for (uint16_t x = xBegin; x <= xEnd; x++)
+                    {
+                        const Vector2 vPos(((float)x + 0.5f) / (float)size, ((float)y + 0.5f) / (float)size);
+                        const Vector2 baryUV = getBarycentricCoords(vPos, aVPos, bVPos, cVPos);
+
+                        if (baryUV[0] < 0 || baryUV[0] > 1 ||
+                            baryUV[1] < 0 || baryUV[1] > 1 ||
+                            1 - baryUV[0] - baryUV[1] < 0 ||
+                            1 - baryUV[0] - baryUV[1] > 1)
+                            continue;
+
+                        CoverageTexel& texel = coverageMap->texels[y * size + x];
+                        texel.triangle = triangleIndex;
+                        texel.chart = chartIndex;
+                        texel.offset = (uint8_t)k;
+                    }
+                }
+            }
+        }
+    }
+
+    coverageMap->validTriangleCount = validTriCount;
+
+    // If a good chunk of triangles are invalid, warn the user about it
+    if (validTriCount < triCount / 2)
+        Logger::logFormatted(LogType::Warning, "Instance \"%s\" has invalid lightmap UV data", instance.name.c_str());
+
+    return coverageMap;
+}
+
+std::unique_ptr<CoverageMap> CoverageMap::createOrLoad(const Instance& instance, const uint16_t size, const std::string& cacheDirectoryPath)
+{
+    const uint64_t hash = computeHash(instance, size);
+
+    char fileName[1024];
+    sprintf(fileName, "%s/%s_%016llx.cvgm", cacheDirectoryPath.c_str(), instance.name.c_str(), (unsigned long long)hash);
+
+    std::unique_ptr<CoverageMap> coverageMap = std::make_unique<CoverageMap>();
+    if (coverageMap->load(fileName, hash))
+    {
+        uint32_t triCount = 0;
+        for (auto& mesh : instance.meshes)
+            triCount += mesh->triangleCount;
+
+        // Repeat the warning create() would have given, it'd otherwise only show up on the first bake
+        if (coverageMap->validTriangleCount < triCount / 2)
+            Logger::logFormatted(LogType::Warning, "Instance \"%s\" has invalid lightmap UV data", instance.name.c_str());
+
+        return coverageMap;
+    }
+
+    coverageMap = create(instance, size);
+
+    std::error_code errorCode;
+    std::filesystem::create_directories(cacheDirectoryPath, errorCode);
+
+    coverageMap->save(fileName, hash);
+
+    return coverageMap;
+}
+
+size_t CoverageMap::getIndex(const size_t x, const size_t y) const
+{
+    return y * size + x;
+}
+
+size_t CoverageMap::getMeshIndex(const uint32_t triangle) const
+{
+    return std::upper_bound(triangleOffsets.begin(), triangleOffsets.end(), triangle) - triangleOffsets.begin() - 1;
+}
+
+const CoverageTexel& CoverageMap::getTexel(const size_t x, const size_t y) const
+{
+    return texels[getIndex(x, y)];
+}
+
+bool CoverageMap::valid(const size_t x, const size_t y) const
+{
+    return texels[getIndex(x, y)].valid();
+}
+
+size_t CoverageMap::getValidTexelCount() const
+{
+    size_t count = 0;
+
+    for (auto& texel : texels)
+        count += texel.valid() ? 1u : 0u;
+
+    return count;
+}
+
+bool CoverageMap::load(const std::string& filePath, const uint64_t hash)
+{
+    const FileStream file(filePath.c_str(), "rb");
+    if (!file.isOpen())
+        return false;
+
+    if (file.read<uint32_t>() != COVERAGE_MAP_SIGNATURE || file.read<uint32_t>() != COVERAGE_MAP_VERSION || file.read<uint64_t>() != hash)
+        return false;
+
+    size = file.read<uint16_t>();
+    file.align();
+
+    chartCount = file.read<uint32_t>();
+    validTriangleCount = file.read<uint32_t>();
+
+    // Validate every count against the file length before allocating, a truncated cache must not request gigabytes
+    const long position = file.tell();
+    file.seek(0, SEEK_END);
+    const size_t fileSize = (size_t)file.tell();
+    file.seek(position, SEEK_SET);
+
+    const auto readCount = [&](const size_t elementSize, uint32_t& count)
+    {
+        count = file.read<uint32_t>();
+        return (size_t)file.tell() + (size_t)count * elementSize <= fileSize;
+    };
+
+    uint32_t count;
+
+    if (!readCount(sizeof(CoverageTexel), count) || count != (size_t)size * size)
+        return false;
+
+    texels.resize(count);
+    file.read(texels.data(), texels.size());
+
+    if (!readCount(sizeof(uint32_t), count))
+        return false;
+
+    triangleOffsets.resize(count);
+    file.read(triangleOffsets.data(), triangleOffsets.size());
+
+    if (!readCount(sizeof(uint32_t), count))
+        return false;
+
+    triangleCharts.resize(count);
+    file.read(triangleCharts.data(), triangleCharts.size());
+
+    for (auto& texel : texels)
+        texel.discarded = false;
+
+    return true;
+}
+
+void CoverageMap::save(const std::string& filePath, const uint64_t hash) const
+{
+    const FileStream file(filePath.c_str(), "wb");
+    if (!file.isOpen())
+        return;
+
+    file.write(COVERAGE_MAP_SIGNATURE);
+    file.write(COVERAGE_MAP_VERSION);
+    file.write(hash);
+    file.write(size);
+    file.align();
+
+    file.write(chartCount);
+    file.write(validTriangleCount);
+
+    file.write((uint32_t)texels.size());
+    file.write(texels.data(), texels.size());
+
+    file.write((uint32_t)triangleOffsets.size());
+    file.write(triangleOffsets.data(), triangleOffsets.size());
+
+    file.write((uint32_t)triangleCharts.size());
+    file.write(triangleCharts.data(), triangleCharts.size());
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include "BitmapPool.h"
+
+class Instance;
+
+inline constexpr uint32_t COVERAGE_INVALID_INDEX = ~0u;
+
+struct CoverageTexel
+{
+    uint32_t triangle{ COVERAGE_INVALID_INDEX };
+    uint32_t chart{ COVERAGE_INVALID_INDEX };
+    uint8_t offset{};
+    bool discarded{};
+
+    bool covered() const;
+    bool valid() const;
+};
+
+// Stores which triangle and UV chart every lightmap texel of an instance belongs to.
+// Triangle indices are instance-wide, meshes are laid out one after another in instance order.
+class CoverageMap
+{
+public:
+    uint16_t size{};
+    std::vector<CoverageTexel> texels;
+    std::vector<uint32_t> triangleOffsets;
+    std::vector<uint32_t> triangleCharts;
+    uint32_t chartCount{};
+
+    // Triangles with usable lightmap UVs, kept so cached maps can warn about broken UVs too
+    uint32_t validTriangleCount{};
+
+    static uint64_t computeHash(const Instance& instance, uint16_t size);
+
+    static std::unique_ptr<CoverageMap> create(const Instance& instance, uint16_t size);
+    static std::unique_ptr<CoverageMap> createOrLoad(const Instance& instance, uint16_t size, const std::string& cacheDirectoryPath);
+
+    size_t getIndex(size_t x, size_t y) const;
+    size_t getMeshIndex(uint32_t triangle) const;
+
+    const CoverageTexel& getTexel(size_t x, size_t y) const;
+    bool valid(size_t x, size_t y) const;
+
+    size_t getValidTexelCount() const;
+
+    // Marks texels whose bake points got discarded by the baker as invalid.
+    template<typename TBakePoint>
+    void discard(const BakePointArray<TBakePoint>& bakePoints);
+
+    bool load(const std::string& filePath, uint64_t hash);
+    void save(const std::string& filePath, uint64_t hash) const;
+};
+
+template <typename TBakePoint>
+void CoverageMap::discard(const BakePointArray<TBakePoint>& bakePoints)
+{
+    assert(bakePoints.size() == texels.size());
+
+    for (size_t i = 0; i < texels.size(); i++)
+        texels[i].discarded = !bakePoints[i].valid();
+}
@@ -29,6 +29,12 @@ public:
         file = nullptr;
     }
 
+    // Makes sure everything written so far survives a crash, fails if any buffered data couldn't be written
+    bool flush() const
+    {
+        return fflush(file) == 0 && _commit(_fileno(file)) == 0;
+    }
+
     long tell() const
     {
         return ftell(file);
@@ -48,9 +54,9 @@ public:
     }
 
     template <typename T>
-    void read(T* value, const size_t count) const
+    bool read(T* value, const size_t count) const
     {
-        fread(value, sizeof(T), count, file);
+        return fread(value, sizeof(T), count, file) == count;
     }
 
     std::string readString() const
@@ -76,9 +82,9 @@ public:
     }
 
     template <typename T>
-    void write(T* value, const size_t count) const
+    bool write(T* value, const size_t count) const
     {
-        fwrite(value, sizeof(T), count, file);
+        return fwrite(value, sizeof(T), count, file) == count;
     }
 
     void write(const std::string& value) const
@@ -88,7 +94,9 @@ public:
         fwrite(&length, sizeof(uint32_t), 1, file);
         fwrite(value.data(), sizeof(std::string::value_type), length, file);
 
-        align();
+        // Padding is written out instead of seeked over, seeking past the end does nothing in append mode
+        const uint32_t padding = 0;
+        fwrite(&padding, 1, (4 - length % 4) % 4, file);
     }
 
     void align(const size_t alignment = 4) const
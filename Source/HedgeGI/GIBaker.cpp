@@ -2,7 +2,9 @@
 
 #include "BakePoint.h"
 #include "BakingFactory.h"
+#include "BilateralDenoiserDevice.h"
 #include "BitmapHelper.h"
+#include "SampleAccumulator.h"
 
 struct GIPoint : BakePoint<1, BAKE_POINT_FLAGS_ALL>
 {
@@ -17,15 +19,68 @@ struct GIPoint : BakePoint<1, BAKE_POINT_FLAGS_ALL>
     }
 };
 
-GIPair GIBaker::bake(const RaytracingContext& context, const Instance& instance, const uint16_t size, const BakeParams& bakeParams)
+size_t GIBaker::estimateMemory(const uint16_t size, const GIBakeStage stage, const DenoiserType denoiserType, const size_t pointSize, const size_t basisCount)
 {
-    std::vector<GIPoint> bakePoints = createBakePoints<GIPoint>(context, instance, size);
+    const size_t texelCount = (size_t)size * size;
 
-    BakingFactory::bake(context, bakePoints, bakeParams);
+    // Light map and shadow map, the shadow map is painted as R16F
+    const size_t lightMapMemory = texelCount * sizeof(Color4) * basisCount;
+    const size_t bitmapMemory = lightMapMemory + texelCount * Bitmap::getTexelSize(BitmapFormat::R16F);
+
+    if (stage == GIBakeStage::PostProcess)
+    {
+        // Every step keeps its input and output alive, the steps themselves run one after another
+        const size_t dilateMemory = lightMapMemory + BitmapHelper::estimateDilateMemory(size, size) * 2;
+
+        size_t denoiseMemory = lightMapMemory;
+        if (denoiserType == DenoiserType::Bilateral)
+            denoiseMemory += BilateralDenoiserGuide::estimateMemory(size) + BilateralDenoiserDevice::estimateMemory(size, size);
+
+        // Saving converts into scratch images
+        const size_t saveMemory = lightMapMemory * 2;
+
+        return bitmapMemory + std::max({ dilateMemory, denoiseMemory, saveMemory });
+    }
+
+    return texelCount * (pointSize + sizeof(CoverageTexel) + sizeof(uint8_t)) + bitmapMemory;
+}
+
+size_t GIBaker::estimateMemory(const uint16_t size, const GIBakeStage stage, const DenoiserType denoiserType)
+{
+    return estimateMemory(size, stage, denoiserType, sizeof(GIPoint), GIPoint::BASIS_COUNT);
+}
+
+GIPair GIBaker::bake(const RaytracingContext& context, const Instance& instance, const uint16_t size, const BakeParams& bakeParams, BakeProgress* progress)
+{
+    const std::unique_ptr<CoverageMap> coverageMap = CoverageMap::create(instance, size);
+    return bake(context, instance, *coverageMap, bakeParams, progress);
+}
+
+GIPair GIBaker::bake(const RaytracingContext& context, const Instance& instance, CoverageMap& coverageMap, const BakeParams& bakeParams,
+    BakeProgress* progress, SampleAccumulator* accumulator)
+{
+    BakePointArray<GIPoint> bakePoints = createBakePoints<GIPoint>(instance, coverageMap, progress);
+
+    // Every accumulated session needs fresh samples
+    uint64_t seed = hashData(instance.name.data(), instance.name.size());
+    if (accumulator != nullptr)
+        seed = hashValue(accumulator->getSeedOffset(), seed);
+
+    std::vector<Vector2> luminanceMoments;
+    BakingFactory::bake(context, bakePoints, bakeParams, progress, accumulator != nullptr ? &luminanceMoments : nullptr, seed);
+
+    if (accumulator != nullptr && (progress == nullptr || !progress->isCancelled()))
+    {
+        accumulator->initialize(GIPoint::BASIS_COUNT, coverageMap.size);
+        accumulator->accumulate(bakePoints, luminanceMoments, bakeParams);
+        accumulator->resolve(bakePoints);
+    }
+
+    coverageMap.discard(bakePoints);
 
     return
     {
-        BitmapHelper::createAndPaint(bakePoints, size, size, PAINT_FLAGS_COLOR),
-        BitmapHelper::createAndPaint(bakePoints, size, size, PAINT_FLAGS_SHADOW)
+        BitmapHelper::createAndPaint(bakePoints, coverageMap.size, coverageMap.size, PAINT_FLAGS_COLOR),
+        BitmapHelper::createAndPaint(bakePoints, coverageMap.size, coverageMap.size, PAINT_FLAGS_SHADOW, BitmapFormat::R16F)
     };
 }
\ No newline at end of file
@@ -1,13 +1,24 @@
 ﻿#pragma once
 
+class BakeProgress;
 class Bitmap;
+class CoverageMap;
 class Instance;
+class SampleAccumulator;
 class Scene;
 
 struct BakeParams;
 struct GIPoint;
 struct RaytracingContext;
 
+enum class DenoiserType;
+
+enum class GIBakeStage
+{
+    Bake,
+    PostProcess
+};
+
 struct GIPair
 {
     std::unique_ptr<Bitmap> lightMap;
@@ -17,5 +28,12 @@ struct GIPair
 class GIBaker
 {
 public:
-    static GIPair bake(const RaytracingContext& context, const Instance& instance, uint16_t size, const BakeParams& bakeParams);
+    // Shared by every GI baker, they only differ in the size of their bake points and how many bases they paint.
+    static size_t estimateMemory(uint16_t size, GIBakeStage stage, DenoiserType denoiserType, size_t pointSize, size_t basisCount);
+    static size_t estimateMemory(uint16_t size, GIBakeStage stage, DenoiserType denoiserType);
+
+    static GIPair bake(const RaytracingContext& context, const Instance& instance, uint16_t size, const BakeParams& bakeParams, BakeProgress* progress = nullptr);
+    // Adds the samples to the accumulator if one is given and paints what it accumulated across sessions.
+    static GIPair bake(const RaytracingContext& context, const Instance& instance, CoverageMap& coverageMap, const BakeParams& bakeParams,
+        BakeProgress* progress = nullptr, SampleAccumulator* accumulator = nullptr);
 };
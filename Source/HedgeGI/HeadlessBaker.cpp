@@ -0,0 +1,103 @@
+﻿#include "HeadlessBaker.h"
+
+#include "BakeService.h"
+#include "Instance.h"
+#include "Logger.h"
+#include "SHLightField.h"
+#include "Stage.h"
+#include "StageParams.h"
+
+void PipeOutput::setHandle(const HANDLE handle)
+{
+    std::lock_guard lock(criticalSection);
+    this->handle = handle;
+}
+
+void PipeOutput::writeLine(const char* format, ...)
+{
+    char text[1024];
+
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(text, sizeof(text) - 1, format, args);
+    va_end(args);
+
+    // Each message has to stay on a single line
+    size_t size = std::min<size_t>(length > 0 ? length : 0, sizeof(text) - 2);
+
+    while (size > 0 && (text[size - 1] == '\n' || text[size - 1] == '\r'))
+        --size;
+
+    std::replace(text, text + size, '\n', ' ');
+    text[size++] = '\n';
+
+    std::lock_guard lock(criticalSection);
+
+    if (handle == INVALID_HANDLE_VALUE)
+        return;
+
+    DWORD written;
+    WriteFile(handle, text, (DWORD)size, &written, nullptr);
+}
+
+HeadlessBaker::HeadlessBaker() : document(new Document())
+{
+    document->add(std::make_unique<Stage>());
+    document->add(std::make_unique<StageParams>());
+    document->add(std::make_unique<BakeService>());
+    document->initialize();
+}
+
+Stage* HeadlessBaker::getStage() const
+{
+    return document->get<Stage>();
+}
+
+StageParams* HeadlessBaker::getParams() const
+{
+    return document->get<StageParams>();
+}
+
+BakeService* HeadlessBaker::getBakeService() const
+{
+    return document->get<BakeService>();
+}
+
+bool HeadlessBaker::loadStage(const std::string& directoryPath) const
+{
+    if (!std::filesystem::is_directory(directoryPath))
+    {
+        Logger::logFormatted(LogType::Error, "Unable to locate stage directory %s", directoryPath.c_str());
+        return false;
+    }
+
+    getStage()->loadStage(directoryPath);
+    return getStage()->getScene() != nullptr;
+}
+
+void HeadlessBaker::bake(const std::function<void(size_t progress, const char* name)>& progressFunction) const
+{
+    const auto bakeService = getBakeService();
+
+    auto future = std::async(std::launch::async, [bakeService] { bakeService->bake(); });
+
+    size_t reportedProgress = 0;
+
+    const auto report = [&]
+    {
+        const size_t progress = bakeService->getProgress();
+        if (progress == reportedProgress)
+            return;
+
+        const Instance* instance = bakeService->getLastBakedInstance();
+        const SHLightField* shlf = bakeService->getLastBakedShlf();
+
+        progressFunction(progress, instance != nullptr ? instance->name.c_str() : shlf != nullptr ? shlf->name.c_str() : "");
+        reportedProgress = progress;
+    };
+
+    while (future.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+        report();
+
+    report();
+}
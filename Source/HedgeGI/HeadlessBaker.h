@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include "Document.h"
+
+class BakeService;
+class Stage;
+class StageParams;
+
+// Single line messages sent back by shard workers and the bake server ("L<type> text", "P <progress> <name>").
+// Line breaks within a message get flattened, writes from concurrent threads never interleave.
+class PipeOutput
+{
+    CriticalSection criticalSection;
+    HANDLE handle{ INVALID_HANDLE_VALUE };
+
+public:
+    void setHandle(HANDLE handle);
+    void writeLine(const char* format, ...);
+};
+
+class SceneLookup
+{
+public:
+    // Keeps the order of the items, names without a match are left out.
+    template<typename T>
+    static std::vector<const T*> findByName(const std::vector<std::unique_ptr<T>>& items, const phmap::flat_hash_set<std::string>& names);
+};
+
+// Bakes stages without any of the UI, used by shard workers and the command line.
+class HeadlessBaker
+{
+    // Intentionally leaked, destroying the stage would write its state back into the stage properties
+    Document* document;
+
+public:
+    HeadlessBaker();
+
+    Stage* getStage() const;
+    StageParams* getParams() const;
+    BakeService* getBakeService() const;
+
+    bool loadStage(const std::string& directoryPath) const;
+
+    // Blocks until the bake finishes, the function gets called every time an item completes.
+    void bake(const std::function<void(size_t progress, const char* name)>& progressFunction) const;
+};
+
+template<typename T>
+std::vector<const T*> SceneLookup::findByName(const std::vector<std::unique_ptr<T>>& items, const phmap::flat_hash_set<std::string>& names)
+{
+    std::vector<const T*> result;
+
+    for (auto& item : items)
+    {
+        if (names.contains(item->name))
+            result.push_back(item.get());
+    }
+
+    return result;
+}
@@ -1,10 +1,11 @@
 ﻿#include "LightEditor.h"
 
+#include "BakeService.h"
 #include "BakingFactory.h"
 #include "CameraController.h"
 #include "Im3DManager.h"
 #include "Input.h"
-#include "Light.h"
+#include "LightInfluence.h"
 #include "Math.h"
 #include "PackService.h"
 #include "resource.h"
@@ -53,6 +54,14 @@ const Label CAST_SHADOW_LABEL = { "Cast Shadow",
 
 const char* const LIGHT_SAVE_CHANGES_DESC = "Packs every changed light into stage files.";
 
+const Label LIGHT_INCLUDE_INDIRECT_LABEL = { "Include Indirect",
+    "Also rebakes instances and SH light fields that could receive light bounced off the surfaces this light reaches.\n\n"
+    "This is a conservative estimate based on the light intensity, disabling it only rebakes what is within the light radius." };
+
+const char* const LIGHT_BAKE_AFFECTED_DESC =
+    "Bakes the instances and SH light fields affected by the selected light, both in the same run, "
+    "including the area it used to affect before being edited.";
+
 void LightEditor::drawBillboardsAndUpdateSelection()
 {
     const auto viewportWindow = get<ViewportWindow>();
@@ -249,6 +258,14 @@ void LightEditor::update(float deltaTime)
 
     tooltip(LIGHT_REMOVE_DESC);
 
+    if (selection != originalSelection)
+    {
+        originalSelection = selection;
+
+        if (selection != nullptr)
+            original = *selection;
+    }
+
     if (selection != nullptr)
     {
         Im3d::PushSize(IM3D_LINE_SIZE);
@@ -369,6 +386,31 @@ void LightEditor::update(float deltaTime)
             get<StateManager>()->packResources(PackResourceMode::Light);
 
         tooltip(LIGHT_SAVE_CHANGES_DESC);
+
+        if (params->mode == BakingFactoryMode::GI || (params->mode == BakingFactoryMode::LightField && params->targetEngine == TargetEngine::HE2))
+        {
+            ImGui::SameLine();
+
+            if (ImGui::Button("Bake Affected"))
+            {
+                LightInfluence influence = LightInfluence::compute(*stage->getScene(), *selection, includeIndirect);
+                influence.merge(LightInfluence::compute(*stage->getScene(), original, includeIndirect));
+
+                if (!influence.empty())
+                {
+                    get<BakeService>()->setTargets(influence.instances, influence.shLightFields);
+                    get<StateManager>()->bake();
+                }
+
+                original = *selection;
+            }
+
+            tooltip(LIGHT_BAKE_AFFECTED_DESC);
+
+            ImGui::SameLine();
+            ImGui::Checkbox(LIGHT_INCLUDE_INDIRECT_LABEL.name, &includeIndirect);
+            tooltip(LIGHT_INCLUDE_INDIRECT_LABEL.desc);
+        }
     }
 
     params->dirty |= params->dirtyBVH;
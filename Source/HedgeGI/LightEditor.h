@@ -1,16 +1,20 @@
 ﻿#pragma once
 
+#include "Light.h"
 #include "Texture.h"
 #include "UIComponent.h"
 
-class Light;
-
 class LightEditor final : public UIComponent
 {
     char search[1024]{};
     Light* selection{};
     const Texture lightBulb;
 
+    // State of the selection before it got edited, used to find what the light used to affect
+    const Light* originalSelection{};
+    Light original;
+    bool includeIndirect{ true };
+
     void drawBillboardsAndUpdateSelection();
 
 public:
@@ -5,6 +5,7 @@
 #include "LightField.h"
 #include "Logger.h"
 #include "Math.h"
+#include "ProbeDenoiser.h"
 
 struct LightFieldPoint : BakePoint<8, BAKE_POINT_FLAGS_SHADOW>
 {
@@ -84,7 +85,7 @@ namespace
 }
 
 void LightFieldBaker::createBakePointsRecursively(tbb::task_group& group, CriticalSection& criticalSection, const RaytracingContext& raytracingContext, 
-    LightField& lightField, size_t cellIndex, const AABB& aabb, std::vector<LightFieldPoint>& bakePoints, CornerMap& cornerMap, const BakeParams& bakeParams, const bool regenerateCells)
+    LightField& lightField, size_t cellIndex, const AABB& aabb, BakePointArray<LightFieldPoint>& bakePoints, CornerMap& cornerMap, const BakeParams& bakeParams, const bool regenerateCells)
 {
     RTCPointQueryContext context{};
     rtcInitPointQueryContext(&context);
@@ -171,7 +172,7 @@ void LightFieldBaker::createBakePointsRecursively(tbb::task_group& group, Critic
     }
 }
 
-void LightFieldBaker::bake(LightField& lightField, const RaytracingContext& raytracingContext, const BakeParams& bakeParams, bool regenerateCells)
+void LightFieldBaker::bake(LightField& lightField, const RaytracingContext& raytracingContext, const BakeParams& bakeParams, bool regenerateCells, BakeProgress* progress)
 {
     if (!regenerateCells && lightField.cells.empty())
     {
@@ -193,19 +194,97 @@ void LightFieldBaker::bake(LightField& lightField, const RaytracingContext& rayt
 
     Logger::log(LogType::Normal, "Generating bake points...");
 
-    std::vector<LightFieldPoint> bakePoints;
+    BakePointArray<LightFieldPoint> bakePoints;
     CornerMap cornerMap;
 
-    tbb::task_group group;
+    // Cancelling the context drops the subdivision tasks that haven't started yet
+    BakeProgress::Context taskContext(progress);
+    tbb::task_group group(taskContext.get());
     CriticalSection criticalSection;
 
     createBakePointsRecursively(group, criticalSection, raytracingContext, lightField, 0, lightField.aabb, bakePoints, cornerMap, bakeParams, regenerateCells);
 
     group.wait();
 
+    // A partially subdivided tree can't be reused by later bakes
+    if (progress != nullptr && progress->isCancelled())
+    {
+        lightField.clear(regenerateCells);
+        return;
+    }
+
+    // Subdivision tasks append bake points in whatever order they finish, and random numbers are keyed by
+    // the bake point index. Sort by position, then by cell corner, so repeated bakes produce the same output.
+    {
+        std::vector<Vector3> corners(bakePoints.size());
+
+        for (auto& cornerPair : cornerMap)
+        {
+            for (auto& index : cornerPair.second)
+                corners[index] = cornerPair.first;
+        }
+
+        std::vector<uint32_t> order(bakePoints.size());
+
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = (uint32_t)i;
+
+        tbb::parallel_sort(order.begin(), order.end(), [&](const uint32_t left, const uint32_t right)
+        {
+            const Vector3& leftPosition = bakePoints[left].position;
+            const Vector3& rightPosition = bakePoints[right].position;
+
+            return std::make_tuple(leftPosition.x(), leftPosition.y(), leftPosition.z(), corners[left].x(), corners[left].y(), corners[left].z()) <
+                std::make_tuple(rightPosition.x(), rightPosition.y(), rightPosition.z(), corners[right].x(), corners[right].y(), corners[right].z());
+        });
+
+        BakePointArray<LightFieldPoint> sortedBakePoints;
+        sortedBakePoints.reserve(bakePoints.size());
+
+        std::vector<uint32_t> sortedIndices(order.size());
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            sortedBakePoints.push_back(bakePoints[order[i]]);
+            sortedIndices[order[i]] = (uint32_t)i;
+        }
+
+        // Corner map refers to bake points by index
+        for (auto& cornerPair : cornerMap)
+        {
+            for (auto& index : cornerPair.second)
+                index = sortedIndices[index];
+        }
+
+        bakePoints = std::move(sortedBakePoints);
+    }
+
     Logger::log(LogType::Normal, "Baking points...");
 
-    BakingFactory::bake(raytracingContext, bakePoints, bakeParams);
+    uint64_t seed = hashData(lightField.aabb.min().data(), sizeof(float) * 3);
+    seed = hashData(lightField.aabb.max().data(), sizeof(float) * 3, seed);
+
+    BakingFactory::bake(raytracingContext, bakePoints, bakeParams, progress, nullptr, seed);
+
+    if (progress != nullptr && progress->isCancelled())
+    {
+        lightField.clear(false);
+        return;
+    }
+
+    if (bakeParams.postProcess.denoiseProbes)
+    {
+        Logger::log(LogType::Normal, "Denoising...");
+
+        // Reach the probes of neighboring cells at the smallest cell size
+        ProbeDenoiser::process(raytracingContext, bakePoints, bakeParams.lightField.minCellRadius * 2.0f, progress);
+
+        if (progress != nullptr && progress->isCancelled())
+        {
+            lightField.clear(false);
+            return;
+        }
+    }
 
     Logger::log(LogType::Normal, "Finalizing...");
 
@@ -1,5 +1,8 @@
 ﻿#pragma once
 
+#include "BitmapPool.h"
+
+class BakeProgress;
 class LightField;
 
 struct BakeParams;
@@ -16,9 +19,9 @@ typedef phmap::parallel_flat_hash_map<Vector3, std::vector<uint32_t>, EigenHash<
 class LightFieldBaker
 {
     static void createBakePointsRecursively(tbb::task_group& group, CriticalSection& criticalSection, const RaytracingContext& raytracingContext, 
-        LightField& lightField, size_t cellIndex, const AABB& aabb, std::vector<LightFieldPoint>& bakePoints, CornerMap& cornerMap, const BakeParams& bakeParams, bool regenerateCells);
+        LightField& lightField, size_t cellIndex, const AABB& aabb, BakePointArray<LightFieldPoint>& bakePoints, CornerMap& cornerMap, const BakeParams& bakeParams, bool regenerateCells);
 
 public:
-    static void bake(LightField& lightField, const RaytracingContext& raytracingContext, const BakeParams& bakeParams, bool regenerateCells);
+    static void bake(LightField& lightField, const RaytracingContext& raytracingContext, const BakeParams& bakeParams, bool regenerateCells, BakeProgress* progress = nullptr);
     static std::unique_ptr<LightField> bake(const RaytracingContext& raytracingContext, const BakeParams& bakeParams);
 };
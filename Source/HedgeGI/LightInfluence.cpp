@@ -0,0 +1,84 @@
+﻿#include "LightInfluence.h"
+
+#include "Instance.h"
+#include "Light.h"
+#include "Scene.h"
+#include "SHLightField.h"
+
+// Roughly the smallest step 8-bit light maps are able to represent
+const float INDIRECT_INTENSITY_THRESHOLD = 1.0f / 256.0f;
+
+float LightInfluence::computeIndirectRadius(const Light& light)
+{
+    return sqrtf(light.color.maxCoeff() / INDIRECT_INTENSITY_THRESHOLD);
+}
+
+AABB LightInfluence::getAABB(const SHLightField& shlf)
+{
+    const Matrix4 matrix = shlf.getMatrix();
+
+    AABB aabb;
+    aabb.setEmpty();
+
+    for (size_t i = 0; i < 8; i++)
+    {
+        const Vector4 corner((i & 4) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 1) ? 0.5f : -0.5f, 1.0f);
+        aabb.extend(Vector3((matrix * corner).head<3>() / 10.0f));
+    }
+
+    return aabb;
+}
+
+LightInfluence LightInfluence::compute(const Scene& scene, const Light& light, const bool includeIndirect)
+{
+    LightInfluence influence;
+
+    // Sun affects everything
+    if (light.type == LightType::Directional)
+    {
+        for (auto& instance : scene.instances)
+            influence.instances.push_back(instance.get());
+
+        for (auto& shlf : scene.shLightFields)
+            influence.shLightFields.push_back(shlf.get());
+
+        return influence;
+    }
+
+    const float radius = light.range.w() + (includeIndirect ? computeIndirectRadius(light) : 0.0f);
+    const float radiusSquared = radius * radius;
+
+    for (auto& instance : scene.instances)
+    {
+        if (instance->aabb.squaredExteriorDistance(light.position) <= radiusSquared)
+            influence.instances.push_back(instance.get());
+    }
+
+    for (auto& shlf : scene.shLightFields)
+    {
+        if (getAABB(*shlf).squaredExteriorDistance(light.position) <= radiusSquared)
+            influence.shLightFields.push_back(shlf.get());
+    }
+
+    return influence;
+}
+
+void LightInfluence::merge(const LightInfluence& influence)
+{
+    for (auto& instance : influence.instances)
+    {
+        if (std::find(instances.begin(), instances.end(), instance) == instances.end())
+            instances.push_back(instance);
+    }
+
+    for (auto& shlf : influence.shLightFields)
+    {
+        if (std::find(shLightFields.begin(), shLightFields.end(), shlf) == shLightFields.end())
+            shLightFields.push_back(shlf);
+    }
+}
+
+bool LightInfluence::empty() const
+{
+    return instances.empty() && shLightFields.empty();
+}
@@ -0,0 +1,25 @@
+﻿#pragma once
+
+class Instance;
+class Light;
+class Scene;
+class SHLightField;
+
+// Instances and SH light fields whose baked lighting may change when a light gets edited.
+class LightInfluence
+{
+public:
+    std::vector<const Instance*> instances;
+    std::vector<const SHLightField*> shLightFields;
+
+    // Distance from the light's range at which light bounced off the surfaces
+    // it reaches becomes too dim to matter, assuming every surface is perfectly white.
+    static float computeIndirectRadius(const Light& light);
+
+    static AABB getAABB(const SHLightField& shlf);
+
+    static LightInfluence compute(const Scene& scene, const Light& light, bool includeIndirect);
+
+    void merge(const LightInfluence& influence);
+    bool empty() const;
+};
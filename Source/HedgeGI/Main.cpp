@@ -1,4 +1,6 @@
 #include "App.h"
+#include "BakeShard.h"
+#include "CommandLine.h"
 
 #pragma comment(linker, "/SUBSYSTEM:windows /ENTRY:mainCRTStartup")
 
@@ -15,6 +17,13 @@ int32_t main(int32_t argc, const char* argv[])
     DirectX::Initialize();
     CoInitializeEx(nullptr, COINIT_MULTITHREADED);
 
+    // Launched by a coordinator to bake a part of the stage
+    if (argc == 3 && strcmp(argv[1], "--bake-shard") == 0)
+        std::_Exit(BakeShard::runWorker(argv[2]));
+
+    if (CommandLine::isBake(argc, argv) || CommandLine::isServe(argc, argv))
+        std::_Exit(CommandLine::run(argc, argv));
+
     {
         App app;
         app.run();
@@ -557,6 +557,11 @@ inline void computeTangent(const Vector3& normal, Vector3& tangent, Vector3& bin
     binormal = tangent.cross(normal).normalized();
 }
 
+inline float getLuminance(const Color3& color)
+{
+    return color.x() * 0.2126f + color.y() * 0.7152f + color.z() * 0.0722f;
+}
+
 inline Color3 ldrReady(const Color3& color)
 {
     Color3 hsv = rgb2Hsv(color);
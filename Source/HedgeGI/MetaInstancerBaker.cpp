@@ -3,8 +3,12 @@
 #include "BakePoint.h"
 #include "BakingFactory.h"
 #include "MetaInstancer.h"
+#include "ProbeDenoiser.h"
 #include "SnapToClosestTriangle.h"
 
+// Instances are usually scattered densely, a few neighbors fit within this distance.
+const float MTI_DENOISE_RADIUS = 1.0f;
+
 struct MetaInstancerPoint : BakePoint<1, BAKE_POINT_FLAGS_SHADOW | BAKE_POINT_FLAGS_SOFT_SHADOW>
 {
     void addSample(const Color3& color, const Vector3& worldSpaceDirection)
@@ -18,9 +22,9 @@ struct MetaInstancerPoint : BakePoint<1, BAKE_POINT_FLAGS_SHADOW | BAKE_POINT_FL
     }
 };
 
-void MetaInstancerBaker::bake(MetaInstancer& metaInstancer, const RaytracingContext& raytracingContext, const BakeParams& bakeParams)
+void MetaInstancerBaker::bake(MetaInstancer& metaInstancer, const RaytracingContext& raytracingContext, const BakeParams& bakeParams, BakeProgress* progress)
 {
-    std::vector<MetaInstancerPoint> bakePoints;
+    BakePointArray<MetaInstancerPoint> bakePoints;
     bakePoints.resize(metaInstancer.instances.size());
 
     for (size_t i = 0; i < bakePoints.size(); i++)
@@ -36,8 +40,19 @@ void MetaInstancerBaker::bake(MetaInstancer& metaInstancer, const RaytracingCont
         bakePoint.y = (i >> 16) & 0xFFFF;
     }
 
-    SnapToClosestTriangle::process(raytracingContext, bakePoints, 5.0f);
-    BakingFactory::bake(raytracingContext, bakePoints, bakeParams);
+    SnapToClosestTriangle::process(raytracingContext, bakePoints, 5.0f, progress);
+    BakingFactory::bake(raytracingContext, bakePoints, bakeParams, progress, nullptr, hashData(metaInstancer.name.data(), metaInstancer.name.size()));
+
+    if (progress != nullptr && progress->isCancelled())
+        return;
+
+    if (bakeParams.postProcess.denoiseProbes)
+    {
+        ProbeDenoiser::process(raytracingContext, bakePoints, MTI_DENOISE_RADIUS, progress);
+
+        if (progress != nullptr && progress->isCancelled())
+            return;
+    }
 
     for (auto& bakePoint : bakePoints)
     {
@@ -2,10 +2,11 @@
 
 struct BakeParams;
 struct RaytracingContext;
+class BakeProgress;
 class MetaInstancer;
 
 class MetaInstancerBaker
 {
 public:
-    static void bake(MetaInstancer& metaInstancer, const RaytracingContext& raytracingContext, const BakeParams& bakeParams);
+    static void bake(MetaInstancer& metaInstancer, const RaytracingContext& raytracingContext, const BakeParams& bakeParams, BakeProgress* progress = nullptr);
 };
@@ -0,0 +1,43 @@
+﻿#include "NumaArenas.h"
+
+#include "Logger.h"
+
+NumaArenas::NumaArenas()
+{
+    const std::vector<tbb::numa_node_id> nodes = tbb::info::numa_nodes();
+
+    if (nodes.size() > 1)
+    {
+        for (const tbb::numa_node_id node : nodes)
+            arenas.push_back(std::make_unique<tbb::task_arena>(tbb::task_arena::constraints(node)));
+
+        Logger::logFormatted(LogType::Normal, "Baking across %d NUMA nodes", (int)nodes.size());
+    }
+    else
+    {
+        arenas.push_back(std::make_unique<tbb::task_arena>());
+    }
+
+    loads.resize(arenas.size());
+}
+
+size_t NumaArenas::getCount() const
+{
+    return arenas.size();
+}
+
+size_t NumaArenas::acquire(const double cost)
+{
+    std::lock_guard lock(criticalSection);
+
+    const size_t index = std::min_element(loads.begin(), loads.end()) - loads.begin();
+    loads[index] += cost;
+
+    return index;
+}
+
+void NumaArenas::release(const size_t index, const double cost)
+{
+    std::lock_guard lock(criticalSection);
+    loads[index] -= cost;
+}
@@ -0,0 +1,28 @@
+﻿#pragma once
+
+// One task arena per NUMA node, work executed in an arena only runs on the cores of its node.
+// Ends up with a single unconstrained arena if there is only one node or TBB can't see the topology (tbbbind is missing).
+class NumaArenas
+{
+    std::vector<std::unique_ptr<tbb::task_arena>> arenas;
+    std::vector<double> loads;
+    CriticalSection criticalSection;
+
+public:
+    NumaArenas();
+
+    size_t getCount() const;
+
+    // Picks the arena with the least amount of work in flight.
+    size_t acquire(double cost);
+    void release(size_t index, double cost);
+
+    template<typename TFunction>
+    auto execute(size_t index, TFunction&& function);
+};
+
+template <typename TFunction>
+auto NumaArenas::execute(const size_t index, TFunction&& function)
+{
+    return arenas[index]->execute(std::forward<TFunction>(function));
+}
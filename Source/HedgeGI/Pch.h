@@ -50,17 +50,20 @@ using Quaternion = Eigen::Quaternionf;
 
 // std
 #include <algorithm>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
 #include <execution>
 #include <filesystem>
 #include <fstream>
 #include <future>
+#include <io.h>
 #include <random>
 #include <unordered_set>
 #include <vector>
 #include <stack>
 #include <map>
+#include <queue>
 
 // parallel_hashmap
 #include <phmap.h>
@@ -0,0 +1,665 @@
+﻿#include "PngWriter.h"
+
+#include "FileStream.h"
+
+namespace
+{
+    constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+    constexpr size_t WINDOW_SIZE = 32768;
+    constexpr size_t HASH_BITS = 15;
+    constexpr size_t MAX_CHAIN_LENGTH = 16;
+    constexpr size_t MIN_MATCH_LENGTH = 3;
+    constexpr size_t MAX_MATCH_LENGTH = 258;
+
+    constexpr size_t LITERAL_CODE_COUNT = 286;
+    constexpr size_t DISTANCE_CODE_COUNT = 30;
+    constexpr size_t CODE_LENGTH_CODE_COUNT = 19;
+
+    constexpr uint16_t LENGTH_BASES[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    constexpr uint8_t LENGTH_EXTRA_BITS[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+    constexpr uint16_t DISTANCE_BASES[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    constexpr uint8_t DISTANCE_EXTRA_BITS[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    constexpr uint8_t CODE_LENGTH_ORDER[] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    class BitWriter
+    {
+        std::vector<uint8_t>& data;
+        uint64_t bits{};
+        size_t bitCount{};
+
+    public:
+        explicit BitWriter(std::vector<uint8_t>& data) : data(data) {}
+
+        void write(const uint32_t value, const size_t count)
+        {
+            bits |= (uint64_t)value << bitCount;
+            bitCount += count;
+
+            while (bitCount >= 8)
+            {
+                data.push_back((uint8_t)bits);
+                bits >>= 8;
+                bitCount -= 8;
+            }
+        }
+
+        void align()
+        {
+            if (bitCount > 0)
+                write(0, 8 - bitCount);
+        }
+    };
+
+    // Symbols of the LZ77 pass, literals have no distance.
+    struct Token
+    {
+        uint16_t length;
+        uint16_t distance;
+    };
+
+    struct HuffmanCode
+    {
+        uint8_t lengths[LITERAL_CODE_COUNT]{};
+        uint16_t codes[LITERAL_CODE_COUNT]{};
+
+        // Builds length limited codes, lengths past the limit get folded back the same way zlib and miniz do.
+        void build(const uint32_t* frequencies, const size_t count, const size_t maxLength)
+        {
+            struct Node
+            {
+                uint32_t frequency;
+                int32_t left;
+                int32_t right;
+            };
+
+            std::vector<Node> nodes;
+            std::vector<int32_t> symbols(count, -1);
+            std::priority_queue<std::pair<uint32_t, int32_t>, std::vector<std::pair<uint32_t, int32_t>>, std::greater<>> queue;
+
+            for (size_t i = 0; i < count; i++)
+            {
+                lengths[i] = 0;
+
+                if (frequencies[i] == 0)
+                    continue;
+
+                symbols[i] = (int32_t)nodes.size();
+                queue.emplace(frequencies[i], (int32_t)nodes.size());
+                nodes.push_back({ frequencies[i], -1, -1 });
+            }
+
+            if (nodes.empty())
+                return;
+
+            if (nodes.size() == 1)
+            {
+                for (size_t i = 0; i < count; i++)
+                    lengths[i] = symbols[i] >= 0 ? 1 : 0;
+
+                assignCodes(count);
+                return;
+            }
+
+            while (queue.size() > 1)
+            {
+                const auto left = queue.top();
+                queue.pop();
+                const auto right = queue.top();
+                queue.pop();
+
+                queue.emplace(left.first + right.first, (int32_t)nodes.size());
+                nodes.push_back({ left.first + right.first, left.second, right.second });
+            }
+
+            std::vector<uint32_t> depths(nodes.size());
+            for (size_t i = nodes.size() - 1; i != ~0ull; i--)
+            {
+                if (nodes[i].left >= 0)
+                {
+                    depths[nodes[i].left] = depths[i] + 1;
+                    depths[nodes[i].right] = depths[i] + 1;
+                }
+            }
+
+            uint32_t lengthCounts[32]{};
+            std::vector<std::pair<uint32_t, size_t>> sorted;
+
+            for (size_t i = 0; i < count; i++)
+            {
+                if (symbols[i] < 0)
+                    continue;
+
+                lengthCounts[std::min<uint32_t>(depths[symbols[i]], (uint32_t)maxLength)]++;
+                sorted.emplace_back(frequencies[i], i);
+            }
+
+            uint32_t total = 0;
+            for (size_t i = maxLength; i > 0; i--)
+                total += lengthCounts[i] << (maxLength - i);
+
+            while (total != (1u << maxLength))
+            {
+                lengthCounts[maxLength]--;
+
+                for (size_t i = maxLength - 1; i > 0; i--)
+                {
+                    if (lengthCounts[i] != 0)
+                    {
+                        lengthCounts[i]--;
+                        lengthCounts[i + 1] += 2;
+                        break;
+                    }
+                }
+
+                total--;
+            }
+
+            // Most frequent symbols get the shortest codes
+            std::stable_sort(sorted.begin(), sorted.end(), [](const auto& left, const auto& right) { return left.first > right.first; });
+
+            size_t index = 0;
+            for (size_t i = 1; i <= maxLength; i++)
+            {
+                for (uint32_t j = 0; j < lengthCounts[i]; j++)
+                    lengths[sorted[index++].second] = (uint8_t)i;
+            }
+
+            assignCodes(count);
+        }
+
+        // Canonical codes, reversed since deflate writes them starting from the most significant bit.
+        void assignCodes(const size_t count)
+        {
+            uint16_t lengthCounts[16]{};
+            for (size_t i = 0; i < count; i++)
+                lengthCounts[lengths[i]]++;
+
+            lengthCounts[0] = 0;
+
+            uint16_t nextCodes[16]{};
+            uint16_t code = 0;
+
+            for (size_t i = 1; i < 16; i++)
+            {
+                code = (uint16_t)((code + lengthCounts[i - 1]) << 1);
+                nextCodes[i] = code;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                if (lengths[i] == 0)
+                    continue;
+
+                uint16_t value = nextCodes[lengths[i]]++;
+                uint16_t reversed = 0;
+
+                for (size_t j = 0; j < lengths[i]; j++)
+                {
+                    reversed = (uint16_t)((reversed << 1) | (value & 1));
+                    value >>= 1;
+                }
+
+                codes[i] = reversed;
+            }
+        }
+
+        void write(BitWriter& writer, const size_t symbol) const
+        {
+            writer.write(codes[symbol], lengths[symbol]);
+        }
+    };
+
+    size_t getLengthCode(const size_t length)
+    {
+        return std::upper_bound(std::begin(LENGTH_BASES), std::end(LENGTH_BASES), (uint16_t)length) - std::begin(LENGTH_BASES) - 1;
+    }
+
+    size_t getDistanceCode(const size_t distance)
+    {
+        return std::upper_bound(std::begin(DISTANCE_BASES), std::end(DISTANCE_BASES), (uint16_t)distance) - std::begin(DISTANCE_BASES) - 1;
+    }
+
+    uint32_t hash(const uint8_t* data)
+    {
+        return ((data[0] << 16 | data[1] << 8 | data[2]) * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Greedy matching with a short hash chain, good enough for filtered lightmaps which are mostly runs.
+    void findMatches(const uint8_t* data, const size_t size, std::vector<Token>& tokens)
+    {
+        std::vector<int32_t> heads(1 << HASH_BITS, -1);
+        std::vector<int32_t> previous(size);
+
+        tokens.reserve(size / 2);
+
+        size_t position = 0;
+        while (position < size)
+        {
+            size_t bestLength = 0;
+            size_t bestDistance = 0;
+
+            if (position + MIN_MATCH_LENGTH <= size)
+            {
+                const uint32_t key = hash(data + position);
+                const size_t maxLength = std::min(MAX_MATCH_LENGTH, size - position);
+
+                int32_t candidate = heads[key];
+                for (size_t i = 0; i < MAX_CHAIN_LENGTH && candidate >= 0 && position - candidate <= WINDOW_SIZE; i++)
+                {
+                    size_t length = 0;
+                    while (length < maxLength && data[candidate + length] == data[position + length])
+                        length++;
+
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestDistance = position - candidate;
+
+                        if (length == maxLength)
+                            break;
+                    }
+
+                    candidate = previous[candidate];
+                }
+            }
+
+            const size_t advance = bestLength >= MIN_MATCH_LENGTH ? bestLength : 1;
+
+            if (bestLength >= MIN_MATCH_LENGTH)
+                tokens.push_back({ (uint16_t)bestLength, (uint16_t)bestDistance });
+            else
+                tokens.push_back({ data[position], 0 });
+
+            for (size_t i = 0; i < advance; i++, position++)
+            {
+                if (position + MIN_MATCH_LENGTH > size)
+                    continue;
+
+                const uint32_t key = hash(data + position);
+                previous[position] = heads[key];
+                heads[key] = (int32_t)position;
+            }
+        }
+    }
+
+    void writeCodeLengths(BitWriter& writer, const HuffmanCode& literalCode, const size_t literalCount, const HuffmanCode& distanceCode, const size_t distanceCount)
+    {
+        uint8_t lengths[LITERAL_CODE_COUNT + DISTANCE_CODE_COUNT];
+        memcpy(lengths, literalCode.lengths, literalCount);
+        memcpy(lengths + literalCount, distanceCode.lengths, distanceCount);
+
+        const size_t count = literalCount + distanceCount;
+
+        // Run length encode with the code length alphabet, symbol and extra bits per entry
+        std::vector<std::pair<uint8_t, uint8_t>> symbols;
+        uint32_t frequencies[CODE_LENGTH_CODE_COUNT]{};
+
+        for (size_t i = 0; i < count;)
+        {
+            size_t runLength = 1;
+            while (i + runLength < count && lengths[i + runLength] == lengths[i])
+                runLength++;
+
+            size_t remaining = runLength;
+
+            if (lengths[i] == 0)
+            {
+                while (remaining >= 11)
+                {
+                    const size_t length = std::min<size_t>(remaining, 138);
+                    symbols.emplace_back(18, (uint8_t)(length - 11));
+                    remaining -= length;
+                }
+
+                if (remaining >= 3)
+                {
+                    symbols.emplace_back(17, (uint8_t)(remaining - 3));
+                    remaining = 0;
+                }
+            }
+            else
+            {
+                symbols.emplace_back(lengths[i], 0);
+                remaining--;
+
+                while (remaining >= 3)
+                {
+                    const size_t length = std::min<size_t>(remaining, 6);
+                    symbols.emplace_back(16, (uint8_t)(length - 3));
+                    remaining -= length;
+                }
+            }
+
+            for (; remaining > 0; remaining--)
+                symbols.emplace_back(lengths[i], 0);
+
+            i += runLength;
+        }
+
+        for (auto& symbol : symbols)
+            frequencies[symbol.first]++;
+
+        HuffmanCode code;
+        code.build(frequencies, CODE_LENGTH_CODE_COUNT, 7);
+
+        size_t codeLengthCount = CODE_LENGTH_CODE_COUNT;
+        while (codeLengthCount > 4 && code.lengths[CODE_LENGTH_ORDER[codeLengthCount - 1]] == 0)
+            codeLengthCount--;
+
+        writer.write((uint32_t)(literalCount - 257), 5);
+        writer.write((uint32_t)(distanceCount - 1), 5);
+        writer.write((uint32_t)(codeLengthCount - 4), 4);
+
+        for (size_t i = 0; i < codeLengthCount; i++)
+            writer.write(code.lengths[CODE_LENGTH_ORDER[i]], 3);
+
+        for (auto& symbol : symbols)
+        {
+            code.write(writer, symbol.first);
+
+            if (symbol.first == 16)
+                writer.write(symbol.second, 2);
+            else if (symbol.first == 17)
+                writer.write(symbol.second, 3);
+            else if (symbol.first == 18)
+                writer.write(symbol.second, 7);
+        }
+    }
+
+    // Compresses a chunk into a single dynamic block. Chunks other than the last one end with an empty
+    // stored block to get back to a byte boundary, like a zlib sync flush.
+    void deflateChunk(const uint8_t* data, const size_t size, const bool last, std::vector<uint8_t>& output)
+    {
+        std::vector<Token> tokens;
+        findMatches(data, size, tokens);
+
+        uint32_t literalFrequencies[LITERAL_CODE_COUNT]{};
+        uint32_t distanceFrequencies[DISTANCE_CODE_COUNT]{};
+
+        for (auto& token : tokens)
+        {
+            if (token.distance == 0)
+            {
+                literalFrequencies[token.length]++;
+            }
+            else
+            {
+                literalFrequencies[257 + getLengthCode(token.length)]++;
+                distanceFrequencies[getDistanceCode(token.distance)]++;
+            }
+        }
+
+        literalFrequencies[256] = 1;
+
+        HuffmanCode literalCode;
+        literalCode.build(literalFrequencies, LITERAL_CODE_COUNT, 15);
+
+        HuffmanCode distanceCode;
+        distanceCode.build(distanceFrequencies, DISTANCE_CODE_COUNT, 15);
+
+        // At least one distance code has to be defined even if there are no matches
+        if (std::all_of(distanceCode.lengths, distanceCode.lengths + DISTANCE_CODE_COUNT, [](const uint8_t length) { return length == 0; }))
+        {
+            distanceCode.lengths[0] = 1;
+            distanceCode.assignCodes(DISTANCE_CODE_COUNT);
+        }
+
+        size_t literalCount = LITERAL_CODE_COUNT;
+        while (literalCount > 257 && literalCode.lengths[literalCount - 1] == 0)
+            literalCount--;
+
+        size_t distanceCount = DISTANCE_CODE_COUNT;
+        while (distanceCount > 1 && distanceCode.lengths[distanceCount - 1] == 0)
+            distanceCount--;
+
+        output.reserve(size / 2);
+
+        BitWriter writer(output);
+        writer.write(last ? 1 : 0, 1);
+        writer.write(2, 2);
+
+        writeCodeLengths(writer, literalCode, literalCount, distanceCode, distanceCount);
+
+        for (auto& token : tokens)
+        {
+            if (token.distance == 0)
+            {
+                literalCode.write(writer, token.length);
+                continue;
+            }
+
+            const size_t lengthCode = getLengthCode(token.length);
+            literalCode.write(writer, 257 + lengthCode);
+            writer.write(token.length - LENGTH_BASES[lengthCode], LENGTH_EXTRA_BITS[lengthCode]);
+
+            const size_t distanceIndex = getDistanceCode(token.distance);
+            distanceCode.write(writer, distanceIndex);
+            writer.write(token.distance - DISTANCE_BASES[distanceIndex], DISTANCE_EXTRA_BITS[distanceIndex]);
+        }
+
+        literalCode.write(writer, 256);
+
+        if (!last)
+        {
+            writer.write(0, 3);
+            writer.align();
+            writer.write(0x0000, 16);
+            writer.write(0xFFFF, 16);
+        }
+        else
+        {
+            writer.align();
+        }
+    }
+
+    uint8_t paeth(const uint8_t left, const uint8_t up, const uint8_t upLeft)
+    {
+        const int estimate = left + up - upLeft;
+        const int leftDistance = std::abs(estimate - left);
+        const int upDistance = std::abs(estimate - up);
+        const int upLeftDistance = std::abs(estimate - upLeft);
+
+        if (leftDistance <= upDistance && leftDistance <= upLeftDistance)
+            return left;
+
+        return upDistance <= upLeftDistance ? up : upLeft;
+    }
+
+    // Tries every filter type and keeps the one with the smallest sum of absolute differences.
+    void filterRow(const uint8_t* row, const uint8_t* previousRow, const size_t size, uint8_t* output)
+    {
+        constexpr size_t BPP = 4;
+
+        size_t bestFilter = 0;
+        uint64_t bestSum = ~0ull;
+
+        for (size_t filter = 0; filter < 5; filter++)
+        {
+            uint64_t sum = 0;
+
+            for (size_t i = 0; i < size; i++)
+            {
+                const uint8_t left = i >= BPP ? row[i - BPP] : 0;
+                const uint8_t up = previousRow != nullptr ? previousRow[i] : 0;
+                const uint8_t upLeft = previousRow != nullptr && i >= BPP ? previousRow[i - BPP] : 0;
+
+                uint8_t value = row[i];
+                switch (filter)
+                {
+                case 1: value -= left; break;
+                case 2: value -= up; break;
+                case 3: value -= (uint8_t)((left + up) / 2); break;
+                case 4: value -= paeth(left, up, upLeft); break;
+                default: break;
+                }
+
+                output[i + 1] = value;
+                sum += (uint64_t)std::abs((int8_t)value);
+            }
+
+            if (sum < bestSum)
+            {
+                bestSum = sum;
+                bestFilter = filter;
+            }
+        }
+
+        output[0] = (uint8_t)bestFilter;
+
+        // Output holds the last filter tried, redo the winner
+        if (bestFilter == 4)
+            return;
+
+        for (size_t i = 0; i < size; i++)
+        {
+            const uint8_t left = i >= BPP ? row[i - BPP] : 0;
+            const uint8_t up = previousRow != nullptr ? previousRow[i] : 0;
+
+            uint8_t value = row[i];
+            switch (bestFilter)
+            {
+            case 1: value -= left; break;
+            case 2: value -= up; break;
+            case 3: value -= (uint8_t)((left + up) / 2); break;
+            default: break;
+            }
+
+            output[i + 1] = value;
+        }
+    }
+
+    uint32_t computeAdler32(const uint8_t* data, const size_t size)
+    {
+        uint32_t a = 1;
+        uint32_t b = 0;
+
+        for (size_t i = 0; i < size;)
+        {
+            // Largest amount of bytes before b can overflow
+            const size_t end = std::min(size, i + 5552);
+
+            for (; i < end; i++)
+            {
+                a += data[i];
+                b += a;
+            }
+
+            a %= 65521;
+            b %= 65521;
+        }
+
+        return (b << 16) | a;
+    }
+
+    uint32_t computeCrc32(const uint8_t* data, const size_t size, uint32_t crc = 0)
+    {
+        static const auto table = []
+        {
+            std::array<uint32_t, 256> table{};
+
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t value = i;
+                for (size_t j = 0; j < 8; j++)
+                    value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+
+                table[i] = value;
+            }
+
+            return table;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+        return ~crc;
+    }
+
+    void writeBigEndian(std::vector<uint8_t>& data, const uint32_t value)
+    {
+        data.push_back((uint8_t)(value >> 24));
+        data.push_back((uint8_t)(value >> 16));
+        data.push_back((uint8_t)(value >> 8));
+        data.push_back((uint8_t)value);
+    }
+
+    void writeChunk(std::vector<uint8_t>& data, const char* type, const uint8_t* chunkData, const size_t size)
+    {
+        writeBigEndian(data, (uint32_t)size);
+
+        const size_t begin = data.size();
+        data.insert(data.end(), type, type + 4);
+        data.insert(data.end(), chunkData, chunkData + size);
+
+        writeBigEndian(data, computeCrc32(data.data() + begin, data.size() - begin));
+    }
+}
+
+void PngWriter::encode(const uint8_t* pixels, const size_t width, const size_t height, const size_t rowPitch, std::vector<uint8_t>& data)
+{
+    const size_t rowSize = width * 4;
+    const size_t filteredRowSize = rowSize + 1;
+
+    std::vector<uint8_t> filtered(filteredRowSize * height);
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, height), [&](const tbb::blocked_range<size_t>& range)
+    {
+        for (size_t y = range.begin(); y < range.end(); y++)
+            filterRow(pixels + y * rowPitch, y > 0 ? pixels + (y - 1) * rowPitch : nullptr, rowSize, filtered.data() + y * filteredRowSize);
+    });
+
+    // Matches never reach across chunks, which costs a little compression for being able to deflate them in parallel
+    const size_t rowsPerChunk = std::max<size_t>(1, CHUNK_SIZE / filteredRowSize);
+    const size_t chunkCount = (height + rowsPerChunk - 1) / rowsPerChunk;
+
+    std::vector<std::vector<uint8_t>> chunks(std::max<size_t>(1, chunkCount));
+
+    tbb::parallel_for((size_t)0, chunkCount, [&](const size_t i)
+    {
+        const size_t begin = i * rowsPerChunk * filteredRowSize;
+        const size_t end = std::min(filtered.size(), begin + rowsPerChunk * filteredRowSize);
+
+        deflateChunk(filtered.data() + begin, end - begin, i == chunkCount - 1, chunks[i]);
+    });
+
+    if (chunkCount == 0)
+        deflateChunk(nullptr, 0, true, chunks[0]);
+
+    std::vector<uint8_t> zlibData = { 0x78, 0x01 };
+
+    for (auto& chunk : chunks)
+        zlibData.insert(zlibData.end(), chunk.begin(), chunk.end());
+
+    writeBigEndian(zlibData, computeAdler32(filtered.data(), filtered.size()));
+
+    data.clear();
+    data.reserve(zlibData.size() + 64);
+
+    const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    data.insert(data.end(), std::begin(signature), std::end(signature));
+
+    std::vector<uint8_t> header;
+    writeBigEndian(header, (uint32_t)width);
+    writeBigEndian(header, (uint32_t)height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8-bit RGBA, deflate, adaptive filtering, no interlacing
+
+    writeChunk(data, "IHDR", header.data(), header.size());
+    writeChunk(data, "IDAT", zlibData.data(), zlibData.size());
+    writeChunk(data, "IEND", nullptr, 0);
+}
+
+bool PngWriter::save(const std::string& filePath, const uint8_t* pixels, const size_t width, const size_t height, const size_t rowPitch)
+{
+    std::vector<uint8_t> data;
+    encode(pixels, width, height, rowPitch, data);
+
+    const FileStream file(filePath.c_str(), "wb");
+    if (!file.isOpen())
+        return false;
+
+    return file.write(data.data(), data.size()) && file.flush();
+}
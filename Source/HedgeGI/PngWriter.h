@@ -0,0 +1,11 @@
+﻿#pragma once
+
+// Encodes 8-bit RGBA images as PNG without going through WIC. Rows are filtered in parallel and the filtered
+// data is split into chunks that get deflated independently, each chunk ends byte aligned so they can simply
+// be concatenated into a single zlib stream.
+class PngWriter
+{
+public:
+    static void encode(const uint8_t* pixels, size_t width, size_t height, size_t rowPitch, std::vector<uint8_t>& data);
+    static bool save(const std::string& filePath, const uint8_t* pixels, size_t width, size_t height, size_t rowPitch);
+};
@@ -1,8 +1,8 @@
 ﻿#include "PostRender.h"
 
 #include "BakeParams.h"
+#include "BlockCompressor.h"
 #include "CabinetCompression.h"
-#include "D3D11Device.h"
 #include "Game.h"
 #include "Logger.h"
 #include "Utilities.h"
@@ -206,7 +206,7 @@ void PostRender::createAtlasesRecursively(std::list<Texture>& textures, std::vec
 }
 
 hl::archive PostRender::createArchive(const std::string& inputDirectoryPath, TargetEngine targetEngine,
-    hl::hh::mirage::raw_gi_texture_group* group, hl::hh::mirage::raw_gi_texture_group_info_v2* groupInfo, bool preferBC7)
+    hl::hh::mirage::raw_gi_texture_group* group, hl::hh::mirage::raw_gi_texture_group_info_v2* groupInfo, bool preferBC7, BlockCompressionQuality quality)
 {
     const std::string levelSuffix = "-level" + std::to_string(group->level);
 
@@ -451,71 +451,52 @@ hl::archive PostRender::createArchive(const std::string& inputDirectoryPath, Tar
         {
             std::unique_ptr<DirectX::ScratchImage> tmpImage = std::make_unique<DirectX::ScratchImage>();
 
-            DirectX::GenerateMipMaps(
+            if (FAILED(DirectX::GenerateMipMaps(
                 atlasImage->GetImages(),
                 atlasImage->GetImageCount(),
                 atlasImage->GetMetadata(),
                 DirectX::TEX_FILTER_BOX | DirectX::TEX_FILTER_FORCE_NON_WIC | DirectX::TEX_FILTER_SEPARATE_ALPHA,
                 0,
-                *tmpImage);
-
-            atlasImage.swap(tmpImage);
-        }
-
-        if (targetEngine == TargetEngine::HE2 && !isBc4)
-        {
-            std::unique_ptr<DirectX::ScratchImage> tmpImage = std::make_unique<DirectX::ScratchImage>();
+                *tmpImage)))
             {
-                const auto lock = D3D11Device::lock();
-
-                DirectX::Compress(
-                    D3D11Device::get(),
-                    atlasImage->GetImages(),
-                    atlasImage->GetImageCount(),
-                    atlasImage->GetMetadata(),
-                    DXGI_FORMAT_BC6H_UF16,
-                    DirectX::TEX_COMPRESS_PARALLEL,
-                    DirectX::TEX_THRESHOLD_DEFAULT,
-                    *tmpImage);
+                Logger::logFormatted(LogType::Error, "Failed to generate mipmaps for an atlas of %lld textures", (long long)atlas.textures.size());
+                atlas.textures.clear();
+                return;
             }
 
             atlasImage.swap(tmpImage);
         }
 
-        else
         {
+            DXGI_FORMAT format;
+
+            if (isBc4)
+                format = DXGI_FORMAT_BC4_UNORM;
+            else if (targetEngine == TargetEngine::HE2)
+                format = DXGI_FORMAT_BC6H_UF16;
+            else if (preferBC7)
+                format = DXGI_FORMAT_BC7_UNORM;
+            else
+                format = DXGI_FORMAT_BC3_UNORM;
+
             std::unique_ptr<DirectX::ScratchImage> tmpImage = std::make_unique<DirectX::ScratchImage>();
 
-            if (!isBc4 && preferBC7)
-            {
-                const auto lock = D3D11Device::lock();
-
-                DirectX::Compress(
-                    D3D11Device::get(),
-                    atlasImage->GetImages(),
-                    atlasImage->GetImageCount(),
-                    atlasImage->GetMetadata(),
-                    DXGI_FORMAT_BC7_UNORM,
-                    DirectX::TEX_COMPRESS_PARALLEL,
-                    DirectX::TEX_THRESHOLD_DEFAULT,
-                    *tmpImage);
-            }
-            else
+            if (!BlockCompressor::compress(
+                atlasImage->GetImages(),
+                atlasImage->GetImageCount(),
+                atlasImage->GetMetadata(),
+                format,
+                *tmpImage,
+                quality))
             {
-                DirectX::Compress(
-                    atlasImage->GetImages(),
-                    atlasImage->GetImageCount(),
-                    atlasImage->GetMetadata(),
-                    isBc4 ? DXGI_FORMAT_BC4_UNORM : DXGI_FORMAT_BC3_UNORM,
-                    DirectX::TEX_COMPRESS_PARALLEL,
-                    DirectX::TEX_THRESHOLD_DEFAULT,
-                    *tmpImage);
+                Logger::logFormatted(LogType::Error, "Failed to compress an atlas of %lld textures", (long long)atlas.textures.size());
+                atlas.textures.clear();
+                return;
             }
 
             atlasImage.swap(tmpImage);
         }
 
-
         DirectX::Blob blob;
         DirectX::SaveToDDSMemory(atlasImage->GetImages(), atlasImage->GetImageCount(), atlasImage->GetMetadata(), DirectX::DDS_FLAGS_NONE, blob);
 
@@ -544,8 +525,8 @@ hl::archive PostRender::createArchive(const std::string& inputDirectoryPath, Tar
 
     auto addAtlas = [&](const Atlas& atlas)
     {
-        // Skip this atlas if it has only one texture
-        if (atlas.textures.size() == 1 && targetEngine == TargetEngine::HE1) 
+        // Skip this atlas if it has only one texture, or none left after failing to compress
+        if (atlas.textures.empty() || (atlas.textures.size() == 1 && targetEngine == TargetEngine::HE1))
             return;
 
         hl::hh::mirage::atlas hhAtlas;
@@ -586,7 +567,8 @@ std::vector<PostRender::Atlas> PostRender::createAtlases(std::list<Texture>& tex
     return atlases;
 }
 
-void PostRender::process(const std::string& stageDirectoryPath, const std::string& inputDirectoryPath, Game game, TargetEngine targetEngine, bool preferBC7)
+void PostRender::process(const std::string& stageDirectoryPath, const std::string& inputDirectoryPath, Game game, TargetEngine targetEngine, 
+    bool preferBC7, BlockCompressionQuality quality)
 {
     const std::string stageName = getFileName(stageDirectoryPath);
 
@@ -672,7 +654,7 @@ void PostRender::process(const std::string& stageDirectoryPath, const std::strin
 
             hl::u32 memorySize = 0;
             {
-                const hl::archive archive = createArchive(inputDirectoryPath, targetEngine, group.get(), groupInfo, preferBC7);
+                const hl::archive archive = createArchive(inputDirectoryPath, targetEngine, group.get(), groupInfo, preferBC7, quality);
 
                 for (auto& entry : archive)
                     memorySize += (hl::u32)entry.size();
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+enum class BlockCompressionQuality;
 enum class Game;
 enum class TargetEngine;
 
@@ -32,7 +33,8 @@ public:
     static std::vector<Atlas> createAtlases(std::list<Texture>& textures);
 
     static hl::archive createArchive(const std::string& inputDirectoryPath, TargetEngine targetEngine,
-        hl::hh::mirage::raw_gi_texture_group* group, hl::hh::mirage::raw_gi_texture_group_info_v2* groupInfo, bool preferBC7);
+        hl::hh::mirage::raw_gi_texture_group* group, hl::hh::mirage::raw_gi_texture_group_info_v2* groupInfo, bool preferBC7, BlockCompressionQuality quality);
 
-    static void process(const std::string& stageDirectoryPath, const std::string& inputDirectoryPath, Game game, TargetEngine targetEngine, bool preferBC7);
+    static void process(const std::string& stageDirectoryPath, const std::string& inputDirectoryPath, Game game, TargetEngine targetEngine, 
+        bool preferBC7, BlockCompressionQuality quality);
 };
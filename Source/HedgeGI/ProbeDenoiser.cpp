@@ -0,0 +1,166 @@
+﻿#include "ProbeDenoiser.h"
+
+#include "Utilities.h"
+
+namespace
+{
+    constexpr float NORMAL_SHARPNESS = 8.0f;
+    constexpr float COLOR_SIGMA = 0.5f;
+
+    struct Cell
+    {
+        int32_t x;
+        int32_t y;
+        int32_t z;
+    };
+
+    Cell getCell(const Vector3& position, const float cellScale)
+    {
+        return
+        {
+            (int32_t)floorf(position.x() * cellScale),
+            (int32_t)floorf(position.y() * cellScale),
+            (int32_t)floorf(position.z() * cellScale)
+        };
+    }
+
+    uint64_t makeCellKey(const int32_t x, const int32_t y, const int32_t z)
+    {
+        return ((uint64_t)(x & 0x1FFFFF) << 42) | ((uint64_t)(y & 0x1FFFFF) << 21) | (uint64_t)(z & 0x1FFFFF);
+    }
+}
+
+void ProbeDenoiser::createGraph(const RaytracingContext& raytracingContext, const Vector3* positions, const Vector3* normals, 
+    const size_t count, const float radius, Graph& graph, BakeProgress* progress)
+{
+    graph.neighbors.resize(count * MAX_NEIGHBOR_COUNT);
+    graph.weights.resize(count * MAX_NEIGHBOR_COUNT);
+    graph.counts.assign(count, 0);
+
+    if (count == 0 || radius <= 0.0f)
+        return;
+
+    // Bucket probes into cells as big as the radius, every neighbor then lies in one of the surrounding 27 cells
+    const float cellScale = 1.0f / radius;
+
+    std::vector<std::pair<uint64_t, uint32_t>> keys(count);
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const tbb::blocked_range<size_t> range)
+    {
+        for (size_t i = range.begin(); i < range.end(); i++)
+        {
+            const Cell cell = getCell(positions[i], cellScale);
+            keys[i] = std::make_pair(makeCellKey(cell.x, cell.y, cell.z), (uint32_t)i);
+        }
+    });
+
+    tbb::parallel_sort(keys.begin(), keys.end());
+
+    phmap::flat_hash_map<uint64_t, std::pair<uint32_t, uint32_t>> cells;
+
+    for (uint32_t i = 0; i < (uint32_t)count;)
+    {
+        uint32_t end = i + 1;
+        while (end < (uint32_t)count && keys[end].first == keys[i].first)
+            end++;
+
+        cells.emplace(keys[i].first, std::make_pair(i, end));
+        i = end;
+    }
+
+    const float radiusSquared = radius * radius;
+
+    // Gaussian falloff reaching two standard deviations at the radius
+    const float distanceScale = 2.0f / radiusSquared;
+
+    BakeProgress::Context taskContext(progress);
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const tbb::blocked_range<size_t> range)
+    {
+        std::vector<std::pair<float, uint32_t>> candidates;
+
+        for (size_t r = range.begin(); r < range.end(); r++)
+        {
+            if (progress != nullptr && progress->isCancelled())
+                return;
+
+            const Vector3& position = positions[r];
+            const Vector3& normal = normals[r];
+            const Cell cell = getCell(position, cellScale);
+
+            candidates.clear();
+
+            for (int32_t z = cell.z - 1; z <= cell.z + 1; z++)
+            {
+                for (int32_t y = cell.y - 1; y <= cell.y + 1; y++)
+                {
+                    for (int32_t x = cell.x - 1; x <= cell.x + 1; x++)
+                    {
+                        const auto pair = cells.find(makeCellKey(x, y, z));
+                        if (pair == cells.end())
+                            continue;
+
+                        for (uint32_t i = pair->second.first; i < pair->second.second; i++)
+                        {
+                            const uint32_t index = keys[i].second;
+                            if (index == r)
+                                continue;
+
+                            const float distanceSquared = (positions[index] - position).squaredNorm();
+                            if (distanceSquared <= radiusSquared)
+                                candidates.emplace_back(distanceSquared, index);
+                        }
+                    }
+                }
+            }
+
+            std::sort(candidates.begin(), candidates.end());
+
+            uint32_t* neighbors = &graph.neighbors[r * MAX_NEIGHBOR_COUNT];
+            float* weights = &graph.weights[r * MAX_NEIGHBOR_COUNT];
+            size_t neighborCount = 0;
+
+            for (auto& candidate : candidates)
+            {
+                if (neighborCount == MAX_NEIGHBOR_COUNT)
+                    break;
+
+                const Vector3& samplePosition = positions[candidate.second];
+
+                const float cosTheta = normal.dot(normals[candidate.second]);
+                if (cosTheta <= 0.0f)
+                    continue;
+
+                // Probes on the other side of a wall see entirely different lighting
+                const float distance = sqrtf(candidate.first);
+                if (distance > 0.0f)
+                {
+                    RTCRay ray {};
+
+                    setRayOrigin(ray, position, 0.0f);
+                    setRayDirection(ray, (samplePosition - position) / distance);
+                    ray.tfar = distance;
+                    ray.mask = RAY_MASK_OPAQUE;
+
+                    rtcOccluded1(raytracingContext.rtcScene, &ray);
+
+                    if (ray.tfar < 0)
+                        continue;
+                }
+
+                neighbors[neighborCount] = candidate.second;
+                weights[neighborCount] = std::exp(-candidate.first * distanceScale) * std::pow(cosTheta, NORMAL_SHARPNESS);
+                neighborCount++;
+            }
+
+            graph.counts[r] = (uint8_t)neighborCount;
+        }
+    }, taskContext.get());
+}
+
+float ProbeDenoiser::computeColorWeight(const Color3& center, const Color3& sample, const size_t pass)
+{
+    // Relative distance so bright and dark probes get filtered alike, tightened with every pass
+    const float colorDistance = (sample - center).square().sum() / (center.square().sum() + sample.square().sum() + 1e-4f);
+    return std::exp(-colorDistance * (float)(1 << pass) / COLOR_SIGMA);
+}
@@ -0,0 +1,106 @@
+﻿#pragma once
+
+#include "BakeProgress.h"
+#include "BitmapPool.h"
+#include "Scene.h"
+
+// Filters baked probes against each other in world space instead of as image texels. Every probe blends with
+// the closest probes it can see, weighted by distance and normal similarity, one basis direction at a time.
+class ProbeDenoiser
+{
+public:
+    static constexpr size_t MAX_NEIGHBOR_COUNT = 16;
+    static constexpr size_t PASS_COUNT = 2;
+
+    // Neighbors of probe i are stored at i * MAX_NEIGHBOR_COUNT, along with their geometric weights.
+    struct Graph
+    {
+        std::vector<uint32_t> neighbors;
+        std::vector<float> weights;
+        std::vector<uint8_t> counts;
+    };
+
+    static void createGraph(const RaytracingContext& raytracingContext, const Vector3* positions, const Vector3* normals, 
+        size_t count, float radius, Graph& graph, BakeProgress* progress = nullptr);
+
+    static float computeColorWeight(const Color3& center, const Color3& sample, size_t pass);
+
+    template<typename TBakePoint>
+    static void process(const RaytracingContext& raytracingContext, BakePointArray<TBakePoint>& bakePoints, const float radius, BakeProgress* progress = nullptr)
+    {
+        constexpr size_t BASIS_COUNT = TBakePoint::BASIS_COUNT;
+
+        // Probes bake with a constant normal (meta instancer points face up, the others keep the default), which leaves the normal term neutral
+        std::vector<Vector3> positions(bakePoints.size());
+        std::vector<Vector3> normals(bakePoints.size());
+
+        for (size_t i = 0; i < bakePoints.size(); i++)
+        {
+            positions[i] = bakePoints[i].position;
+            normals[i] = bakePoints[i].normal;
+        }
+
+        Graph graph;
+        createGraph(raytracingContext, positions.data(), normals.data(), bakePoints.size(), radius, graph, progress);
+
+        std::vector<Color3> colors(bakePoints.size() * BASIS_COUNT);
+        std::vector<float> shadows(bakePoints.size());
+
+        BakeProgress::Context taskContext(progress);
+
+        for (size_t pass = 0; pass < PASS_COUNT; pass++)
+        {
+            if (progress != nullptr && progress->isCancelled())
+                return;
+
+            for (size_t i = 0; i < bakePoints.size(); i++)
+            {
+                std::copy(bakePoints[i].colors, bakePoints[i].colors + BASIS_COUNT, &colors[i * BASIS_COUNT]);
+                shadows[i] = bakePoints[i].shadow;
+            }
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, bakePoints.size()), [&](const tbb::blocked_range<size_t> range)
+            {
+                for (size_t r = range.begin(); r < range.end(); r++)
+                {
+                    const uint32_t* neighbors = &graph.neighbors[r * MAX_NEIGHBOR_COUNT];
+                    const float* weights = &graph.weights[r * MAX_NEIGHBOR_COUNT];
+                    const size_t neighborCount = graph.counts[r];
+
+                    auto& bakePoint = bakePoints[r];
+
+                    // Each basis direction is filtered on its own so light arriving from one side never leaks into another
+                    for (size_t i = 0; i < BASIS_COUNT; i++)
+                    {
+                        const Color3& center = colors[r * BASIS_COUNT + i];
+
+                        Color3 colorSum = center;
+                        float weightSum = 1.0f;
+
+                        for (size_t j = 0; j < neighborCount; j++)
+                        {
+                            const Color3& sample = colors[neighbors[j] * BASIS_COUNT + i];
+                            const float weight = weights[j] * computeColorWeight(center, sample, pass);
+
+                            colorSum += sample * weight;
+                            weightSum += weight;
+                        }
+
+                        bakePoint.colors[i] = colorSum / weightSum;
+                    }
+
+                    float shadowSum = shadows[r];
+                    float weightSum = 1.0f;
+
+                    for (size_t i = 0; i < neighborCount; i++)
+                    {
+                        shadowSum += shadows[neighbors[i]] * weights[i];
+                        weightSum += weights[i];
+                    }
+
+                    bakePoint.shadow = shadowSum / weightSum;
+                }
+            }, taskContext.get());
+        }
+    }
+};
@@ -1,21 +1,29 @@
 ﻿#pragma once
 
-class alignas(std::hardware_destructive_interference_size) Random
+// Counter based generator, every value is a hash of the stream key and the amount of values drawn before it.
+// Keying streams by instance, texel and sample makes bakes identical no matter which thread ends up running them.
+class Random
 {
-    std::default_random_engine engine;
-    std::uniform_real_distribution<float> distribution;
+    uint64_t key;
+    uint32_t dimension{};
 
-    Random() : engine(std::random_device {}()), distribution(0, 1) {}
+    static uint64_t mix(uint64_t value)
+    {
+        // splitmix64 finalizer
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
 
 public:
-    float next() 
+    Random(const uint64_t seed, const uint64_t index = 0, const uint64_t sample = 0)
+        : key(mix(mix(mix(seed) ^ index) ^ sample))
     {
-        return distribution(engine);
     }
 
-    static Random& get()
+    float next()
     {
-        thread_local Random random;
-        return random;
+        // Top 24 bits, exactly representable and never reaches 1
+        return (float)(mix(key + 0x9E3779B97F4A7C15ull * ++dimension) >> 40) * (1.0f / 16777216.0f);
     }
 };
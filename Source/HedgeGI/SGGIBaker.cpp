@@ -4,6 +4,7 @@
 #include "BakingFactory.h"
 #include "BitmapHelper.h"
 #include "Math.h"
+#include "SampleAccumulator.h"
 
 const std::array<Vector3, 4> SG_DIRECTIONS =
 {
@@ -46,15 +47,42 @@ struct SGGIPoint : BakePoint<4, BAKE_POINT_FLAGS_ALL>
     }
 };
 
-GIPair SGGIBaker::bake(const RaytracingContext& context, const Instance& instance, const uint16_t size, const BakeParams& bakeParams)
+size_t SGGIBaker::estimateMemory(const uint16_t size, const GIBakeStage stage, const DenoiserType denoiserType)
 {
-    std::vector<SGGIPoint> bakePoints = createBakePoints<SGGIPoint>(context, instance, size);
+    return GIBaker::estimateMemory(size, stage, denoiserType, sizeof(SGGIPoint), SGGIPoint::BASIS_COUNT);
+}
+
+GIPair SGGIBaker::bake(const RaytracingContext& context, const Instance& instance, const uint16_t size, const BakeParams& bakeParams, BakeProgress* progress)
+{
+    const std::unique_ptr<CoverageMap> coverageMap = CoverageMap::create(instance, size);
+    return bake(context, instance, *coverageMap, bakeParams, progress);
+}
+
+GIPair SGGIBaker::bake(const RaytracingContext& context, const Instance& instance, CoverageMap& coverageMap, const BakeParams& bakeParams,
+    BakeProgress* progress, SampleAccumulator* accumulator)
+{
+    BakePointArray<SGGIPoint> bakePoints = createBakePoints<SGGIPoint>(instance, coverageMap, progress);
     
-    BakingFactory::bake(context, bakePoints, bakeParams);
+    // Every accumulated session needs fresh samples
+    uint64_t seed = hashData(instance.name.data(), instance.name.size());
+    if (accumulator != nullptr)
+        seed = hashValue(accumulator->getSeedOffset(), seed);
+
+    std::vector<Vector2> luminanceMoments;
+    BakingFactory::bake(context, bakePoints, bakeParams, progress, accumulator != nullptr ? &luminanceMoments : nullptr, seed);
+
+    if (accumulator != nullptr && (progress == nullptr || !progress->isCancelled()))
+    {
+        accumulator->initialize(SGGIPoint::BASIS_COUNT, coverageMap.size);
+        accumulator->accumulate(bakePoints, luminanceMoments, bakeParams);
+        accumulator->resolve(bakePoints);
+    }
+
+    coverageMap.discard(bakePoints);
     
     return
     {
-        BitmapHelper::createAndPaint(bakePoints, size, size, PAINT_FLAGS_COLOR),
-        BitmapHelper::createAndPaint(bakePoints, size, size, PAINT_FLAGS_SHADOW)
+        BitmapHelper::createAndPaint(bakePoints, coverageMap.size, coverageMap.size, PAINT_FLAGS_COLOR),
+        BitmapHelper::createAndPaint(bakePoints, coverageMap.size, coverageMap.size, PAINT_FLAGS_SHADOW, BitmapFormat::R16F)
     };
 }
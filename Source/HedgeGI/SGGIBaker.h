@@ -2,7 +2,10 @@
 
 #include "GIBaker.h"
 
+class BakeProgress;
+class CoverageMap;
 class Instance;
+class SampleAccumulator;
 class Scene;
 
 struct BakeParams;
@@ -14,5 +17,10 @@ public:
     static const DXGI_FORMAT LIGHT_MAP_FORMAT = DXGI_FORMAT_BC6H_UF16;
     static const DXGI_FORMAT SHADOW_MAP_FORMAT = DXGI_FORMAT_BC4_UNORM;
 
-    static GIPair bake(const RaytracingContext& context, const Instance& instance, uint16_t size, const BakeParams& bakeParams);
+    static size_t estimateMemory(uint16_t size, GIBakeStage stage, DenoiserType denoiserType);
+
+    static GIPair bake(const RaytracingContext& context, const Instance& instance, uint16_t size, const BakeParams& bakeParams, BakeProgress* progress = nullptr);
+    // Adds the samples to the accumulator if one is given and paints what it accumulated across sessions.
+    static GIPair bake(const RaytracingContext& context, const Instance& instance, CoverageMap& coverageMap, const BakeParams& bakeParams,
+        BakeProgress* progress = nullptr, SampleAccumulator* accumulator = nullptr);
 };
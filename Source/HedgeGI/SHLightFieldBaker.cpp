@@ -4,6 +4,7 @@
 #include "BakingFactory.h"
 #include "Bitmap.h"
 #include "Math.h"
+#include "ProbeDenoiser.h"
 #include "SHLightField.h"
 #include "SnapToClosestTriangle.h"
 
@@ -55,9 +56,9 @@ struct SHLightFieldPoint : BakePoint<6, BAKE_POINT_FLAGS_SHADOW | BAKE_POINT_FLA
     }
 };
 
-std::vector<SHLightFieldPoint> SHLightFieldBaker::createBakePoints(const RaytracingContext& raytracingContext, const SHLightField& shlf)
+BakePointArray<SHLightFieldPoint> SHLightFieldBaker::createBakePoints(const RaytracingContext& raytracingContext, const SHLightField& shlf, BakeProgress* progress)
 {
-    std::vector<SHLightFieldPoint> bakePoints;
+    BakePointArray<SHLightFieldPoint> bakePoints;
     bakePoints.reserve(shlf.resolution.x() * shlf.resolution.y() * shlf.resolution.z());
 
     const Matrix4 matrix = shlf.getMatrix();
@@ -86,14 +87,14 @@ std::vector<SHLightFieldPoint> SHLightFieldBaker::createBakePoints(const Raytrac
     }
 
     SnapToClosestTriangle::process(raytracingContext, bakePoints, 
-        (shlf.scale.array() / shlf.resolution.cast<float>()).maxCoeff() / 10.0f * sqrtf(2.0f) / 2.0f);
+        (shlf.scale.array() / shlf.resolution.cast<float>()).maxCoeff() / 10.0f * sqrtf(2.0f) / 2.0f, progress);
 
     return bakePoints;
 }
 
-std::unique_ptr<Bitmap> SHLightFieldBaker::paint(const std::vector<SHLightFieldPoint>& bakePoints, const SHLightField& shlf)
+std::unique_ptr<Bitmap> SHLightFieldBaker::paint(const BakePointArray<SHLightFieldPoint>& bakePoints, const SHLightField& shlf)
 {
-    std::unique_ptr<Bitmap> bitmap = std::make_unique<Bitmap>(shlf.resolution.x() * 9, shlf.resolution.y(), shlf.resolution.z(), BITMAP_TYPE_3D);
+    std::unique_ptr<Bitmap> bitmap = std::make_unique<Bitmap>(shlf.resolution.x() * 9, shlf.resolution.y(), shlf.resolution.z(), BITMAP_TYPE_3D, BitmapFormat::RGBA16F);
 
     for (auto& bakePoint : bakePoints)
     {
@@ -110,11 +111,15 @@ std::unique_ptr<Bitmap> SHLightFieldBaker::paint(const std::vector<SHLightFieldP
     return bitmap;
 }
 
-std::unique_ptr<Bitmap> SHLightFieldBaker::bake(const RaytracingContext& context, const SHLightField& shlf, const BakeParams& bakeParams)
+std::unique_ptr<Bitmap> SHLightFieldBaker::bake(const RaytracingContext& context, const SHLightField& shlf, const BakeParams& bakeParams, BakeProgress* progress)
 {
-    std::vector<SHLightFieldPoint> bakePoints = createBakePoints(context, shlf);
+    BakePointArray<SHLightFieldPoint> bakePoints = createBakePoints(context, shlf, progress);
 
-    BakingFactory::bake(context, bakePoints, bakeParams);
+    BakingFactory::bake(context, bakePoints, bakeParams, progress, nullptr, hashData(shlf.name.data(), shlf.name.size()));
+
+    // Reach the diagonal neighbors of the grid
+    if (bakeParams.getDenoiserType() != DenoiserType::None)
+        ProbeDenoiser::process(context, bakePoints, (shlf.scale.array() / shlf.resolution.cast<float>()).maxCoeff() / 10.0f * 1.8f, progress);
 
     return paint(bakePoints, shlf);
 }
@@ -1,7 +1,10 @@
 ﻿#pragma once
 
-class Scene;
+#include "BitmapPool.h"
+
+class BakeProgress;
 class Bitmap;
+class Scene;
 class SHLightField;
 
 struct BakeParams;
@@ -10,9 +13,9 @@ struct SHLightFieldPoint;
 
 class SHLightFieldBaker
 {
-    static std::vector<SHLightFieldPoint> createBakePoints(const RaytracingContext& raytracingContext, const SHLightField& shlf);
-    static std::unique_ptr<Bitmap> paint(const std::vector<SHLightFieldPoint>& bakePoints, const SHLightField& shlf);
+    static BakePointArray<SHLightFieldPoint> createBakePoints(const RaytracingContext& raytracingContext, const SHLightField& shlf, BakeProgress* progress);
+    static std::unique_ptr<Bitmap> paint(const BakePointArray<SHLightFieldPoint>& bakePoints, const SHLightField& shlf);
 
 public:
-    static std::unique_ptr<Bitmap> bake(const RaytracingContext& context, const SHLightField& shlf, const BakeParams& bakeParams);
+    static std::unique_ptr<Bitmap> bake(const RaytracingContext& context, const SHLightField& shlf, const BakeParams& bakeParams, BakeProgress* progress = nullptr);
 };
@@ -0,0 +1,173 @@
+﻿#include "SampleAccumulator.h"
+
+#include "FileStream.h"
+
+namespace
+{
+    constexpr uint32_t SAMPLE_ACCUMULATOR_SIGNATURE = 0x4D434341; // ACCM
+    constexpr uint32_t SAMPLE_ACCUMULATOR_VERSION = 1;
+}
+
+size_t SampleAccumulator::estimateMemory(const uint16_t size, const uint32_t basisCount)
+{
+    return (size_t)size * size * (sizeof(Color3) * basisCount + sizeof(Texel));
+}
+
+std::string SampleAccumulator::getFilePath(const std::string& cacheDirectoryPath, const std::string& name, const uint64_t hash)
+{
+    char fileName[1024];
+    sprintf(fileName, "%s/%s_%016llx.accm", cacheDirectoryPath.c_str(), name.c_str(), (unsigned long long)hash);
+
+    return fileName;
+}
+
+bool SampleAccumulator::readNoise(const std::string& filePath, const uint64_t hash, float& noise)
+{
+    const FileStream file(filePath.c_str(), "rb");
+    if (!file.isOpen())
+        return false;
+
+    if (file.read<uint32_t>() != SAMPLE_ACCUMULATOR_SIGNATURE || file.read<uint32_t>() != SAMPLE_ACCUMULATOR_VERSION || file.read<uint64_t>() != hash)
+        return false;
+
+    file.read<uint32_t>(); // Basis count
+    file.read<uint32_t>(); // Session count
+    noise = file.read<float>();
+
+    return true;
+}
+
+void SampleAccumulator::initialize(const uint32_t basisCount, const uint16_t size)
+{
+    if (this->basisCount == basisCount && this->size == size)
+        return;
+
+    this->basisCount = basisCount;
+    this->size = size;
+
+    sessionCount = 0;
+    noise = 0.0f;
+
+    colorSums.assign((size_t)size * size * basisCount, Color3::Zero());
+    texels.assign((size_t)size * size, {});
+}
+
+uint32_t SampleAccumulator::getSeedOffset() const
+{
+    return sessionCount;
+}
+
+float SampleAccumulator::computeNoise() const
+{
+    double sum = 0.0;
+    size_t count = 0;
+
+    for (auto& texel : texels)
+    {
+        if (texel.sampleCount == 0)
+            continue;
+
+        const float mean = texel.luminanceSum / (float)texel.sampleCount;
+        const float variance = std::max(0.0f, texel.luminanceSquareSum / (float)texel.sampleCount - mean * mean);
+
+        sum += sqrtf(variance / (float)texel.sampleCount) / std::max(mean, 0.001f);
+        ++count;
+    }
+
+    return count > 0 ? (float)(sum / (double)count) : 0.0f;
+}
+
+bool SampleAccumulator::load(const std::string& filePath, const uint64_t hash)
+{
+    const FileStream file(filePath.c_str(), "rb");
+    if (!file.isOpen())
+        return false;
+
+    if (file.read<uint32_t>() != SAMPLE_ACCUMULATOR_SIGNATURE || file.read<uint32_t>() != SAMPLE_ACCUMULATOR_VERSION || file.read<uint64_t>() != hash)
+        return false;
+
+    // Validate every count against the file length before allocating, a truncated cache must not request gigabytes
+    const long position = file.tell();
+    file.seek(0, SEEK_END);
+    const size_t fileSize = (size_t)file.tell();
+    file.seek(position, SEEK_SET);
+
+    const auto readCount = [&](const size_t elementSize, uint32_t& count)
+    {
+        count = file.read<uint32_t>();
+        return (size_t)file.tell() + (size_t)count * elementSize <= fileSize;
+    };
+
+    const bool valid = [&]
+    {
+        basisCount = file.read<uint32_t>();
+        sessionCount = file.read<uint32_t>();
+        noise = file.read<float>();
+        size = file.read<uint16_t>();
+        file.align();
+
+        uint32_t count;
+
+        if (!readCount(sizeof(Color3), count) || count != (size_t)size * size * basisCount)
+            return false;
+
+        colorSums.resize(count);
+        if (!file.read(colorSums.data(), colorSums.size()))
+            return false;
+
+        if (!readCount(sizeof(Texel), count) || count != (size_t)size * size)
+            return false;
+
+        texels.resize(count);
+        return file.read(texels.data(), texels.size());
+    }();
+
+    // Half loaded sums would otherwise be picked up by initialize() as if they matched the bake
+    if (!valid)
+        *this = SampleAccumulator();
+
+    return valid;
+}
+
+bool SampleAccumulator::save(const std::string& filePath, const uint64_t hash) const
+{
+    // Earlier sessions are only replaced once the new file is complete, a crash in between leaves them intact
+    const std::string temporaryFilePath = filePath + ".tmp";
+    bool written;
+    {
+        const FileStream file(temporaryFilePath.c_str(), "wb");
+        if (!file.isOpen())
+            return false;
+
+        file.write(SAMPLE_ACCUMULATOR_SIGNATURE);
+    file.write(SAMPLE_ACCUMULATOR_VERSION);
+        file.write(hash);
+        file.write(basisCount);
+        file.write(sessionCount);
+        file.write(noise);
+        file.write(size);
+        file.align();
+
+        file.write((uint32_t)colorSums.size());
+        written = file.write(colorSums.data(), colorSums.size());
+
+        file.write((uint32_t)texels.size());
+        written &= file.write(texels.data(), texels.size());
+
+        file.flush();
+    }
+
+    WCHAR wideCharFilePath[MAX_PATH];
+    WCHAR wideCharTemporaryFilePath[MAX_PATH];
+
+    MultiByteToWideChar(CP_UTF8, NULL, filePath.c_str(), -1, wideCharFilePath, MAX_PATH);
+    MultiByteToWideChar(CP_UTF8, NULL, temporaryFilePath.c_str(), -1, wideCharTemporaryFilePath, MAX_PATH);
+
+    if (!written || !MoveFileExW(wideCharTemporaryFilePath, wideCharFilePath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        DeleteFileW(wideCharTemporaryFilePath);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include "BakeParams.h"
+#include "BitmapPool.h"
+
+// Raw per-texel results of every session an instance got baked in, so that later bakes can add samples
+// to them instead of starting over. Sums are weighted by the amount of samples each session took.
+class SampleAccumulator
+{
+public:
+    struct Texel
+    {
+        float shadowSum{};
+        uint32_t sampleCount{};
+        uint32_t shadowSampleCount{};
+        float luminanceSum{};
+        float luminanceSquareSum{};
+    };
+
+    uint32_t basisCount{};
+    uint16_t size{};
+    uint32_t sessionCount{};
+    float noise{};
+    std::vector<Color3> colorSums;
+    std::vector<Texel> texels;
+
+    static size_t estimateMemory(uint16_t size, uint32_t basisCount);
+
+    static std::string getFilePath(const std::string& cacheDirectoryPath, const std::string& name, uint64_t hash);
+
+    // Reads only the header, used to decide whether an instance needs more samples.
+    static bool readNoise(const std::string& filePath, uint64_t hash, float& noise);
+
+    void initialize(uint32_t basisCount, uint16_t size);
+
+    // Added to the seeds of the next session so that it doesn't repeat the samples of earlier ones.
+    uint32_t getSeedOffset() const;
+
+    // Luminance moments hold the mean luminance and mean squared luminance of the samples of each bake point.
+    template<typename TBakePoint>
+    void accumulate(const BakePointArray<TBakePoint>& bakePoints, const std::vector<Vector2>& luminanceMoments, const BakeParams& bakeParams);
+
+    // Replaces the results of the bake points with the accumulated ones.
+    template<typename TBakePoint>
+    void resolve(BakePointArray<TBakePoint>& bakePoints) const;
+
+    // Average relative standard error of the luminance over every texel with samples.
+    float computeNoise() const;
+
+    // Leaves the accumulator empty if the file is missing, stale or damaged.
+    bool load(const std::string& filePath, uint64_t hash);
+
+    // Replaces the file only once the new one is completely written.
+    bool save(const std::string& filePath, uint64_t hash) const;
+};
+
+template <typename TBakePoint>
+void SampleAccumulator::accumulate(const BakePointArray<TBakePoint>& bakePoints, const std::vector<Vector2>& luminanceMoments, const BakeParams& bakeParams)
+{
+    assert(bakePoints.size() == texels.size() && luminanceMoments.size() == texels.size() && basisCount == TBakePoint::BASIS_COUNT);
+
+    const uint32_t sampleCount = bakeParams.light.sampleCount;
+    const uint32_t shadowSampleCount = std::max(1u, bakeParams.shadow.sampleCount);
+
+    for (size_t i = 0; i < bakePoints.size(); i++)
+    {
+        // Texels discarded by this session keep what earlier sessions accumulated
+        const TBakePoint& bakePoint = bakePoints[i];
+        if (!bakePoint.valid())
+            continue;
+
+        for (size_t j = 0; j < TBakePoint::BASIS_COUNT; j++)
+            colorSums[i * TBakePoint::BASIS_COUNT + j] += bakePoint.colors[j] * (float)sampleCount;
+
+        Texel& texel = texels[i];
+        texel.shadowSum += bakePoint.shadow * (float)shadowSampleCount;
+        texel.sampleCount += sampleCount;
+        texel.shadowSampleCount += shadowSampleCount;
+        texel.luminanceSum += luminanceMoments[i].x() * (float)sampleCount;
+        texel.luminanceSquareSum += luminanceMoments[i].y() * (float)sampleCount;
+    }
+
+    ++sessionCount;
+    noise = computeNoise();
+}
+
+template <typename TBakePoint>
+void SampleAccumulator::resolve(BakePointArray<TBakePoint>& bakePoints) const
+{
+    assert(bakePoints.size() == texels.size() && basisCount == TBakePoint::BASIS_COUNT);
+
+    for (size_t i = 0; i < bakePoints.size(); i++)
+    {
+        TBakePoint& bakePoint = bakePoints[i];
+        const Texel& texel = texels[i];
+
+        if (!bakePoint.valid() || texel.sampleCount == 0)
+            continue;
+
+        for (size_t j = 0; j < TBakePoint::BASIS_COUNT; j++)
+            bakePoint.colors[j] = colorSums[i * TBakePoint::BASIS_COUNT + j] / (float)texel.sampleCount;
+
+        bakePoint.shadow = texel.shadowSum / (float)texel.shadowSampleCount;
+    }
+}
@@ -14,6 +14,12 @@ Scene::~Scene()
 {
     if (rtcScene != nullptr)
         rtcReleaseScene(rtcScene);
+
+    for (auto& rtcSceneReplica : rtcSceneReplicas)
+    {
+        if (rtcSceneReplica != nullptr)
+            rtcReleaseScene(rtcSceneReplica);
+    }
 }
 
 const LightBVH& Scene::getLightBVH() const
@@ -29,12 +35,9 @@ void Scene::buildAABB()
         aabb.extend(instance->aabb);
 }
 
-RTCScene Scene::createRTCScene()
+RTCScene Scene::buildRTCScene() const
 {
-    if (rtcScene != nullptr)
-        return rtcScene;
-
-    rtcScene = rtcNewScene(RaytracingDevice::get());
+    const RTCScene scene = rtcNewScene(RaytracingDevice::get());
     for (size_t i = 0; i < meshes.size(); i++)
     {
         const auto& mesh = meshes[i];
@@ -44,18 +47,37 @@ RTCScene Scene::createRTCScene()
 
         const RTCGeometry rtcGeometry = mesh->createRTCGeometry();
 
-        rtcAttachGeometryByID(rtcScene, rtcGeometry, (uint32_t)i);
+        rtcAttachGeometryByID(scene, rtcGeometry, (uint32_t)i);
         rtcReleaseGeometry(rtcGeometry);
     }
 
-    rtcSetSceneBuildQuality(rtcScene, RTC_BUILD_QUALITY_HIGH);
-    rtcSetSceneFlags(rtcScene, RTC_SCENE_FLAG_COMPACT | RTC_SCENE_FLAG_FILTER_FUNCTION_IN_ARGUMENTS);
+    rtcSetSceneBuildQuality(scene, RTC_BUILD_QUALITY_HIGH);
+    rtcSetSceneFlags(scene, RTC_SCENE_FLAG_COMPACT | RTC_SCENE_FLAG_FILTER_FUNCTION_IN_ARGUMENTS);
+
+    rtcCommitScene(scene);
 
-    rtcCommitScene(rtcScene);
+    return scene;
+}
+
+RTCScene Scene::createRTCScene()
+{
+    if (rtcScene == nullptr)
+        rtcScene = buildRTCScene();
 
     return rtcScene;
 }
 
+RTCScene Scene::createRTCSceneReplica(const size_t index)
+{
+    if (index >= rtcSceneReplicas.size())
+        rtcSceneReplicas.resize(index + 1);
+
+    if (rtcSceneReplicas[index] == nullptr)
+        rtcSceneReplicas[index] = buildRTCScene();
+
+    return rtcSceneReplicas[index];
+}
+
 const LightBVH* Scene::createLightBVH(const bool force)
 {
     if ((force || !lightBVH.valid()) && !lights.empty())
@@ -69,6 +91,11 @@ RaytracingContext Scene::getRaytracingContext()
     return { this, createRTCScene(), createLightBVH() };
 }
 
+RaytracingContext Scene::getRaytracingContext(const size_t replicaIndex)
+{
+    return { this, createRTCSceneReplica(replicaIndex), createLightBVH() };
+}
+
 void Scene::sortAndUnify()
 {
     std::unordered_set<const Bitmap*> bitmapSet;
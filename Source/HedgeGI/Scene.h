@@ -28,8 +28,11 @@ struct RaytracingContext
 class Scene
 {
     RTCScene rtcScene {};
+    std::vector<RTCScene> rtcSceneReplicas;
     LightBVH lightBVH {};
 
+    RTCScene buildRTCScene() const;
+
 public:
     ~Scene();
 
@@ -52,8 +55,14 @@ public:
     void buildAABB();
 
     RTCScene createRTCScene();
+
+    // Separate copies of the Embree scene, eg. one per NUMA node. Build them from a thread running on the node
+    // so that the BVH gets allocated in its local memory. Geometry buffers are still shared with the original.
+    RTCScene createRTCSceneReplica(size_t index);
+
     const LightBVH* createLightBVH(bool force = false);
     RaytracingContext getRaytracingContext();
+    RaytracingContext getRaytracingContext(size_t replicaIndex);
 
     void sortAndUnify();
 };
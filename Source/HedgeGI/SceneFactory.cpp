@@ -2,6 +2,7 @@
 
 #include "ArchiveCompression.h"
 #include "Bitmap.h"
+#include "BitmapPool.h"
 #include "Instance.h"
 #include "Light.h"
 #include "Logger.h"
@@ -82,10 +83,10 @@ std::unique_ptr<Bitmap> SceneFactory::createBitmap(const uint8_t* data, const si
     bitmap->width = metadata.width;
     bitmap->height = metadata.height;
     bitmap->arraySize = bitmap->type == BITMAP_TYPE_3D ? metadata.depth : metadata.arraySize;
-    bitmap->data = operator new(bitmap->width * bitmap->height * bitmap->arraySize * (size_t)bitmap->format);
+    bitmap->data = BitmapPool::get().acquire(bitmap->getDataSize());
 
     for (size_t i = 0; i < bitmap->arraySize; i++)
-        memcpy(bitmap->getColorPtr(bitmap->width * bitmap->height * i), scratchImage->GetImage(0, i, 0)->pixels, bitmap->width * bitmap->height * (size_t)bitmap->format);
+        memcpy(bitmap->getColorPtr(bitmap->width * bitmap->height * i), scratchImage->GetImage(0, i, 0)->pixels, bitmap->width * bitmap->height * bitmap->getTexelSize());
 
     return bitmap;
 }
@@ -4,6 +4,177 @@
 #include "Bitmap.h"
 #include "Instance.h"
 #include "Mesh.h"
+#include "Utilities.h"
+
+namespace
+{
+    constexpr size_t SEAM_TILE_SIZE = 8;
+    constexpr uint32_t INVALID_MESH_INDEX = ~0u;
+
+    struct PositionKey
+    {
+        int32_t values[3];
+
+        bool operator==(const PositionKey& other) const
+        {
+            return memcmp(values, other.values, sizeof(values)) == 0;
+        }
+
+    };
+
+    struct PositionKeyHash
+    {
+        size_t operator()(const PositionKey& key) const
+        {
+            return hashData(key.values, sizeof(key.values));
+        }
+    };
+
+    // Cells are about ten times the nearlyEqual tolerance, so nearly equal positions always land in the same or an adjacent cell
+    PositionKey makePositionKey(const Vector3& position)
+    {
+        return
+        {
+            (int32_t)floorf(position.x() * 1024.0f),
+            (int32_t)floorf(position.y() * 1024.0f),
+            (int32_t)floorf(position.z() * 1024.0f)
+        };
+    }
+
+    // Returns the lowest vertex index among the nearly equal positions of every vertex, indices run across all meshes.
+    // Chains of nearly equal positions are joined, so two positions within the tolerance never end up with different ids.
+    std::vector<uint32_t> weldPositions(const Instance& instance, const std::vector<size_t>& vertexOffsets)
+    {
+        std::vector<const Vector3*> positions(vertexOffsets.back());
+
+        for (size_t i = 0; i < instance.meshes.size(); i++)
+        {
+            const Mesh* mesh = instance.meshes[i];
+
+            for (size_t j = 0; j < mesh->vertexCount; j++)
+                positions[vertexOffsets[i] + j] = &mesh->vertices[j].position;
+        }
+
+        std::vector<uint32_t> parents(positions.size());
+        for (size_t i = 0; i < parents.size(); i++)
+            parents[i] = (uint32_t)i;
+
+        const auto findRoot = [&](uint32_t index)
+        {
+            while (parents[index] != index)
+                index = parents[index] = parents[parents[index]];
+
+            return index;
+        };
+
+        phmap::flat_hash_map<PositionKey, std::vector<uint32_t>, PositionKeyHash> cells;
+
+        for (uint32_t i = 0; i < (uint32_t)positions.size(); i++)
+        {
+            const PositionKey key = makePositionKey(*positions[i]);
+
+            for (int32_t z = -1; z <= 1; z++)
+            {
+                for (int32_t y = -1; y <= 1; y++)
+                {
+                    for (int32_t x = -1; x <= 1; x++)
+                    {
+                        const auto cell = cells.find({ key.values[0] + x, key.values[1] + y, key.values[2] + z });
+                        if (cell == cells.end())
+                            continue;
+
+                        for (const uint32_t j : cell->second)
+                        {
+                            if (!nearlyEqual(*positions[i], *positions[j]))
+                                continue;
+
+                            const uint32_t rootA = findRoot(i);
+                            const uint32_t rootB = findRoot(j);
+
+                            if (rootA != rootB)
+                                parents[std::max(rootA, rootB)] = std::min(rootA, rootB);
+                        }
+                    }
+                }
+            }
+
+            cells[key].push_back(i);
+        }
+
+        for (uint32_t i = 0; i < (uint32_t)parents.size(); i++)
+            parents[i] = findRoot(i);
+
+        return parents;
+    }
+
+    struct HalfEdge
+    {
+        uint32_t key[2];
+        uint32_t meshIndex;
+        uint32_t triangleIndex;
+        const Vertex* start;
+        const Vertex* end;
+
+        // Mesh and triangle indices keep the order of matching edges deterministic
+        bool operator<(const HalfEdge& other) const
+        {
+            if (key[0] != other.key[0]) return key[0] < other.key[0];
+            if (key[1] != other.key[1]) return key[1] < other.key[1];
+            if (meshIndex != other.meshIndex) return meshIndex < other.meshIndex;
+            if (triangleIndex != other.triangleIndex) return triangleIndex < other.triangleIndex;
+            return start < other.start;
+        }
+    };
+
+    // Returns the tile ranges covering [begin, end] texels, wrapping around like texel lookups do.
+    size_t getTileRanges(const int64_t begin, const int64_t end, const size_t size, const size_t tileCount, std::pair<size_t, size_t>* ranges)
+    {
+        if (end - begin + 1 >= (int64_t)size)
+        {
+            ranges[0] = std::make_pair(0, tileCount - 1);
+            return 1;
+        }
+
+        const size_t wrappedBegin = (size_t)(((begin % (int64_t)size) + (int64_t)size) % (int64_t)size) / SEAM_TILE_SIZE;
+        const size_t wrappedEnd = (size_t)(((end % (int64_t)size) + (int64_t)size) % (int64_t)size) / SEAM_TILE_SIZE;
+
+        if (wrappedBegin <= wrappedEnd)
+        {
+            ranges[0] = std::make_pair(wrappedBegin, wrappedEnd);
+            return 1;
+        }
+
+        ranges[0] = std::make_pair(wrappedBegin, tileCount - 1);
+        ranges[1] = std::make_pair(0, wrappedEnd);
+        return 2;
+    }
+
+    // Appends every tile the blending of a segment can touch, bake point offsets reach one texel around it.
+    void getTiles(const Vector2& start, const Vector2& end, const size_t width, const size_t height,
+        const size_t tileCountX, const size_t tileCountY, std::vector<size_t>& tiles)
+    {
+        std::pair<size_t, size_t> rangesX[2];
+        std::pair<size_t, size_t> rangesY[2];
+
+        const size_t rangeCountX = getTileRanges((int64_t)floorf(std::min(start.x(), end.x()) * (float)width) - 1,
+            (int64_t)floorf(std::max(start.x(), end.x()) * (float)width) + 1, width, tileCountX, rangesX);
+
+        const size_t rangeCountY = getTileRanges((int64_t)floorf(std::min(start.y(), end.y()) * (float)height) - 1,
+            (int64_t)floorf(std::max(start.y(), end.y()) * (float)height) + 1, height, tileCountY, rangesY);
+
+        for (size_t i = 0; i < rangeCountY; i++)
+        {
+            for (size_t y = rangesY[i].first; y <= rangesY[i].second; y++)
+            {
+                for (size_t j = 0; j < rangeCountX; j++)
+                {
+                    for (size_t x = rangesX[j].first; x <= rangesX[j].second; x++)
+                        tiles.push_back(y * tileCountX + x);
+                }
+            }
+        }
+    }
+}
 
 void SeamOptimizer::blend(const size_t stepCount, const Vector2& startA, const Vector2& endA,
     const Vector2& startB, const Vector2& endB, const Bitmap& bitmap)
@@ -37,44 +208,23 @@ void SeamOptimizer::blend(const size_t stepCount, const Vector2& startA, const V
     }
 }
 
-void SeamOptimizer::compareAndBlend(const Mesh& mA, const Mesh& mB, const Triangle& tA, const Triangle& tB, const Bitmap& bitmap)
+void SeamOptimizer::compare(const Vertex& startA, const Vertex& endA, const Vertex* startB, const Vertex* endB, std::vector<SeamEdge>& edges)
 {
-    const Vertex* vA[3];
-    const Vertex* vB[3];
-
-    vA[0] = &mA.vertices[tA.a];
-    vA[1] = &mA.vertices[tA.b];
-    vA[2] = &mA.vertices[tA.c];
-    vB[0] = &mB.vertices[tB.a];
-    vB[1] = &mB.vertices[tB.b];
-    vB[2] = &mB.vertices[tB.c];
+    // Triangles sharing an edge usually wind it in opposite directions
+    if (!nearlyEqual(startA.position, startB->position))
+        std::swap(startB, endB);
 
-    for (size_t startA = 0; startA < 3; startA++)
-    {
-        const int32_t startB = findVertex(vA[startA]->position, vA[startA]->normal, *vB[0], *vB[1], *vB[2]);
-        if (startB == -1)
-            continue;
-
-        const bool startNearlyEqual = nearlyEqual(vA[startA]->vPos, vB[startB]->vPos);
-
-        for (size_t endB = 0; endB < 3; endB++)
-        {
-            if (startB == endB)
-                continue;
+    if (!nearlyEqual(startA.position, startB->position) || !nearlyEqual(endA.position, endB->position))
+        return;
 
-            const int32_t endA = findVertex(vB[endB]->position, vB[endB]->normal, *vA[0], *vA[1], *vA[2]);
-            if (endA == -1)
-                continue;
+    // Hard edges aren't seams
+    if (startA.normal.dot(startB->normal) <= 0.9f || endA.normal.dot(endB->normal) <= 0.9f)
+        return;
 
-            if (startNearlyEqual && nearlyEqual(vA[endA]->vPos, vB[endB]->vPos))
-                continue;
+    if (nearlyEqual(startA.vPos, startB->vPos) && nearlyEqual(endA.vPos, endB->vPos))
+        return;
 
-            const size_t cA = computeStepCount(vA[startA]->vPos, vA[endA]->vPos, bitmap.width, bitmap.height);
-            const size_t cB = computeStepCount(vB[startB]->vPos, vB[endB]->vPos, bitmap.width, bitmap.height);
-
-            blend(std::max(cA, cB), vA[startA]->vPos, vA[endA]->vPos, vB[startB]->vPos, vB[endB]->vPos, bitmap);
-        }
-    }
+    edges.push_back({ startA.vPos, endA.vPos, startB->vPos, endB->vPos });
 }
 
 size_t SeamOptimizer::computeStepCount(const Vector2& p1, const Vector2& p2, const size_t width, const size_t height)
@@ -84,67 +234,177 @@ size_t SeamOptimizer::computeStepCount(const Vector2& p1, const Vector2& p2, con
     return (size_t)ceilf(sqrtf(x * x + y * y));
 }
 
-int32_t SeamOptimizer::findVertex(const Vector3& position, const Vector3& normal, const Vertex& a, const Vertex& b, const Vertex& c)
+SeamOptimizer::SeamOptimizer(const Instance& instance)
 {
-    if (nearlyEqual(a.position, position) && a.normal.dot(normal) > 0.9f) return 0;
-    if (nearlyEqual(b.position, position) && b.normal.dot(normal) > 0.9f) return 1;
-    if (nearlyEqual(c.position, position) && c.normal.dot(normal) > 0.9f) return 2;
-    return -1;
-}
+    std::vector<size_t> triangleOffsets(instance.meshes.size() + 1);
 
-SeamOptimizer::SeamOptimizer(const Instance& instance) : instance(instance)
-{
     for (size_t i = 0; i < instance.meshes.size(); i++)
-    {
-        const Mesh* mesh = instance.meshes[i];
+        triangleOffsets[i + 1] = triangleOffsets[i] + instance.meshes[i]->triangleCount;
 
-        for (size_t j = 0; j < mesh->triangleCount; j++)
+    std::vector<size_t> vertexOffsets(instance.meshes.size() + 1);
+
+    for (size_t i = 0; i < instance.meshes.size(); i++)
+        vertexOffsets[i + 1] = vertexOffsets[i] + instance.meshes[i]->vertexCount;
+
+    const std::vector<uint32_t> positionIds = weldPositions(instance, vertexOffsets);
+
+    // Key every triangle edge on its welded endpoint positions, edges shared in 3D end up next to each other once sorted
+    std::vector<HalfEdge> halfEdges(triangleOffsets.back() * 3);
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, instance.meshes.size(), 1), [&](const tbb::blocked_range<size_t>& meshRange)
+    {
+        for (size_t i = meshRange.begin(); i < meshRange.end(); i++)
         {
-            const Triangle& triangle = mesh->triangles[j];
-            const Vertex& a = mesh->vertices[triangle.a];
-            const Vertex& b = mesh->vertices[triangle.b];
-            const Vertex& c = mesh->vertices[triangle.c];
+            const Mesh* mesh = instance.meshes[i];
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh->triangleCount), [&](const tbb::blocked_range<size_t>& range)
+            {
+                for (size_t j = range.begin(); j < range.end(); j++)
+                {
+                    const Triangle& triangle = mesh->triangles[j];
+                    const Vertex* vertices[] = { &mesh->vertices[triangle.a], &mesh->vertices[triangle.b], &mesh->vertices[triangle.c] };
+                    const uint32_t ids[] = { positionIds[vertexOffsets[i] + triangle.a], positionIds[vertexOffsets[i] + triangle.b], positionIds[vertexOffsets[i] + triangle.c] };
+
+                    // Skip if the triangle is degenerate
+                    const bool degenerate = nearlyEqual(vertices[0]->vPos, vertices[1]->vPos) ||
+                        nearlyEqual(vertices[1]->vPos, vertices[2]->vPos) || nearlyEqual(vertices[2]->vPos, vertices[0]->vPos);
+
+                    for (size_t k = 0; k < 3; k++)
+                    {
+                        HalfEdge& halfEdge = halfEdges[(triangleOffsets[i] + j) * 3 + k];
 
-            // Skip if the triangle is degenerate
-            if (nearlyEqual(a.vPos, b.vPos) || nearlyEqual(b.vPos, c.vPos) || nearlyEqual(c.vPos, a.vPos))
-                continue;
+                        halfEdge.meshIndex = degenerate ? INVALID_MESH_INDEX : (uint32_t)i;
+                        halfEdge.triangleIndex = (uint32_t)j;
+                        halfEdge.start = vertices[k];
+                        halfEdge.end = vertices[(k + 1) % 3];
 
-            nodes.push_back({ std::min(a.position.x(), std::min(b.position.x(), c.position.x())), (uint32_t)i, (uint32_t)j });
+                        halfEdge.key[0] = std::min(ids[k], ids[(k + 1) % 3]);
+                        halfEdge.key[1] = std::max(ids[k], ids[(k + 1) % 3]);
+                    }
+                }
+            });
         }
+    });
+
+    halfEdges.erase(std::remove_if(halfEdges.begin(), halfEdges.end(), 
+        [](const HalfEdge& halfEdge) { return halfEdge.meshIndex == INVALID_MESH_INDEX; }), halfEdges.end());
+
+    tbb::parallel_sort(halfEdges.begin(), halfEdges.end());
+
+    std::vector<std::pair<size_t, size_t>> groups;
+
+    for (size_t i = 0; i < halfEdges.size();)
+    {
+        size_t end = i + 1;
+        while (end < halfEdges.size() && halfEdges[end].key[0] == halfEdges[i].key[0] && halfEdges[end].key[1] == halfEdges[i].key[1])
+            end++;
+
+        if (end - i > 1)
+            groups.emplace_back(i, end);
+
+        i = end;
     }
 
-    nodes.sort([](const auto& left, const auto& right) { return left.key < right.key; });
+    // Match every pair within a group, results are kept per group so the edge order doesn't depend on scheduling
+    std::vector<std::vector<SeamEdge>> groupEdges(groups.size());
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, groups.size()), [&](const tbb::blocked_range<size_t>& range)
+    {
+        for (size_t r = range.begin(); r < range.end(); r++)
+        {
+            for (size_t i = groups[r].first; i < groups[r].second; i++)
+            {
+                const HalfEdge& halfEdgeA = halfEdges[i];
+
+                for (size_t j = i + 1; j < groups[r].second; j++)
+                {
+                    const HalfEdge& halfEdgeB = halfEdges[j];
+
+                    if (halfEdgeA.meshIndex == halfEdgeB.meshIndex && halfEdgeA.triangleIndex == halfEdgeB.triangleIndex)
+                        continue;
+
+                    compare(*halfEdgeA.start, *halfEdgeA.end, halfEdgeB.start, halfEdgeB.end, groupEdges[r]);
+                }
+            }
+        }
+    });
+
+    size_t edgeCount = 0;
+    for (auto& currentEdges : groupEdges)
+        edgeCount += currentEdges.size();
+
+    edges.reserve(edgeCount);
+
+    for (auto& currentEdges : groupEdges)
+        edges.insert(edges.end(), currentEdges.begin(), currentEdges.end());
 }
 
 SeamOptimizer::~SeamOptimizer() = default;
 
-std::unique_ptr<Bitmap> SeamOptimizer::optimize(const Bitmap& bitmap) const
+const std::vector<SeamEdge>& SeamOptimizer::getEdges() const
+{
+    return edges;
+}
+
+void SeamOptimizer::apply(const Bitmap& bitmap) const
 {
-    std::unique_ptr<Bitmap> optimized = std::make_unique<Bitmap>(bitmap, true);
+    // Edges share texels, an edge gets blended one batch after the last edge touching any of its tiles.
+    // Edges within a batch never touch the same texel, so the result stays the same as blending them in order.
+    const size_t tileCountX = (bitmap.width + SEAM_TILE_SIZE - 1) / SEAM_TILE_SIZE;
+    const size_t tileCountY = (bitmap.height + SEAM_TILE_SIZE - 1) / SEAM_TILE_SIZE;
+
+    std::vector<uint32_t> tileBatches(tileCountX * tileCountY);
+    std::vector<uint32_t> edgeBatches(edges.size());
+    std::vector<size_t> tiles;
+    uint32_t batchCount = 0;
+
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        const SeamEdge& edge = edges[i];
+
+        tiles.clear();
+        getTiles(edge.startA, edge.endA, bitmap.width, bitmap.height, tileCountX, tileCountY, tiles);
+        getTiles(edge.startB, edge.endB, bitmap.width, bitmap.height, tileCountX, tileCountY, tiles);
+
+        uint32_t batch = 0;
+        for (const size_t tile : tiles)
+            batch = std::max(batch, tileBatches[tile]);
+
+        for (const size_t tile : tiles)
+            tileBatches[tile] = batch + 1;
+
+        edgeBatches[i] = batch;
+        batchCount = std::max(batchCount, batch + 1);
+    }
+
+    std::vector<uint32_t> batchOffsets(batchCount + 1);
+    for (const uint32_t batch : edgeBatches)
+        ++batchOffsets[batch + 1];
+
+    for (size_t i = 0; i < batchCount; i++)
+        batchOffsets[i + 1] += batchOffsets[i];
 
-    std::list<const SeamNode*> list;
-    for (auto& node : nodes)
+    std::vector<uint32_t> batchEdges(edges.size());
     {
-        list.push_back(&node);
-        for (auto it = list.begin(); it != list.end();)
+        std::vector<uint32_t> batchSizes(batchOffsets.begin(), batchOffsets.end() - 1);
+
+        for (size_t i = 0; i < edges.size(); i++)
+            batchEdges[batchSizes[edgeBatches[i]]++] = (uint32_t)i;
+    }
+
+    for (size_t i = 0; i < batchCount; i++)
+    {
+        tbb::parallel_for(tbb::blocked_range<size_t>(batchOffsets[i], batchOffsets[i + 1]), [&](const tbb::blocked_range<size_t>& range)
         {
-            if (abs(node.key - (*it)->key) < 0.0001f)
+            for (size_t j = range.begin(); j < range.end(); j++)
             {
-                const Mesh* meshA = instance.meshes[node.meshIndex];
-                const Triangle& triangleA = meshA->triangles[node.triangleIndex];
-                const Mesh* meshB = instance.meshes[(*it)->meshIndex];
-                const Triangle& triangleB = meshB->triangles[(*it)->triangleIndex];
+                const SeamEdge& edge = edges[batchEdges[j]];
 
-                compareAndBlend(*meshA, *meshB, triangleA, triangleB, *optimized);
+                const size_t cA = computeStepCount(edge.startA, edge.endA, bitmap.width, bitmap.height);
+                const size_t cB = computeStepCount(edge.startB, edge.endB, bitmap.width, bitmap.height);
 
-                ++it;
+                blend(std::max(cA, cB), edge.startA, edge.endA, edge.startB, edge.endB, bitmap);
             }
-            else
-            {
-                it = list.erase(it);
-            }
-        }
+        });
     }
-
-    return optimized;
 }
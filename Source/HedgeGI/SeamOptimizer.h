@@ -7,25 +7,29 @@ class Mesh;
 struct Triangle;
 struct Vertex;
 
-struct SeamNode
+// Pair of lightmap UV segments that meet at the same edge in 3D space.
+struct SeamEdge
 {
-    float key;
-    uint32_t meshIndex;
-    uint32_t triangleIndex;
+    Vector2 startA;
+    Vector2 endA;
+    Vector2 startB;
+    Vector2 endB;
 };
 
 class SeamOptimizer
 {
-    const Instance& instance;
-    std::list<SeamNode> nodes;
+    std::vector<SeamEdge> edges;
 
     static void blend(size_t stepCount, const Vector2& startA, const Vector2& endA, const Vector2& startB, const Vector2& endB, const Bitmap& bitmap);
-    static void compareAndBlend(const Mesh& mA, const Mesh& mB, const Triangle& tA, const Triangle& tB, const Bitmap& bitmap);
+    static void compare(const Vertex& startA, const Vertex& endA, const Vertex* startB, const Vertex* endB, std::vector<SeamEdge>& edges);
     static size_t computeStepCount(const Vector2& p1, const Vector2& p2, size_t width, size_t height);
-    static int32_t findVertex(const Vector3& position, const Vector3& normal, const Vertex& a, const Vertex& b, const Vertex& c);
 public:
+    // Seam edges only depend on the instance, they get matched once here by hashing triangle edges on their 3D positions.
     SeamOptimizer(const Instance& instance);
     ~SeamOptimizer();
 
-    std::unique_ptr<Bitmap> optimize(const Bitmap& bitmap) const;
+    const std::vector<SeamEdge>& getEdges() const;
+
+    // Blends the texels along every seam edge in place, edges that don't share texels get blended in parallel.
+    void apply(const Bitmap& bitmap) const;
 };
@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include "BakeProgress.h"
+#include "BitmapPool.h"
 #include "Scene.h"
 
 class SnapToClosestTriangle
@@ -16,12 +18,17 @@ public:
     static bool pointQueryFunc(RTCPointQueryFunctionArguments* args);
 
     template<typename TBakePoint>
-    static void process(const RaytracingContext& raytracingContext, std::vector<TBakePoint>& bakePoints, const float radius = 1.0f)
+    static void process(const RaytracingContext& raytracingContext, BakePointArray<TBakePoint>& bakePoints, const float radius = 1.0f, BakeProgress* progress = nullptr)
     {
+        BakeProgress::Context taskContext(progress);
+
         tbb::parallel_for(tbb::blocked_range<size_t>(0, bakePoints.size()), [&](const tbb::blocked_range<size_t> range)
         {
             for (size_t r = range.begin(); r < range.end(); r++)
             {
+                if (progress != nullptr && progress->isCancelled())
+                    return;
+
                 auto& bakePoint = bakePoints[r];
 
                 // Snap to the closest triangle
@@ -39,6 +46,6 @@ public:
 
                 bakePoint.position = userData.newPosition;
             }
-        });
+        }, taskContext.get());
     }
 };
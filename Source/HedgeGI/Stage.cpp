@@ -1,5 +1,4 @@
 ﻿#include "Stage.h"
-#include "AppData.h"
 #include "StageParams.h"
 #include "Logger.h"
 #include "SceneFactory.h"
@@ -33,7 +32,7 @@ void Stage::loadStage(const std::string& directoryPath)
 {
     name = getFileNameWithoutExtension(directoryPath);
     this->directoryPath = directoryPath;
-    get<AppData>()->addRecentStage(directoryPath);
+
     game = detectGameFromStageDirectory(directoryPath);
 
     const auto params = get<StageParams>();
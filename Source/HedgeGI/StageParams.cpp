@@ -1,6 +1,5 @@
 ﻿#include "StageParams.h"
 
-#include "CameraController.h"
 #include "Logger.h"
 #include "Stage.h"
 
@@ -8,7 +7,9 @@ void StageParams::loadProperties()
 {
     const auto stage = get<Stage>();
 
-    get<CameraController>()->load(propertyBag);
+    for (auto& listener : propertyListeners)
+        listener.load(propertyBag);
+
     load(propertyBag);
     viewportResolutionInvRatio = propertyBag.get(PROP("viewportResolutionInvRatio"), 2.0f);
     gammaCorrectionFlag = propertyBag.get(PROP("gammaCorrectionFlag"), false);
@@ -19,6 +20,12 @@ void StageParams::loadProperties()
     saveAsBc7 = propertyBag.get(PROP("saveAsBc7"), false);
     resolutionSuperSampleScale = propertyBag.get(PROP("resolutionSuperSampleScale"), 1);
     useExistingLightField = propertyBag.get(PROP("useExistingLightField"), false);
+    memoryBudget = propertyBag.get(PROP("memoryBudget"), 0u);
+    maxConcurrentBakes = propertyBag.get(PROP("maxConcurrentBakes"), 0u);
+    shardCount = propertyBag.get(PROP("shardCount"), 0u);
+    accumulateSamples = propertyBag.get(PROP("accumulateSamples"), false);
+    targetNoise = propertyBag.get(PROP("targetNoise"), 0.0f);
+    replicateScenePerNode = propertyBag.get(PROP("replicateScenePerNode"), false);
 
     if (stage->getGame() == Game::Forces)
         targetEngine = TargetEngine::HE2;
@@ -26,7 +33,9 @@ void StageParams::loadProperties()
 
 void StageParams::storeProperties()
 {
-    get<CameraController>()->store(propertyBag);
+    for (auto& listener : propertyListeners)
+        listener.store(propertyBag);
+
     store(propertyBag);
     propertyBag.set(PROP("viewportResolutionInvRatio"), viewportResolutionInvRatio);
     propertyBag.set(PROP("gammaCorrectionFlag"), gammaCorrectionFlag);
@@ -37,6 +46,12 @@ void StageParams::storeProperties()
     propertyBag.set(PROP("saveAsBc7"), saveAsBc7);
     propertyBag.set(PROP("resolutionSuperSampleScale"), resolutionSuperSampleScale);
     propertyBag.set(PROP("useExistingLightField"), useExistingLightField);
+    propertyBag.set(PROP("memoryBudget"), memoryBudget);
+    propertyBag.set(PROP("maxConcurrentBakes"), maxConcurrentBakes);
+    propertyBag.set(PROP("shardCount"), shardCount);
+    propertyBag.set(PROP("accumulateSamples"), accumulateSamples);
+    propertyBag.set(PROP("targetNoise"), targetNoise);
+    propertyBag.set(PROP("replicateScenePerNode"), replicateScenePerNode);
 }
 
 bool StageParams::validateOutputDirectoryPath(const bool create) const
@@ -54,3 +69,22 @@ bool StageParams::validateOutputDirectoryPath(const bool create) const
     Logger::log(LogType::Error, "Unable to locate output directory path");
     return false;
 }
+
+std::string StageParams::getCacheDirectoryPath() const
+{
+    return outputDirectoryPath + "/cache";
+}
+
+std::string StageParams::getShardFilePath(const std::string& filePath) const
+{
+    return getShardFilePath(filePath, shardName);
+}
+
+std::string StageParams::getShardFilePath(const std::string& filePath, const std::string& shardName)
+{
+    if (shardName.empty())
+        return filePath;
+
+    const std::filesystem::path path(filePath);
+    return (path.parent_path() / (path.stem().string() + "_" + shardName + path.extension().string())).string();
+}
@@ -11,6 +11,13 @@ enum class BakingFactoryMode
     MetaInstancer
 };
 
+// Lets components outside of the baking core (the viewport camera etc.) keep their settings in the stage properties.
+struct StagePropertyListener
+{
+    std::function<void(const PropertyBag&)> load;
+    std::function<void(PropertyBag&)> store;
+};
+
 class StageParams final : public Component, public BakeParams
 {
 public:
@@ -27,7 +34,29 @@ public:
 
     size_t resolutionSuperSampleScale{ 1 };
 
+    // Adds the samples of every GI bake to the ones of earlier bakes instead of replacing them
+    bool accumulateSamples{};
+
+    // In percent, accumulating bakes skip existing instances that are below it, 0 refines everything
+    float targetNoise{};
+
+    // In megabytes, 0 picks a budget based on the physical memory
+    uint32_t memoryBudget{};
+
+    // Instances the GI pipeline bakes at the same time on top of the memory budget, 0 leaves it to the budget alone
+    uint32_t maxConcurrentBakes{};
+
+    // Builds a copy of the BVH for every NUMA node so rays don't cross the interconnect
+    bool replicateScenePerNode{};
+
+    // Amount of worker processes to split bakes across, 0 or 1 bakes within this process
+    uint32_t shardCount{};
+
+    // Set when running as a shard worker, not saved
+    std::string shardName;
+
     PropertyBag propertyBag;
+    std::vector<StagePropertyListener> propertyListeners;
 
     bool dirty{ false };
     bool dirtyBVH{ false };
@@ -36,4 +65,9 @@ public:
     void storeProperties();
 
     bool validateOutputDirectoryPath(bool create) const;
+    std::string getCacheDirectoryPath() const;
+
+    // Appends the shard name to bookkeeping files so workers don't overwrite each other's.
+    std::string getShardFilePath(const std::string& filePath) const;
+    static std::string getShardFilePath(const std::string& filePath, const std::string& shardName);
 };
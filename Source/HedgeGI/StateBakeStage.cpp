@@ -11,6 +11,7 @@
 #include "Stage.h"
 #include "StageParams.h"
 #include "StateManager.h"
+#include "Viewport.h"
 
 StateBakeStage::StateBakeStage(const bool packAfterFinish) : packAfterFinish(packAfterFinish)
 {
@@ -20,6 +21,7 @@ void StateBakeStage::enter()
 {
     future = std::async(std::launch::async, [this]
     {
+        getContext()->get<Viewport>()->waitForBake();
         getContext()->get<BakeService>()->bake();
     });
 
@@ -84,7 +86,20 @@ void StateBakeStage::update(float deltaTime)
             else
                 sprintf(overlay, "%s (%dx%d)", lastBakedInstance->name.c_str(), resolution, resolution);
 
-            fraction = bakeProgress / (float)std::max<size_t>(1, stage->getScene()->instances.size());
+            // Weight by estimated cost when available, falls back to instance count if everything got skipped
+            fraction = bake->getProgressFraction();
+            if (fraction <= 0.0f)
+                fraction = bakeProgress / (float)std::max<size_t>(1, stage->getScene()->instances.size());
+
+            const double remainingSeconds = bake->getRemainingSeconds();
+            if (remainingSeconds >= 0.0)
+            {
+                const size_t seconds = (size_t)remainingSeconds;
+                const size_t length = strlen(overlay);
+
+                sprintf(overlay + length, " - %02dh:%02dm:%02ds remaining",
+                    (int)(seconds / (60 * 60)), (int)((seconds / 60) % 60), (int)(seconds % 60));
+            }
         }
 
         else if (params->mode == BakingFactoryMode::LightField && lastBakedShlf != nullptr)
@@ -97,6 +112,19 @@ void StateBakeStage::update(float deltaTime)
         ImGui::Separator();
     }
 
+    // Bake points of everything that is currently baking, keeps moving during large instances and light fields
+    const BakeProgress& kernelProgress = bake->getKernelProgress();
+
+    if (const size_t total = kernelProgress.getTotal(); total > 0)
+    {
+        char overlay[64];
+        sprintf(overlay, "%lld/%lld bake points", (long long)std::min(kernelProgress.getDone(), total), (long long)total);
+
+        ImGui::SetNextItemWidth(popupWidth);
+        ImGui::ProgressBar(kernelProgress.getFraction(), { 0, 0 }, overlay);
+        ImGui::Separator();
+    }
+
     if (ImGui::Button("Cancel"))
         bake->requestCancel();
 
@@ -1,5 +1,6 @@
 ﻿#include "StateLoadStage.h"
 
+#include "AppData.h"
 #include "AppWindow.h"
 #include "BakeService.h"
 #include "DockSpaceManager.h"
@@ -26,6 +27,8 @@ void StateLoadStage::enter()
     document.add(std::make_unique<DockSpaceManager>());
     document.initialize();
 
+    getContext()->get<AppData>()->addRecentStage(directoryPath);
+
     future = std::async(std::launch::async, [this]
     {
         document.get<Stage>()->loadStage(directoryPath);
@@ -62,6 +62,27 @@ constexpr uint64_t strHash(const char* const value)
     return hash;
 }
 
+// FNV-1a, used for keying caches and verifying outputs
+inline uint64_t hashData(const void* data, const size_t dataSize, uint64_t hash = 0xCBF29CE484222325)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    for (size_t i = 0; i < dataSize; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
+
+template<typename T>
+inline uint64_t hashValue(const T& value, const uint64_t hash)
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be hashed");
+    return hashData(&value, sizeof(T), hash);
+}
+
 inline std::string wideCharToMultiByte(LPCWSTR value)
 {
     char multiByte[1024];